@@ -0,0 +1,117 @@
+/*******************************************************************************
+ * Blur Stack Implementation
+ *
+ * @author Matthew Munson
+ * @date 5/9/2021
+ *
+ * The builder thread keeps the previous level in float and blurs it by the
+ * difference sigma to get the next one. Only the finished, rounded levels are
+ * shared with the caller, under the lock.
+ *
+ ******************************************************************************/
+
+#include "BlurStack.h"
+#include "../Common/RecursiveGaussian.h"
+
+#include <cmath>
+
+using namespace std;
+using namespace cv;
+
+BlurStack::BlurStack(const Mat& image, const vector<double>& sigmas, bool recursive)
+    : source(image),
+      sigmas(sigmas),
+      recursive(recursive),
+      levels(sigmas.size()),
+      stopping(false)
+{
+    builder = thread(&BlurStack::build, this);
+}
+
+BlurStack::~BlurStack()
+{
+    stopping = true;
+
+    if(builder.joinable())
+        builder.join();
+}
+
+Mat BlurStack::level(size_t index)
+{
+    CV_Assert(index < sigmas.size());
+
+    {
+        lock_guard<mutex> guard(lock);
+
+        if(!levels[index].empty())
+            return levels[index];
+    }
+
+    //Blurred in float, as built levels are, since 8-bit blurs use a shorter kernel
+    Mat converted, direct;
+    source.convertTo(converted, CV_32F);
+    blur(converted, direct, sigmas[index], source.depth());
+
+    return direct;
+}
+
+bool BlurStack::ready(size_t index)
+{
+    lock_guard<mutex> guard(lock);
+
+    return index < levels.size() && !levels[index].empty();
+}
+
+void BlurStack::wait()
+{
+    if(builder.joinable())
+        builder.join();
+}
+
+// Purpose: Build every level in order
+// Preconditions: Runs on the builder thread
+// Postconditions: Every level is stored, unless the stack is being destroyed
+void BlurStack::build()
+{
+    Mat previous;
+    source.convertTo(previous, CV_32F);
+
+    double previousSigma = 0;
+
+    for(size_t i = 0; i < sigmas.size() && !stopping; i++)
+    {
+        //Gaussians compose by adding variances, so only the difference still has to be applied
+        double step = sqrt(sigmas[i] * sigmas[i] - previousSigma * previousSigma);
+
+        Mat next;
+        blur(previous, next, step, CV_32F);
+
+        Mat rounded;
+        next.convertTo(rounded, source.depth());
+
+        {
+            lock_guard<mutex> guard(lock);
+            levels[i] = rounded;
+        }
+
+        previous = next;
+        previousSigma = sigmas[i];
+    }
+}
+
+// Purpose: Blur with the implementation chosen at construction
+// Preconditions: sigma > 0
+// Postconditions: dst has depth ddepth
+void BlurStack::blur(const Mat& src, Mat& dst, double sigma, int ddepth) const
+{
+    if(recursive)
+    {
+        RecursiveGaussian::blur(src, dst, sigma, sigma, ddepth);
+        return;
+    }
+
+    Mat blurred;
+    GaussianBlur(src, blurred, Size(0,0), sigma, sigma);
+
+    blurred.convertTo(dst, ddepth);
+}
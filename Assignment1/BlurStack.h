@@ -0,0 +1,97 @@
+/*******************************************************************************
+ * Blur Stack Signatures
+ *
+ * @author Matthew Munson
+ * @date 5/9/2021
+ *
+ * Every blur level the smoothing slider can show, built once in the
+ * background. Reblurring the whole image from scratch on every slider change
+ * costs a full Gaussian blur per change, and more at the larger sigmas. Instead
+ * each level is derived from the one before it: blurring a Gaussian blur of
+ * sigma s1 by sigma sqrt(s2^2 - s1^2) gives the blur of sigma s2, and the
+ * difference sigmas are much smaller than s2 itself. Once a level is built,
+ * asking for it is a lookup.
+ *
+ * Levels are chained in floating point, so rounding does not accumulate up the
+ * stack; each is rounded to the source depth once for display. Because each
+ * step truncates its own kernel, a level can differ from a floating point
+ * GaussianBlur of the same sigma by a gray level, on under one pixel in a
+ * hundred. An 8-bit GaussianBlur cuts its kernel off at 3 sigma rather than 4,
+ * so it differs from the levels by several gray levels around sharp edges.
+ * With the recursive blur, repeated replication also changes pixels within
+ * about 3 sigma of the border.
+ *
+ * Header file documentation is user-focused. For implementation-level comments
+ * see BlurStack.cpp
+ *
+ ******************************************************************************/
+
+#ifndef MACHINEVISION_BLURSTACK_H
+#define MACHINEVISION_BLURSTACK_H
+
+#include <atomic>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <thread>
+#include <vector>
+
+using namespace cv;
+
+class BlurStack {
+
+public:
+
+    /***********************************************************************************************
+     * Constructor
+     *
+     * Starts building every level on a background thread and returns immediately.
+     *
+     * @param image : The image to blur. It is shared, not copied, and must not be modified while
+     *                the stack exists.
+     * @param sigmas : The sigma of each level, in increasing order
+     * @param recursive : Blur with RecursiveGaussian instead of GaussianBlur
+     **********************************************************************************************/
+    BlurStack(const Mat& image, const std::vector<double>& sigmas, bool recursive = false);
+
+    // Stops the background build and waits for it
+    ~BlurStack();
+
+    BlurStack(const BlurStack&) = delete;
+    BlurStack& operator=(const BlurStack&) = delete;
+
+    /***********************************************************************************************
+     * Level
+     *
+     * @param index : Index into the sigmas given to the constructor
+     * @return The image blurred by that level's sigma. If the background build has not reached it
+     *         yet, the level is blurred directly from the image in floating point instead of
+     *         waiting, so it matches the built level to within the tolerance above.
+     **********************************************************************************************/
+    Mat level(size_t index);
+
+    // Whether a level has been built, so that level() is a lookup
+    bool ready(size_t index);
+
+    // Blocks until every level has been built. Call from the thread that owns the stack.
+    void wait();
+
+private:
+
+    Mat source;
+    std::vector<double> sigmas;
+    bool recursive;
+
+    std::mutex lock;
+    std::vector<Mat> levels;        // Built levels at the source depth, empty until built
+    std::atomic<bool> stopping;
+    std::thread builder;
+
+    // Builds the levels in order, each from the last
+    void build();
+
+    // One Gaussian blur with the configured implementation
+    void blur(const Mat& src, Mat& dst, double sigma, int ddepth) const;
+};
+
+
+#endif //MACHINEVISION_BLURSTACK_H
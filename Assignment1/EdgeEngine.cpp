@@ -0,0 +1,51 @@
+/***************************************************************************************************
+ * Edge Engine Implementation
+ *
+ * @author Matthew Munson
+ * @date 4/25/2021
+ *
+ * Implementation file for the EdgeEngine class. Both methods are thin wrappers around the stages
+ * of FastCanny:
+ *
+ *     - void setImage(const Mat& image)
+ *     - void detect(Mat& edges, double threshold1, double threshold2) const
+ *
+ **************************************************************************************************/
+
+#include "EdgeEngine.h"
+#include "FastCanny.h"
+
+using namespace cv;
+
+// Purpose: Run the gradient and non-maximum suppression stages once for an image
+// Preconditions: image is a non-empty 8-bit image
+// Postconditions: The candidates of image are cached. The gradients themselves are released, as
+//                 only the local maxima are needed for hysteresis.
+void EdgeEngine::setImage(const Mat& image)
+{
+    CV_Assert(image.depth() == CV_8U && !image.empty());
+
+    Mat dx, dy, magnitude;
+
+    FastCanny::computeGradients(image, dx, dy, magnitude);
+
+    FastCanny::suppressNonMaxima(dx, dy, magnitude, maxima);
+}
+
+// Purpose: Run only the threshold-dependent stage
+// Preconditions: setImage has been called
+// Postconditions: edges holds the edge map
+void EdgeEngine::detect(Mat& edges, double threshold1, double threshold2) const
+{
+    CV_Assert(!empty());
+
+    FastCanny::hysteresis(maxima, edges, threshold1, threshold2);
+}
+
+// Purpose: Report whether an image has been set
+// Preconditions: None
+// Postconditions: None
+bool EdgeEngine::empty() const
+{
+    return maxima.empty();
+}
@@ -0,0 +1,61 @@
+/*******************************************************************************
+ * Edge Engine Signatures
+ *
+ * @author Matthew Munson
+ * @date 4/25/2021
+ *
+ * Caches the threshold-independent half of Canny edge detection for one image.
+ * Setting an image runs the Sobel gradients and non-maximum suppression once;
+ * every detect() after that only reruns hysteresis. This is what the Canny
+ * threshold trackbars in the edge detection slider example need, since moving
+ * them does not change the blurred image.
+ *
+ * Header file documentation is user-focused. For implementation-level comments
+ * see EdgeEngine.cpp
+ *
+ ******************************************************************************/
+
+#ifndef MACHINEVISION_EDGEENGINE_H
+#define MACHINEVISION_EDGEENGINE_H
+
+#include <opencv2/opencv.hpp>
+
+using namespace cv;
+
+class EdgeEngine {
+
+public:
+
+    /***********************************************************************************************
+     * Set Image
+     *
+     * Computes and caches the gradients and the non-maximum suppression candidates of an image.
+     * Usually the image has already been blurred.
+     *
+     * @param image : An 8-bit image
+     **********************************************************************************************/
+    void setImage(const Mat& image);
+
+    /***********************************************************************************************
+     * Detect
+     *
+     * Runs hysteresis on the cached candidates. The result is the same as
+     * Canny(image, edges, threshold1, threshold2) on the image passed to setImage.
+     *
+     * @param edges : Receives a CV_8UC1 edge map, 255 on edges and 0 elsewhere
+     * @param threshold1 : First hysteresis threshold
+     * @param threshold2 : Second hysteresis threshold
+     **********************************************************************************************/
+    void detect(Mat& edges, double threshold1, double threshold2) const;
+
+    // True until an image has been set
+    bool empty() const;
+
+private:
+
+    // Gradient magnitude of each non-maximum suppression candidate, zero elsewhere
+    Mat maxima;
+};
+
+
+#endif //MACHINEVISION_EDGEENGINE_H
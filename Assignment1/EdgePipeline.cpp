@@ -0,0 +1,243 @@
+/***************************************************************************************************
+ * Edge Pipeline Implementation
+ *
+ * @author Matthew Munson
+ * @date 4/26/2021
+ *
+ * Implementation file for the EdgePipeline class. Functions include:
+ *
+ * Graph construction and parameters
+ *     - EdgePipeline()
+ *     - void setImage(const Mat& image)
+ *     - void setBlurX(int sizeX, double sigmaX)
+ *     - void setBlurY(int sizeY, double sigmaY)
+ *     - void setThresholds(double threshold1, double threshold2)
+ *     - void setRecursiveBlur(bool enabled)
+ *
+ * Evaluation
+ *     - const Mat& blurred()
+ *     - const Mat& edges()
+ *     - void evaluate(STAGE_TYPES type)
+ *     - void compute(STAGE_TYPES type)
+ *
+ **************************************************************************************************/
+
+#include "EdgePipeline.h"
+#include "../Common/RecursiveGaussian.h"
+#include "../Common/Trace.h"
+
+using namespace std;
+using namespace cv;
+
+/***************************************************************************************************
+ * GRAPH CONSTRUCTION AND PARAMETERS
+ **************************************************************************************************/
+
+// Purpose: Wire up the stages. Stages are referred to by index so the pipeline stays copyable.
+// Preconditions: None
+// Postconditions: Every stage is dirty
+EdgePipeline::EdgePipeline()
+{
+    stages[HORIZONTAL_BLUR].inputs = {SOURCE};
+    stages[VERTICAL_BLUR].inputs = {HORIZONTAL_BLUR};
+    stages[GRADIENTS].inputs = {VERTICAL_BLUR};
+    stages[HYSTERESIS].inputs = {GRADIENTS};
+
+    for(stage& s : stages)
+        s.seenVersions.assign(s.inputs.size(), 0);
+}
+
+// Purpose: Replace the source image
+// Preconditions: image is a non-empty 8-bit image
+// Postconditions: Every stage downstream of the source is out of date
+void EdgePipeline::setImage(const Mat& image)
+{
+    CV_Assert(image.depth() == CV_8U && !image.empty());
+
+    source = image;
+    stages[SOURCE].version++;
+}
+
+// Purpose: Update the horizontal blur parameters
+// Preconditions: None
+// Postconditions: The horizontal blur is dirty if either value changed
+void EdgePipeline::setBlurX(int sizeX, double sigmaX)
+{
+    if(sizeX == this->sizeX && sigmaX == this->sigmaX)
+        return;
+
+    this->sizeX = sizeX;
+    this->sigmaX = sigmaX;
+    stages[HORIZONTAL_BLUR].paramsChanged = true;
+}
+
+// Purpose: Update the vertical blur parameters
+// Preconditions: None
+// Postconditions: The vertical blur is dirty if either value changed
+void EdgePipeline::setBlurY(int sizeY, double sigmaY)
+{
+    if(sizeY == this->sizeY && sigmaY == this->sigmaY)
+        return;
+
+    this->sizeY = sizeY;
+    this->sigmaY = sigmaY;
+    stages[VERTICAL_BLUR].paramsChanged = true;
+}
+
+// Purpose: Update the Canny thresholds
+// Preconditions: None
+// Postconditions: Hysteresis is dirty if either value changed
+void EdgePipeline::setThresholds(double threshold1, double threshold2)
+{
+    if(threshold1 == this->threshold1 && threshold2 == this->threshold2)
+        return;
+
+    this->threshold1 = threshold1;
+    this->threshold2 = threshold2;
+    stages[HYSTERESIS].paramsChanged = true;
+}
+
+// Purpose: Choose between exact and recursive blur passes
+// Preconditions: None
+// Postconditions: Both blur passes are dirty if the choice changed
+void EdgePipeline::setRecursiveBlur(bool enabled)
+{
+    if(enabled == recursiveBlur)
+        return;
+
+    recursiveBlur = enabled;
+    stages[HORIZONTAL_BLUR].paramsChanged = true;
+    stages[VERTICAL_BLUR].paramsChanged = true;
+}
+
+/***************************************************************************************************
+ * EVALUATION
+ **************************************************************************************************/
+
+// Purpose: Get the blurred image
+// Preconditions: An image has been set
+// Postconditions: The blur stages are up to date
+const Mat& EdgePipeline::blurred()
+{
+    evaluate(VERTICAL_BLUR);
+
+    return verticalPass;
+}
+
+// Purpose: Get the edge map
+// Preconditions: An image has been set
+// Postconditions: Every stage is up to date
+const Mat& EdgePipeline::edges()
+{
+    evaluate(HYSTERESIS);
+
+    return edgeMap;
+}
+
+// Purpose: Pull-based evaluation. Inputs are brought up to date first, then the stage reruns only
+//          if its parameters changed or an input has produced a new output since it last ran.
+// Preconditions: An image has been set
+// Postconditions: The stage's cached output is current
+void EdgePipeline::evaluate(STAGE_TYPES type)
+{
+    CV_Assert(!source.empty());
+
+    stage& s = stages[type];
+
+    bool dirty = s.paramsChanged;
+
+    for(size_t i = 0; i < s.inputs.size(); i++)
+    {
+        evaluate(s.inputs[i]);
+
+        dirty |= stages[s.inputs[i]].version != s.seenVersions[i];
+    }
+
+    if(!dirty)
+        return;
+
+    compute(type);
+
+    for(size_t i = 0; i < s.inputs.size(); i++)
+        s.seenVersions[i] = stages[s.inputs[i]].version;
+
+    s.paramsChanged = false;
+    s.version++;
+}
+
+// Purpose: Run one stage
+// Preconditions: The stage's inputs are up to date
+// Postconditions: The stage's cached output is replaced
+void EdgePipeline::compute(STAGE_TYPES type)
+{
+    //The blur is GaussianBlur split into its two passes, and FastCanny splits Canny the same way
+    static const char* const STAGE_NAMES[STAGE_COUNT + 1] =
+        {"source", "GaussianBlur rows", "GaussianBlur columns", "Canny gradients",
+         "Canny hysteresis", ""};
+
+    Trace::span trace(STAGE_NAMES[type]);
+
+    Mat identity = Mat(1, 1, CV_64F, Scalar(1.0));
+
+    switch(type)
+    {
+        case SOURCE:
+            break;
+
+        case HORIZONTAL_BLUR:
+            if(recursiveBlur)
+                RecursiveGaussian::blurRows(source, horizontalPass, sigmaX, CV_32F);
+            else
+                sepFilter2D(source,
+                            horizontalPass,
+                            CV_32F,
+                            gaussianKernel(sizeX, sigmaX),
+                            identity);
+            break;
+
+        case VERTICAL_BLUR:
+            if(recursiveBlur)
+                RecursiveGaussian::blurColumns(horizontalPass,
+                                               verticalPass,
+                                               sigmaY,
+                                               source.depth());
+            else
+                sepFilter2D(horizontalPass,
+                            verticalPass,
+                            source.depth(),
+                            identity,
+                            gaussianKernel(sizeY, sigmaY));
+            break;
+
+        case GRADIENTS:
+            engine.setImage(verticalPass);
+            break;
+
+        case HYSTERESIS:
+            engine.detect(edgeMap, threshold1, threshold2);
+            break;
+
+        case STAGE_COUNT:
+            break;
+    }
+}
+
+// Purpose: Build the same 1D kernel GaussianBlur() builds for an 8-bit image
+// Preconditions: size > 0 or sigma > 0
+// Postconditions: None
+Mat EdgePipeline::gaussianKernel(int size, double sigma)
+{
+    if(size <= 0)
+        size = cvRound(sigma * 3 * 2 + 1) | 1;
+
+    return getGaussianKernel(size, sigma, CV_64F);
+}
+
+/***************************************************************************************************
+ * STAGE RUN COUNTS
+ **************************************************************************************************/
+
+unsigned long EdgePipeline::horizontalBlurRuns() const { return stages[HORIZONTAL_BLUR].version; }
+unsigned long EdgePipeline::verticalBlurRuns() const { return stages[VERTICAL_BLUR].version; }
+unsigned long EdgePipeline::gradientRuns() const { return stages[GRADIENTS].version; }
+unsigned long EdgePipeline::hysteresisRuns() const { return stages[HYSTERESIS].version; }
@@ -0,0 +1,150 @@
+/*******************************************************************************
+ * Edge Pipeline Signatures
+ *
+ * @author Matthew Munson
+ * @date 4/26/2021
+ *
+ * The blur and edge detection chain from the edge detection slider example,
+ * modelled as a small graph of stages:
+ *
+ *     source -> horizontal blur -> vertical blur -> gradients -> hysteresis
+ *
+ * Each stage caches its output and records which parameters and inputs it
+ * depends on. A stage only reruns when one of its own parameters changed or
+ * one of its inputs produced a new output since it last ran. Moving a Canny
+ * threshold therefore skips the blur entirely, and moving Size Y or Sigma Y
+ * reuses the horizontal blur pass.
+ *
+ * The Gaussian blur is split into its two separable passes. The horizontal
+ * pass is kept in floating point, so the result matches GaussianBlur() to
+ * within rounding of the final 8-bit value. With setRecursiveBlur(true) both
+ * passes use RecursiveGaussian instead, whose cost does not grow with sigma.
+ *
+ * Header file documentation is user-focused. For implementation-level comments
+ * see EdgePipeline.cpp
+ *
+ ******************************************************************************/
+
+#ifndef MACHINEVISION_EDGEPIPELINE_H
+#define MACHINEVISION_EDGEPIPELINE_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+#include "EdgeEngine.h"
+
+using namespace std;
+using namespace cv;
+
+class EdgePipeline {
+
+public:
+
+    EdgePipeline();
+
+    /***********************************************************************************************
+     * Set Image
+     *
+     * Sets the 8-bit image at the start of the pipeline. Every stage reruns on the next request.
+     *
+     * @param image : The image to blur and detect edges in
+     **********************************************************************************************/
+    void setImage(const Mat& image);
+
+    /***********************************************************************************************
+     * Parameter Setters
+     *
+     * Each setter only invalidates the stage that reads the parameter, and only if the value
+     * actually changed. Sizes and sigmas follow GaussianBlur(): a size of zero or less is computed
+     * from the sigma.
+     **********************************************************************************************/
+    void setBlurX(int sizeX, double sigmaX);
+    void setBlurY(int sizeY, double sigmaY);
+    void setThresholds(double threshold1, double threshold2);
+
+    /***********************************************************************************************
+     * Set Recursive Blur
+     *
+     * Switches both blur passes between exact kernels (the default) and the recursive
+     * approximation in RecursiveGaussian.h, which ignores the kernel sizes and is faster at large
+     * sigmas.
+     **********************************************************************************************/
+    void setRecursiveBlur(bool enabled);
+
+    /***********************************************************************************************
+     * Blurred
+     *
+     * @return The blurred image, recomputing only the stages that are out of date
+     **********************************************************************************************/
+    const Mat& blurred();
+
+    /***********************************************************************************************
+     * Edges
+     *
+     * @return The Canny edge map of the blurred image, recomputing only the stages that are out of
+     *         date
+     **********************************************************************************************/
+    const Mat& edges();
+
+    // How many times a stage has produced a new output. Useful to check what a change reran.
+    unsigned long horizontalBlurRuns() const;
+    unsigned long verticalBlurRuns() const;
+    unsigned long gradientRuns() const;
+    unsigned long hysteresisRuns() const;
+
+private:
+
+    enum STAGE_TYPES
+    {
+        SOURCE,
+        HORIZONTAL_BLUR,
+        VERTICAL_BLUR,
+        GRADIENTS,
+        HYSTERESIS,
+        STAGE_COUNT
+    };
+
+    // Dependency bookkeeping for one stage
+    struct stage
+    {
+        vector<STAGE_TYPES> inputs;          // Stages whose output this stage reads
+        vector<unsigned long> seenVersions;  // Version of each input when this stage last ran
+        unsigned long version = 0;           // Bumped every time this stage produces an output
+        bool paramsChanged = true;           // One of this stage's own parameters changed
+    };
+
+    stage stages[STAGE_COUNT];
+
+    // Parameters:
+
+    int sizeX = 1;
+    int sizeY = 1;
+
+    double sigmaX = 1.0;
+    double sigmaY = 1.0;
+
+    double threshold1 = 0.0;
+    double threshold2 = 0.0;
+
+    bool recursiveBlur = false;
+
+    // Cached outputs:
+
+    Mat source;
+    Mat horizontalPass; // CV_32F, blurred along rows only
+    Mat verticalPass;   // 8-bit, blurred along both axes
+    EdgeEngine engine;
+    Mat edgeMap;
+
+    // Brings a stage and everything it depends on up to date
+    void evaluate(STAGE_TYPES type);
+
+    // Recomputes the output of a single stage from its (up to date) inputs
+    void compute(STAGE_TYPES type);
+
+    // The 1D Gaussian kernel GaussianBlur() would use for this size and sigma
+    static Mat gaussianKernel(int size, double sigma);
+};
+
+
+#endif //MACHINEVISION_EDGEPIPELINE_H
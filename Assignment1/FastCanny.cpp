@@ -0,0 +1,475 @@
+/***************************************************************************************************
+ * Fast Canny Implementation
+ *
+ * @author Matthew Munson
+ * @date 4/24/2021
+ *
+ * Implementation file for the FastCanny class. The algorithm follows cv::Canny() step for step so
+ * that the two produce identical edge maps:
+ *
+ * Stage 1: Gradients
+ *     - void computeGradients(const Mat& image, Mat& dx, Mat& dy, Mat& magnitude)
+ *
+ * Stage 2: Non-Maximum Suppression
+ *     - void suppressNonMaxima(const Mat& dx, const Mat& dy, const Mat& magnitude, Mat& maxima)
+ *
+ * Stage 3: Hysteresis
+ *     - void hysteresis(const Mat& maxima, Mat& edges, double threshold1, double threshold2)
+ *
+ * Every stage runs over horizontal tiles of the image with parallelFor. The inner loops work on
+ * raw row pointers with no branches on the pixel values so that the compiler can vectorize them.
+ *
+ **************************************************************************************************/
+
+#include "FastCanny.h"
+#include "../Common/PixelFormat.h"
+#include "../Common/TaskScheduler.h"
+
+#include <atomic>
+#include <memory>
+
+using namespace std;
+using namespace cv;
+
+// tan(22.5 degrees) in Q15 fixed point, the same constant OpenCV uses
+static const int CANNY_SHIFT = 15;
+static const int TG22 = (int)(0.4142135623730950488016887242097 * (1 << CANNY_SHIFT) + 0.5);
+
+// Smallest tile handed to a thread. Smaller tiles only add border merges.
+static const int MIN_TILE_ROWS = 16;
+
+/***************************************************************************************************
+ * UNION-FIND HELPERS
+ *
+ * The forest is stored in one array indexed by pixel (row * cols + col). Roots always point to
+ * themselves, and a root is only ever linked beneath a smaller index, so concurrent unions from
+ * different tile borders cannot form a cycle.
+ **************************************************************************************************/
+
+// Purpose: Find the root of a pixel's component, halving the path along the way
+// Preconditions: p belongs to the forest
+// Postconditions: None beyond path compression
+static int findRoot(atomic<int>* parent, int p)
+{
+    int q = parent[p].load(memory_order_relaxed);
+
+    while(q != p)
+    {
+        int r = parent[q].load(memory_order_relaxed);
+
+        // Any ancestor is a valid parent, so this store is safe without a compare-and-swap
+        parent[p].store(r, memory_order_relaxed);
+
+        p = q;
+        q = r;
+    }
+
+    return p;
+}
+
+// Purpose: Merge the components containing a and b
+// Preconditions: a and b belong to the forest
+// Postconditions: a and b share a root
+static void unite(atomic<int>* parent, int a, int b)
+{
+    while(true)
+    {
+        a = findRoot(parent, a);
+        b = findRoot(parent, b);
+
+        if(a == b)
+            return;
+
+        if(a < b)
+            swap(a, b);
+
+        int expected = a;
+
+        if(parent[a].compare_exchange_weak(expected, b))
+            return;
+    }
+}
+
+/***************************************************************************************************
+ * DETECT
+ **************************************************************************************************/
+
+// Purpose: Run the three Canny stages
+// Preconditions: image is an 8-bit image
+// Postconditions: edges holds the edge map. The input is unchanged unless it aliases edges.
+void FastCanny::detect(const Mat& image, Mat& edges, double threshold1, double threshold2)
+{
+    CV_Assert(image.depth() == CV_8U && !image.empty());
+
+    Mat dx, dy, magnitude, maxima;
+
+    computeGradients(image, dx, dy, magnitude);
+
+    suppressNonMaxima(dx, dy, magnitude, maxima);
+
+    hysteresis(maxima, edges, threshold1, threshold2);
+}
+
+// Purpose: Pick a tile height that gives every thread a few tiles to balance the load
+// Preconditions: None
+// Postconditions: None
+int FastCanny::tileHeight(int rows)
+{
+    int tiles = max(1, parallelThreads() * 4);
+
+    return max(MIN_TILE_ROWS, (rows + tiles - 1) / tiles);
+}
+
+/***************************************************************************************************
+ * STAGE 1: GRADIENTS
+ **************************************************************************************************/
+
+// Scratch rows for gradientRow, one set per thread
+struct gradientBuffers
+{
+    vector<short> smooth, diff;       // Column sums with one replicated pixel on each side
+    vector<short> channelDx, channelDy;
+
+    explicit gradientBuffers(int cols)
+        : smooth(cols + 2), diff(cols + 2), channelDx(cols), channelDy(cols) {}
+};
+
+// Purpose: Sobel derivatives and L1 magnitude for one row of an image with Channels channels
+// Preconditions: above, center and below are rows of the image (replicated at the borders)
+// Postconditions: dxRow, dyRow and magRow hold the strongest channel's gradient at each pixel.
+//                 The channel count is a template parameter so that the single-channel case reads
+//                 contiguous bytes and vectorizes.
+template<int Channels>
+static void gradientRow(const uchar* above,
+                        const uchar* center,
+                        const uchar* below,
+                        short* dxRow,
+                        short* dyRow,
+                        short* magRow,
+                        int cols,
+                        gradientBuffers& buffers)
+{
+    short* smooth = buffers.smooth.data();
+    short* diff = buffers.diff.data();
+
+    for(int c = 0; c < Channels; c++)
+    {
+        // Vertical pass: [1 2 1] for dx and [-1 0 1] for dy
+        for(int j = 0; j < cols; j++)
+        {
+            int k = j * Channels + c;
+
+            smooth[j + 1] = (short)(above[k] + 2 * center[k] + below[k]);
+            diff[j + 1] = (short)(below[k] - above[k]);
+        }
+
+        smooth[0] = smooth[1];
+        diff[0] = diff[1];
+        smooth[cols + 1] = smooth[cols];
+        diff[cols + 1] = diff[cols];
+
+        // Horizontal pass: [-1 0 1] for dx and [1 2 1] for dy
+        short* gx = c == 0 ? dxRow : buffers.channelDx.data();
+        short* gy = c == 0 ? dyRow : buffers.channelDy.data();
+
+        for(int j = 0; j < cols; j++)
+        {
+            gx[j] = (short)(smooth[j + 2] - smooth[j]);
+            gy[j] = (short)(diff[j] + 2 * diff[j + 1] + diff[j + 2]);
+        }
+
+        if(c == 0)
+        {
+            for(int j = 0; j < cols; j++)
+                magRow[j] = (short)(abs(gx[j]) + abs(gy[j]));
+
+            continue;
+        }
+
+        // Keep the strongest channel. Ties go to the earlier channel.
+        for(int j = 0; j < cols; j++)
+        {
+            short m = (short)(abs(gx[j]) + abs(gy[j]));
+            bool stronger = m > magRow[j];
+
+            magRow[j] = stronger ? m : magRow[j];
+            dxRow[j] = stronger ? gx[j] : dxRow[j];
+            dyRow[j] = stronger ? gy[j] : dyRow[j];
+        }
+    }
+}
+
+// Purpose: Compute the 3x3 Sobel derivatives and their L1 magnitude
+// Preconditions: image is an 8-bit image with 1, 3 or 4 channels
+// Postconditions: dx and dy are CV_16S images the size of the input. magnitude is a CV_16S image
+//                 with a one pixel border of zeros on every side. For multi-channel images each
+//                 pixel keeps the channel with the largest magnitude; like OpenCV, an alpha
+//                 channel counts as a channel.
+void FastCanny::computeGradients(const Mat& image, Mat& dx, Mat& dy, Mat& magnitude)
+{
+    const int rows = image.rows;
+    const int cols = image.cols;
+
+    dx.create(rows, cols, CV_16SC1);
+    dy.create(rows, cols, CV_16SC1);
+    magnitude = Mat::zeros(rows + 2, cols + 2, CV_16SC1);
+
+    int tile = tileHeight(rows);
+    int tiles = (rows + tile - 1) / tile;
+
+    dispatchPixelFormat(image, [&](auto format)
+    {
+        const int channels = decltype(format)::channels;
+
+        parallelFor(Range(0, tiles), [&](const Range& range)
+        {
+            gradientBuffers buffers(cols);
+
+            for(int i = range.start * tile; i < min(rows, range.end * tile); i++)
+            {
+                // The border is replicated, as in OpenCV's Canny
+                gradientRow<channels>(image.ptr<uchar>(max(i - 1, 0)),
+                                      image.ptr<uchar>(i),
+                                      image.ptr<uchar>(min(i + 1, rows - 1)),
+                                      dx.ptr<short>(i),
+                                      dy.ptr<short>(i),
+                                      magnitude.ptr<short>(i + 1) + 1,
+                                      cols,
+                                      buffers);
+            }
+        });
+    });
+}
+
+/***************************************************************************************************
+ * STAGE 2: NON-MAXIMUM SUPPRESSION
+ **************************************************************************************************/
+
+// Purpose: Non-maximum suppression for one row
+// Preconditions: The magnitude rows are padded by one zero on each side
+// Postconditions: maximaRow holds the magnitude of each local maximum and zero elsewhere. The
+//                 neighbours are picked with selects instead of branches so that the compiler
+//                 can vectorize the loop.
+static void suppressRow(const short* dxRow,
+                        const short* dyRow,
+                        const short* magAbove,
+                        const short* magRow,
+                        const short* magBelow,
+                        short* maximaRow,
+                        int cols)
+{
+    for(int j = 0; j < cols; j++)
+    {
+        int m = magRow[j];
+        int xs = dxRow[j];
+        int ys = dyRow[j];
+
+        int x = abs(xs);
+        int y = abs(ys) << CANNY_SHIFT;
+
+        int tg22x = x * TG22;
+        int tg67x = tg22x + (x << (CANNY_SHIFT + 1));
+
+        bool horizontal = y < tg22x;
+        bool vertical = y > tg67x;
+
+        // Every neighbour is loaded up front so the selects below need no branches
+        int left = magRow[j - 1], right = magRow[j + 1];
+        int aboveLeft = magAbove[j - 1], above = magAbove[j], aboveRight = magAbove[j + 1];
+        int belowLeft = magBelow[j - 1], below = magBelow[j], belowRight = magBelow[j + 1];
+
+        // Diagonal neighbours lean left or right depending on the gradient's quadrant
+        bool leansRight = (xs ^ ys) < 0;
+
+        int diagonalA = leansRight ? aboveRight : aboveLeft;
+        int diagonalB = leansRight ? belowLeft : belowRight;
+
+        int a = horizontal ? left : (vertical ? above : diagonalA);
+        int b = horizontal ? right : (vertical ? below : diagonalB);
+
+        // A tie with the second neighbour still counts as a maximum, except along the diagonals
+        int diagonal = !horizontal & !vertical;
+        int isMax = (m > a) & ((m > b) | ((m == b) & !diagonal));
+
+        maximaRow[j] = isMax ? (short)m : (short)0;
+    }
+}
+
+// Purpose: Thin the gradient to local maxima along the gradient direction
+// Preconditions: dx, dy and magnitude come from computeGradients
+// Postconditions: maxima is a CV_16S image the size of dx. Local maxima keep their magnitude and
+//                 every other pixel is zero. A zero magnitude is never a local maximum, so zero
+//                 is unambiguous.
+void FastCanny::suppressNonMaxima(const Mat& dx, const Mat& dy, const Mat& magnitude, Mat& maxima)
+{
+    const int rows = dx.rows;
+    const int cols = dx.cols;
+
+    maxima.create(rows, cols, CV_16SC1);
+
+    int tile = tileHeight(rows);
+    int tiles = (rows + tile - 1) / tile;
+
+    parallelFor(Range(0, tiles), [&](const Range& range)
+    {
+        for(int i = range.start * tile; i < min(rows, range.end * tile); i++)
+        {
+            const short* dxRow = dx.ptr<short>(i);
+            const short* dyRow = dy.ptr<short>(i);
+            const short* magAbove = magnitude.ptr<short>(i) + 1;
+            const short* magRow = magnitude.ptr<short>(i + 1) + 1;
+            const short* magBelow = magnitude.ptr<short>(i + 2) + 1;
+
+            short* maximaRow = maxima.ptr<short>(i);
+
+            suppressRow(dxRow, dyRow, magAbove, magRow, magBelow, maximaRow, cols);
+        }
+    });
+}
+
+/***************************************************************************************************
+ * STAGE 3: HYSTERESIS
+ **************************************************************************************************/
+
+// Purpose: Keep every candidate that is 8-connected to a strong pixel through other candidates
+// Preconditions: maxima comes from suppressNonMaxima
+// Postconditions: edges is a CV_8UC1 image with 255 on edges and 0 elsewhere
+void FastCanny::hysteresis(const Mat& maxima, Mat& edges, double threshold1, double threshold2)
+{
+    const int rows = maxima.rows;
+    const int cols = maxima.cols;
+    const size_t total = (size_t)rows * cols;
+
+    if(threshold1 > threshold2)
+        swap(threshold1, threshold2);
+
+    // Non-maxima are stored as zero, so a negative low threshold behaves like zero
+    const int low = max(cvFloor(threshold1), 0);
+    const int high = max(cvFloor(threshold2), 0);
+
+    // Turns a row of maxima into EDGE_CLASS values
+    auto classify = [&](const short* maximaRow, uchar* classRow)
+    {
+        for(int j = 0; j < cols; j++)
+        {
+            int m = maximaRow[j];
+
+            classRow[j] = m > high ? STRONG : (m > low ? CANDIDATE : NOT_EDGE);
+        }
+    };
+
+    Mat edgeClass(rows, cols, CV_8UC1);
+
+    // Only the entries for CANDIDATE and STRONG pixels are ever initialized or read
+    unique_ptr<atomic<int>[]> parentStorage(new atomic<int>[total]);
+    unique_ptr<atomic<bool>[]> strongStorage(new atomic<bool>[total]);
+
+    atomic<int>* parent = parentStorage.get();
+    atomic<bool>* strongRoot = strongStorage.get();
+
+    int tile = tileHeight(rows);
+    int tiles = (rows + tile - 1) / tile;
+
+    // 1) Classify and label each tile on its own. Only pixels inside the tile are linked.
+    parallelFor(Range(0, tiles), [&](const Range& range)
+    {
+        for(int t = range.start; t < range.end; t++)
+        {
+            int first = t * tile;
+            int last = min(rows, first + tile);
+
+            for(int i = first; i < last; i++)
+            {
+                uchar* classRow = edgeClass.ptr<uchar>(i);
+
+                classify(maxima.ptr<short>(i), classRow);
+
+                const uchar* classAbove = i > first ? edgeClass.ptr<uchar>(i - 1) : nullptr;
+
+                for(int j = 0; j < cols; j++)
+                {
+                    if(classRow[j] == NOT_EDGE)
+                        continue;
+
+                    int p = i * cols + j;
+
+                    parent[p].store(p, memory_order_relaxed);
+                    strongRoot[p].store(false, memory_order_relaxed);
+
+                    if(j > 0 && classRow[j - 1] != NOT_EDGE)
+                        unite(parent, p, p - 1);
+
+                    if(classAbove == nullptr)
+                        continue;
+
+                    for(int k = max(j - 1, 0); k <= min(j + 1, cols - 1); k++)
+                    {
+                        if(classAbove[k] != NOT_EDGE)
+                            unite(parent, p, p - cols + (k - j));
+                    }
+                }
+            }
+        }
+    });
+
+    // 2) Merge the forests across each border between two tiles
+    parallelFor(Range(1, tiles), [&](const Range& range)
+    {
+        for(int t = range.start; t < range.end; t++)
+        {
+            int i = t * tile;
+
+            const uchar* classRow = edgeClass.ptr<uchar>(i);
+            const uchar* classAbove = edgeClass.ptr<uchar>(i - 1);
+
+            for(int j = 0; j < cols; j++)
+            {
+                if(classRow[j] == NOT_EDGE)
+                    continue;
+
+                int p = i * cols + j;
+
+                for(int k = max(j - 1, 0); k <= min(j + 1, cols - 1); k++)
+                {
+                    if(classAbove[k] != NOT_EDGE)
+                        unite(parent, p, p - cols + (k - j));
+                }
+            }
+        }
+    });
+
+    // 3) Flag every component that contains a strong pixel
+    parallelFor(Range(0, tiles), [&](const Range& range)
+    {
+        for(int i = range.start * tile; i < min(rows, range.end * tile); i++)
+        {
+            const uchar* classRow = edgeClass.ptr<uchar>(i);
+
+            for(int j = 0; j < cols; j++)
+            {
+                if(classRow[j] == STRONG)
+                    strongRoot[findRoot(parent, i * cols + j)].store(true, memory_order_relaxed);
+            }
+        }
+    });
+
+    // 4) Write out the pixels whose component was flagged
+    edges.create(rows, cols, CV_8UC1);
+
+    parallelFor(Range(0, tiles), [&](const Range& range)
+    {
+        for(int i = range.start * tile; i < min(rows, range.end * tile); i++)
+        {
+            const uchar* classRow = edgeClass.ptr<uchar>(i);
+            uchar* edgeRow = edges.ptr<uchar>(i);
+
+            for(int j = 0; j < cols; j++)
+            {
+                bool isEdge = classRow[j] != NOT_EDGE &&
+                              strongRoot[findRoot(parent, i * cols + j)].load(memory_order_relaxed);
+
+                edgeRow[j] = isEdge ? 255 : 0;
+            }
+        }
+    });
+}
@@ -0,0 +1,102 @@
+/*******************************************************************************
+ * Fast Canny Signatures
+ *
+ * @author Matthew Munson
+ * @date 4/24/2021
+ *
+ * An in-house replacement for cv::Canny() that we are able to tune. The edge
+ * map matches OpenCV's Canny() (3x3 aperture, L1 gradient) for the same pair
+ * of thresholds. Work is split across horizontal tiles of the image:
+ *
+ * - Sobel gradients are computed in 16-bit fixed point
+ *
+ * - Non-maximum suppression uses OpenCV's integer tan(22.5) test
+ *
+ * - Hysteresis labels each tile with a union-find forest, then merges the
+ *   forests across tile borders in parallel
+ *
+ * Header file documentation is user-focused. For implementation-level comments
+ * see FastCanny.cpp
+ *
+ ******************************************************************************/
+
+#ifndef MACHINEVISION_FASTCANNY_H
+#define MACHINEVISION_FASTCANNY_H
+
+#include <opencv2/opencv.hpp>
+
+using namespace cv;
+
+class FastCanny {
+
+public:
+
+    /***********************************************************************************************
+     * Detect Edges
+     *
+     * Drop-in replacement for Canny(image, edges, threshold1, threshold2). The input may be an
+     * 8-bit image with 1, 3 or 4 channels; for multi-channel images the channel with the
+     * strongest gradient is used at each pixel, as OpenCV does. The input and output may be the
+     * same Mat.
+     *
+     * @param image : An 8-bit image
+     * @param edges : Receives a CV_8UC1 edge map, 255 on edges and 0 elsewhere
+     * @param threshold1 : First hysteresis threshold
+     * @param threshold2 : Second hysteresis threshold
+     **********************************************************************************************/
+    static void detect(const Mat& image, Mat& edges, double threshold1, double threshold2);
+
+    // Individual stages, for callers that cache the threshold-independent work (see EdgeEngine)
+
+    /***********************************************************************************************
+     * Compute Gradients
+     *
+     * Stage 1. Computes the 3x3 Sobel derivatives and their L1 magnitude.
+     *
+     * @param image : An 8-bit image with 1, 3 or 4 channels
+     * @param dx : Receives the CV_16S horizontal derivative
+     * @param dy : Receives the CV_16S vertical derivative
+     * @param magnitude : Receives the CV_16S magnitude, padded with a one pixel border of zeros
+     **********************************************************************************************/
+    static void computeGradients(const Mat& image, Mat& dx, Mat& dy, Mat& magnitude);
+
+    /***********************************************************************************************
+     * Suppress Non-Maxima
+     *
+     * Stage 2. Thins the gradient to pixels that are a local maximum along the gradient direction.
+     * Does not depend on the thresholds.
+     *
+     * @param dx, dy, magnitude : The output of computeGradients
+     * @param maxima : Receives a CV_16S image holding the magnitude of each local maximum and zero
+     *                 everywhere else
+     **********************************************************************************************/
+    static void suppressNonMaxima(const Mat& dx, const Mat& dy, const Mat& magnitude, Mat& maxima);
+
+    /***********************************************************************************************
+     * Hysteresis
+     *
+     * Stage 3. Keeps the local maxima above threshold2, and the ones above threshold1 that are
+     * connected to them. This is the only stage that depends on the thresholds.
+     *
+     * @param maxima : The output of suppressNonMaxima
+     * @param edges : Receives a CV_8UC1 edge map, 255 on edges and 0 elsewhere
+     * @param threshold1, threshold2 : The hysteresis thresholds, in either order
+     **********************************************************************************************/
+    static void hysteresis(const Mat& maxima, Mat& edges, double threshold1, double threshold2);
+
+private:
+
+    // Pixel classes used during hysteresis, named after OpenCV's
+    enum EDGE_CLASS
+    {
+        CANDIDATE = 0, // Local maximum above the low threshold
+        NOT_EDGE = 1,  // Suppressed or below the low threshold
+        STRONG = 2     // Local maximum above the high threshold
+    };
+
+    // Rows per tile used by every parallel stage
+    static int tileHeight(int rows);
+};
+
+
+#endif //MACHINEVISION_FASTCANNY_H
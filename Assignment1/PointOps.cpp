@@ -0,0 +1,162 @@
+/***************************************************************************************************
+ * Point Operation Chain Implementation
+ *
+ * @author Matthew Munson
+ * @date 4/27/2021
+ *
+ * Implementation file for the PointOpChain class. Functions include:
+ *
+ * Building the chain
+ *     - invert(), scale(), offset(), gamma(), threshold(), clamp()
+ *
+ * Compiling and applying the chain
+ *     - uchar evaluate(int value, int channel)
+ *     - Mat compile(int channels)
+ *     - void apply(const Mat& image, Mat& output)
+ *
+ **************************************************************************************************/
+
+#include "PointOps.h"
+
+using namespace std;
+using namespace cv;
+
+/***************************************************************************************************
+ * BUILDING THE CHAIN
+ *
+ * Purpose: Append an effect to the chain
+ * Preconditions: None
+ * Postconditions: The effect runs after every effect already in the chain
+ **************************************************************************************************/
+
+PointOpChain& PointOpChain::invert() { ops.push_back({INVERT, Scalar(), Scalar()}); return *this; }
+
+PointOpChain& PointOpChain::scale(double alpha) { return scale(Scalar::all(alpha)); }
+PointOpChain& PointOpChain::scale(const Scalar& alpha)
+{
+    ops.push_back({SCALE, alpha, Scalar()});
+    return *this;
+}
+
+PointOpChain& PointOpChain::offset(double beta) { return offset(Scalar::all(beta)); }
+PointOpChain& PointOpChain::offset(const Scalar& beta)
+{
+    ops.push_back({OFFSET, beta, Scalar()});
+    return *this;
+}
+
+PointOpChain& PointOpChain::gamma(double gamma) { return this->gamma(Scalar::all(gamma)); }
+PointOpChain& PointOpChain::gamma(const Scalar& gamma)
+{
+    ops.push_back({GAMMA, gamma, Scalar()});
+    return *this;
+}
+
+PointOpChain& PointOpChain::threshold(double thresh, double maxValue)
+{
+    ops.push_back({THRESHOLD, Scalar::all(thresh), Scalar::all(maxValue)});
+    return *this;
+}
+
+PointOpChain& PointOpChain::clamp(double low, double high)
+{
+    ops.push_back({CLAMP, Scalar::all(low), Scalar::all(high)});
+    return *this;
+}
+
+size_t PointOpChain::size() const { return ops.size(); }
+
+/***************************************************************************************************
+ * COMPILING AND APPLYING THE CHAIN
+ **************************************************************************************************/
+
+// Purpose: Run every effect in order on one value
+// Preconditions: 0 <= value <= 255, 0 <= channel < 4
+// Postconditions: None. Each effect's result is rounded and saturated to 8 bits before the next
+//                 effect sees it, as it would be between two separate OpenCV calls.
+uchar PointOpChain::evaluate(int value, int channel) const
+{
+    uchar x = saturate_cast<uchar>(value);
+
+    for(const pointOp& op : ops)
+    {
+        double a = op.a[channel];
+        double b = op.b[channel];
+
+        switch(op.type)
+        {
+            case INVERT:
+                x = (uchar)(255 - x);
+                break;
+
+            case SCALE:
+                x = saturate_cast<uchar>(abs(x * a));
+                break;
+
+            case OFFSET:
+                x = saturate_cast<uchar>(x + a);
+                break;
+
+            case GAMMA:
+                x = saturate_cast<uchar>(255.0 * pow(x / 255.0, a));
+                break;
+
+            case THRESHOLD:
+                x = x > a ? saturate_cast<uchar>(b) : (uchar)0;
+                break;
+
+            case CLAMP:
+                x = saturate_cast<uchar>(min(max((double)x, a), b));
+                break;
+        }
+    }
+
+    return x;
+}
+
+// Purpose: Compose the chain into one lookup table
+// Preconditions: 1 <= channels <= 4
+// Postconditions: None
+Mat PointOpChain::compile(int channels) const
+{
+    CV_Assert(channels >= 1 && channels <= 4);
+
+    Mat table(1, 256, CV_8UC(channels));
+
+    bool shared = true;
+
+    for(int value = 0; value < 256; value++)
+    {
+        uchar* entry = table.ptr<uchar>(0) + value * channels;
+
+        for(int c = 0; c < channels; c++)
+        {
+            entry[c] = evaluate(value, c);
+            shared &= entry[c] == entry[0];
+        }
+    }
+
+    // LUT() has a faster path for a single-channel table, which it applies to every channel
+    if(shared && channels > 1)
+    {
+        Mat single(1, 256, CV_8UC1);
+
+        for(int value = 0; value < 256; value++)
+            single.at<uchar>(0, value) = table.at<uchar>(0, value * channels);
+
+        return single;
+    }
+
+    return table;
+}
+
+// Purpose: Apply the composed chain
+// Preconditions: image is an 8-bit image with 1 to 4 channels
+// Postconditions: output holds the transformed image. LUT() is vectorized and splits large images
+//                 across OpenCV's thread pool, so this is a single parallel pass over the pixels.
+void PointOpChain::apply(const Mat& image, Mat& output) const
+{
+    CV_Assert(image.depth() == CV_8U);
+
+    LUT(image, compile(image.channels()), output);
+}
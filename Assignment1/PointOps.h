@@ -0,0 +1,115 @@
+/*******************************************************************************
+ * Point Operation Chain Signatures
+ *
+ * @author Matthew Munson
+ * @date 4/27/2021
+ *
+ * Builds a chain of per-pixel effects (invert, scale, offset, gamma, threshold
+ * and clamp) and applies the whole chain in a single pass. Because every effect
+ * maps an 8-bit value to an 8-bit value, any chain can be composed ahead of
+ * time into one 256-entry lookup table per channel. Applying a ten-effect chain
+ * then costs the same as applying one.
+ *
+ * Each effect rounds and saturates to 8 bits before the next one runs, so a
+ * chain gives exactly the same result as calling the matching OpenCV functions
+ * one after another.
+ *
+ * Example:
+ *
+ *     PointOpChain().invert().scale(2.0).apply(image, output);
+ *
+ * Header file documentation is user-focused. For implementation-level comments
+ * see PointOps.cpp
+ *
+ ******************************************************************************/
+
+#ifndef MACHINEVISION_POINTOPS_H
+#define MACHINEVISION_POINTOPS_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+using namespace std;
+using namespace cv;
+
+class PointOpChain {
+
+public:
+
+    // Effects. Every effect returns the chain so calls can be strung together. The Scalar
+    // overloads take a separate value for each channel (blue, green, red, alpha).
+
+    // 255 - value, like bitwise_not()
+    PointOpChain& invert();
+
+    // |value * alpha|, like convertScaleAbs()
+    PointOpChain& scale(double alpha);
+    PointOpChain& scale(const Scalar& alpha);
+
+    // value + beta
+    PointOpChain& offset(double beta);
+    PointOpChain& offset(const Scalar& beta);
+
+    // 255 * (value / 255) ^ gamma. Gamma below 1 brightens, above 1 darkens.
+    PointOpChain& gamma(double gamma);
+    PointOpChain& gamma(const Scalar& gamma);
+
+    // maxValue where value > thresh and 0 elsewhere, like threshold() with THRESH_BINARY
+    PointOpChain& threshold(double thresh, double maxValue = 255);
+
+    // Limits value to [low, high]
+    PointOpChain& clamp(double low, double high);
+
+    /***********************************************************************************************
+     * Compile
+     *
+     * Composes the chain into a lookup table.
+     *
+     * @param channels : The number of channels of the images the table will be used on
+     * @return A 1x256 CV_8U table. It has a single channel when every channel maps the same way,
+     *         and one channel per image channel otherwise.
+     **********************************************************************************************/
+    Mat compile(int channels) const;
+
+    /***********************************************************************************************
+     * Apply
+     *
+     * Applies the whole chain to an 8-bit image in one pass. The input is unchanged unless it is
+     * also the output.
+     *
+     * @param image : An 8-bit image with up to four channels
+     * @param output : Receives the transformed image
+     **********************************************************************************************/
+    void apply(const Mat& image, Mat& output) const;
+
+    // Number of effects in the chain
+    size_t size() const;
+
+private:
+
+    enum OP_TYPES
+    {
+        INVERT,
+        SCALE,
+        OFFSET,
+        GAMMA,
+        THRESHOLD,
+        CLAMP
+    };
+
+    // One effect and its parameters. Per-channel parameters live in a, shared ones in b.
+    struct pointOp
+    {
+        OP_TYPES type;
+        Scalar a;
+        Scalar b;
+    };
+
+    vector<pointOp> ops;
+
+    // Runs the chain for a single input value of one channel
+    uchar evaluate(int value, int channel) const;
+};
+
+
+#endif //MACHINEVISION_POINTOPS_H
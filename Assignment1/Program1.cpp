@@ -7,14 +7,16 @@
  * Implementation file for methods in the Program1 Class. Functions include:
  *
  * Example 1: Basic image processing
+ *     - Mat imgProcessing(const Mat& image)
+ *     - vector<Mat> imgProcessingBatch(const vector<Mat>& images)
  *     - Mat imgProcessingExample(const Mat& image)
  *
  * Example 2: Smoothing Slider Example
- *     - void on_smoothing_trackbar(int alphaSlider, void* testImage)
- *     - void smoothingSliderExample(Mat image)
+ *     - void on_smoothing_trackbar(int alphaSlider, void* blurStack)
+ *     - void smoothingSliderExample(Mat image, bool recursive)
  *
  * Example 3: Edge Detection Slider Example
- *     - void blur_and_canny(Program1 *program, const Mat& image, const string& windowName)
+ *     - void blur_and_canny(Program1 *program, const string& windowName)
  *     - void print_settings(Program1 *program)
  *     - void trackbar_callback(int sliderValue, void*combinedData)
  *     - void edgeDetectionSliderExample(const Mat& image)
@@ -29,39 +31,125 @@
  *     - Sigma Y
  *     - Threshold 1
  *     - Threshold 2
+ *     - Recursive Blur
  *
  **************************************************************************************************/
 
 #include "Program1.h"
+#include "BlurStack.h"
+#include "FastCanny.h"
+#include "PointOps.h"
+#include "../Common/RecursiveGaussian.h"
+#include "../Common/PixelKernels.h"
+#include "../Common/TaskScheduler.h"
+#include "../Common/Trace.h"
 
 using namespace std;
 using namespace cv;
 
+// Settings for the basic image processing steps
+static const double PROCESSING_SIGMA = 2.0;
+static const double PROCESSING_THRESHOLD_1 = 20;
+static const double PROCESSING_THRESHOLD_2 = 60;
+
 /***************************************************************************************************
  * PART I
  **************************************************************************************************/
 
-//Purpose: Demonstrate basic image processing
+//Purpose: Run the basic image processing steps without any display
 //Preconditions: None
 //Postconditions: Image is rotated 180 degrees, grey-scaled, and edges detected.
-Mat Program1::imgProcessingExample(const Mat& image)
+Mat Program1::imgProcessing(const Mat& image)
 {
     Mat copy = Mat();
 
-    //Flip the image vertically and horizontally
-    flip(image, copy, 0);
-
-    //Reduce the color to greyscale
-    cvtColor(copy, copy, COLOR_BGR2GRAY);
+    //Rotate the image 180 degrees (flip it vertically and horizontally) and reduce the color to
+    //greyscale, in a single pass. Grey, BGR and BGRA inputs are all accepted.
+    PixelKernels::flipToGray(image, copy, -1);
 
     //Blur the image
+    Trace::span blur("GaussianBlur");
     GaussianBlur(copy,
                  copy,
                  Size(0,0),
-                 2.0,
-                 2.0);
+                 PROCESSING_SIGMA,
+                 PROCESSING_SIGMA);
+    blur.end();
+
+    Trace::span canny("Canny");
+    FastCanny::detect(copy, copy, PROCESSING_THRESHOLD_1, PROCESSING_THRESHOLD_2);
+
+    return copy;
+}
+
+//Purpose: Run the basic image processing steps on a batch of same-size images
+//Preconditions: Every image has the same size and type
+//Postconditions: Each image is rotated 180 degrees, grey-scaled, and edges detected. Each stage is
+//                one parallel pass over the whole batch. OpenCV runs parallel loops nested inside
+//                another one serially, so the per-image blur and edge detection below each stay
+//                on the thread that picked up the image.
+vector<Mat> Program1::imgProcessingBatch(const vector<Mat>& images)
+{
+    if(images.empty())
+        return vector<Mat>();
+
+    int rows = images[0].rows;
+    int count = (int)images.size();
+
+    //Stage 1: rotate and reduce to greyscale, every image into one stack of planes
+    Mat gray;
+    PixelKernels::flipToGray(images, gray, -1);
+
+    //Stage 2: blur each plane. BORDER_ISOLATED keeps a plane from reading its neighbours.
+    Mat blurred(gray.size(), CV_8UC1);
+
+    parallelFor(Range(0, count), [&](const Range& range)
+    {
+        for(int k = range.start; k < range.end; k++)
+        {
+            Trace::span trace("GaussianBlur");
+            Mat plane = blurred.rowRange(k * rows, (k + 1) * rows);
+
+            GaussianBlur(gray.rowRange(k * rows, (k + 1) * rows),
+                         plane,
+                         Size(0,0),
+                         PROCESSING_SIGMA,
+                         PROCESSING_SIGMA,
+                         BORDER_DEFAULT | BORDER_ISOLATED);
+        }
+    });
+
+    //Stage 3: detect edges in each plane, written straight into the output stack
+    Mat edges(gray.size(), CV_8UC1);
+
+    parallelFor(Range(0, count), [&](const Range& range)
+    {
+        for(int k = range.start; k < range.end; k++)
+        {
+            Trace::span trace("Canny");
+            Mat plane = edges.rowRange(k * rows, (k + 1) * rows);
+
+            FastCanny::detect(blurred.rowRange(k * rows, (k + 1) * rows),
+                              plane,
+                              PROCESSING_THRESHOLD_1,
+                              PROCESSING_THRESHOLD_2);
+        }
+    });
+
+    vector<Mat> results;
+
+    for(int k = 0; k < count; k++)
+        results.push_back(edges.rowRange(k * rows, (k + 1) * rows));
+
+    return results;
+}
 
-    Canny(copy, copy, 20, 60);
+//Purpose: Demonstrate basic image processing
+//Preconditions: None
+//Postconditions: Image is rotated 180 degrees, grey-scaled, and edges detected.
+Mat Program1::imgProcessingExample(const Mat& image)
+{
+    Mat copy = imgProcessing(image);
 
     //Display Processed Image:
 
@@ -83,19 +171,14 @@ Mat Program1::imgProcessingExample(const Mat& image)
 
 // Callback function for when the blur trackbar is changed
 // Purpose: Handle changes to the blur trackbar
-// Preconditions: Trackbar initialized, testImage struct created and passed in
-// Postconditions: Image blurred and displayed
-void Program1::on_smoothing_trackbar(int alphaSlider, void* testImage)
+// Preconditions: Trackbar initialized, BlurStack created and passed in
+// Postconditions: Blurred image looked up (or blurred, if not built yet) and displayed
+void Program1::on_smoothing_trackbar(int alphaSlider, void* blurStack)
 {
-    Mat im = *((Mat*) testImage);
+    BlurStack* stack = (BlurStack*) blurStack;
 
-    Mat copy = Mat();
-
-    GaussianBlur(im,
-                 copy,
-                 Size(0,0),
-                 alphaSlider + 1,
-                 alphaSlider + 1);
+    //Level i is blurred with sigma i + 1
+    Mat copy = stack->level(alphaSlider);
 
     imshow("Smoothing Adjustment", copy);
 };
@@ -104,7 +187,7 @@ void Program1::on_smoothing_trackbar(int alphaSlider, void* testImage)
 // Purpose: Demonstrate trackbar usage and blur of an image
 // Preconditions: None
 // Postconditions: None
-void Program1::smoothingSliderExample(Mat image)
+void Program1::smoothingSliderExample(Mat image, bool recursive)
 {
     string windowName = "Smoothing Adjustment";
 
@@ -114,12 +197,21 @@ void Program1::smoothingSliderExample(Mat image)
 
     int smoothing_slider = 0;
     int smoothing_max = 10;
+
+    //Start building every level the slider can reach while the user looks at the original
+    vector<double> sigmas;
+
+    for(int i = 0; i <= smoothing_max; i++)
+        sigmas.push_back(i + 1);
+
+    BlurStack stack(image, sigmas, recursive);
+
     createTrackbar("Smoothing",
                    windowName,
                    &smoothing_slider,
                    smoothing_max,
                    on_smoothing_trackbar,
-                   &image);
+                   &stack);
 
     waitKey(0);
     destroyWindow(windowName);
@@ -131,25 +223,20 @@ void Program1::smoothingSliderExample(Mat image)
 
 // Applies a gaussian blur and canny edge detection algorithm
 // Purpose: Provide a modular interface and wrap openCV functionality
-// Preconditions: Program 1 initialized. Window created
-// Postconditions: Image display updated
-void Program1::blur_and_canny(Program1 *program, const Mat& image, const string& windowName)
+// Preconditions: Program 1 initialized. Window created. Pipeline image set.
+// Postconditions: Image display updated. Only the pipeline stages whose settings changed since the
+//                 last call are recomputed.
+void Program1::blur_and_canny(Program1 *program, const string& windowName)
 {
-    Mat copy1 = Mat();
-    Mat copy2 = Mat();
-
-    GaussianBlur(image,
-                 copy1,
-                 Size(program->getSizeX(), program->getSizeY()),
-                 program->getSigmaX(),
-                 program->getSigmaY());
+    EdgePipeline& pipeline = program->edgePipeline;
 
+    pipeline.setBlurX(program->getSizeX(), program->getSigmaX());
+    pipeline.setBlurY(program->getSizeY(), program->getSigmaY());
+    pipeline.setThresholds(program->getThreshold1(), program->getThreshold2());
 
-    imshow("Blur Result", copy1);
+    imshow("Blur Result", pipeline.blurred());
 
-    Canny(copy1, copy2, program->getThreshold1(), program->getThreshold2());
-
-    imshow(windowName, copy2);
+    imshow(windowName, pipeline.edges());
 }
 
 // Prints instance variables to console
@@ -220,7 +307,7 @@ void Program1::trackbar_callback(int sliderValue, void*combinedData)
             break;
     }
 
-    blur_and_canny(program, data->image, data->windowName);
+    blur_and_canny(program, data->windowName);
 
     print_settings(program);
 }
@@ -238,15 +325,18 @@ void Program1::edgeDetectionSliderExample(const Mat& image)
     int defaultSliderSize = 20;
     Mat output = Mat();
 
+    // A new image invalidates anything cached from a previous run
+    edgePipeline.setImage(image);
+
     namedWindow(windowName, WINDOW_GUI_NORMAL);
     namedWindow("Blur Result", WINDOW_GUI_NORMAL);
 
-    callbackData size_x_data = {SIZE_X, this, image, windowName};
-    callbackData size_y_data = {SIZE_Y, this, image, windowName};
-    callbackData sigma_x_data = {SIGMA_X, this, image, windowName};
-    callbackData sigma_y_data = {SIGMA_Y, this, image, windowName};
-    callbackData threshold1_data = {THRESHOLD1, this, image, windowName};
-    callbackData threshold2_data = {THRESHOLD2, this, image, windowName};
+    callbackData size_x_data = {SIZE_X, this, windowName};
+    callbackData size_y_data = {SIZE_Y, this, windowName};
+    callbackData sigma_x_data = {SIGMA_X, this, windowName};
+    callbackData sigma_y_data = {SIGMA_Y, this, windowName};
+    callbackData threshold1_data = {THRESHOLD1, this, windowName};
+    callbackData threshold2_data = {THRESHOLD2, this, windowName};
 
     int sizeX_slider = 0;
     int sizeX_max = 10;
@@ -321,11 +411,9 @@ Mat Program1::additionalImageEffectsExample(const Mat& image)
     string windowName = "Additional-Effects";
     Mat inverted;
 
-    //Bitwise not inverts the image
-    bitwise_not(image, inverted);
-
-    //Convert Scale with an alpha > 1.0 brightens the image
-    convertScaleAbs(inverted, inverted, 2.0);
+    //Inverting the image and then scaling with an alpha > 1.0 to brighten it. Both effects are
+    //folded into one lookup table and applied in a single pass.
+    PointOpChain().invert().scale(2.0).apply(image, inverted);
 
     imshow(windowName, inverted);
 
@@ -356,3 +444,11 @@ void Program1::setSigmaX(double sigmaX) { this->sigmaX = sigmaX; }
 void Program1::setSigmaY(double sigmaY) { this->sigmaY = sigmaY; }
 void Program1::setThreshold1(double thresh1) { this->threshold1 = thresh1; }
 void Program1::setThreshold2(double thresh2) { this->threshold2 = thresh2; }
+
+bool Program1::getRecursiveBlur() const { return this->recursiveBlur; }
+
+void Program1::setRecursiveBlur(bool recursive)
+{
+    this->recursiveBlur = recursive;
+    edgePipeline.setRecursiveBlur(recursive);
+}
@@ -28,6 +28,8 @@
 #include <opencv2/imgproc.hpp>
 #include <iostream>
 
+#include "EdgePipeline.h"
+
 using namespace std;
 using namespace cv;
 
@@ -48,16 +50,43 @@ public:
      **********************************************************************************************/
     static Mat imgProcessingExample(const Mat& image);
 
+    /***********************************************************************************************
+     * Image Processing
+     *
+     * The same transformations as imgProcessingExample, without opening a window. Useful for
+     * batch runs and for comparing against other implementations.
+     *
+     * @param An image to be processed
+     * @return The image with transformations applied
+     **********************************************************************************************/
+    static Mat imgProcessing(const Mat& image);
+
+    /***********************************************************************************************
+     * Image Processing Batch
+     *
+     * imgProcessing for many images of the same size and type at once. The images are stacked
+     * into one planar greyscale buffer, and each stage (flip and greyscale, blur, edge detection)
+     * is a single parallel pass over the whole stack rather than one per image. Within a stage
+     * each thread takes whole images, so this pays off when there are more images than threads;
+     * for a few large images, call imgProcessing on each.
+     *
+     * @param images : The images to process, all the same size and type
+     * @return The processed images, in order. They share one buffer.
+     **********************************************************************************************/
+    static vector<Mat> imgProcessingBatch(const vector<Mat>& images);
+
     /***********************************************************************************************
      * Smoothing Slider Example
      *
      * Part 2 of the assignment. Allows the user to blur the input image to varying degree using
      * a trackbar. Sigma X and Sigma Y are varied between 1 and 11. Changes are temporary and are
-     * not saved.
+     * not saved. Every level is built in the background as soon as the window opens (see
+     * BlurStack.h), so moving the slider only looks up the level.
      *
      * @param An image to be processed
+     * @param recursive : Blur with RecursiveGaussian instead of GaussianBlur
      **********************************************************************************************/
-    static void smoothingSliderExample(Mat image);
+    static void smoothingSliderExample(Mat image, bool recursive = false);
 
     /***********************************************************************************************
      * Edge Detection Slider Example:
@@ -128,6 +157,10 @@ public:
     void setThreshold1(double thresh1);
     void setThreshold2(double thresh2);
 
+    // Use RecursiveGaussian for the edge detection example's blur, see EdgePipeline
+    bool getRecursiveBlur() const;
+    void setRecursiveBlur(bool recursive);
+
 private:
 
     //I use this to allow the trackbar callback to figure out which value it should adjust
@@ -142,11 +175,11 @@ private:
     };
 
     //This is the data passed into the callback function, allowing the program to keep its state.
+    //The image itself is held by the program's edge pipeline.
     struct callbackData
     {
         TRACKBAR_TYPES type; // What the trackbar variable should be interpreted as
         Program1* programPtr; // A pointer to 'this', as the function is static
-        Mat image; // The image to modify
         string windowName; // The name of the window to display to
     };
 
@@ -161,16 +194,19 @@ private:
     double threshold1 = 0.0;
     double threshold2 = 0.0;
 
-    // Simple Callback function used in example II
-    static void on_smoothing_trackbar(int alphaSlider, void* testImage);
+    bool recursiveBlur = false;
+
+    // Example III keeps every stage of the blur and edge chain cached between trackbar changes
+    EdgePipeline edgePipeline;
+
+    // Simple Callback function used in example II, given the example's BlurStack
+    static void on_smoothing_trackbar(int alphaSlider, void* blurStack);
 
     // The generalized callback function used for all six trackbars
     static void trackbar_callback(int sliderValue, void*combinedData);
 
-    // Applies a blur and canny affect to an image
-    static void blur_and_canny(Program1* program,
-                               const Mat& image,
-                               const string& windowName);
+    // Applies a blur and canny affect to the image held by the program's edge pipeline
+    static void blur_and_canny(Program1* program, const string& windowName);
 
     // Prints all instance variables to console
     static void print_settings(Program1* program);
@@ -0,0 +1,267 @@
+/*******************************************************************************
+ * Batch Jobs Implementation
+ *
+ * @author Matthew Munson
+ * @date 5/6/2021
+ *
+ * Settings are parsed with stoi/stod, so a malformed number throws and the
+ * batch runner records the job as failed with the exception's message.
+ *
+ ******************************************************************************/
+
+#include "BatchJobs.h"
+
+#include <fstream>
+#include <opencv2/opencv.hpp>
+#include <sstream>
+#include <thread>
+
+#include "KeyingJob.h"
+#include "ResultCache.h"
+#include "../Assignment1/EdgePipeline.h"
+#include "../Common/AsyncImageLoader.h"
+#include "../Common/Metrics.h"
+#include "../Common/Trace.h"
+
+using namespace std;
+using namespace cv;
+
+// Program defaults, matching Assignment2/main.cpp and the tuned Program1 sliders
+static const keyingSettings DEFAULT_KEYING = {4, 60, 8, 1, 96};
+static const int DEFAULT_EDGE_SIZE = 7;
+static const double DEFAULT_EDGE_SIGMA_X = 7;
+static const double DEFAULT_EDGE_SIGMA_Y = 6;
+static const double DEFAULT_EDGE_THRESHOLD_1 = 20;
+static const double DEFAULT_EDGE_THRESHOLD_2 = 60;
+
+static const char STAGE_HELP[] = "Time spent in each stage of a job, in seconds";
+
+static Metrics::histogram& readSeconds =
+    Metrics::addHistogram("machinevision_stage_seconds", STAGE_HELP,
+                          "pipeline=\"edges\",stage=\"read\"");
+static Metrics::histogram& decodeSeconds =
+    Metrics::addHistogram("machinevision_stage_seconds", STAGE_HELP,
+                          "pipeline=\"edges\",stage=\"decode\"");
+static Metrics::histogram& edgesSeconds =
+    Metrics::addHistogram("machinevision_stage_seconds", STAGE_HELP,
+                          "pipeline=\"edges\",stage=\"edges\"");
+static Metrics::histogram& encodeSeconds =
+    Metrics::addHistogram("machinevision_stage_seconds", STAGE_HELP,
+                          "pipeline=\"edges\",stage=\"encode\"");
+static Metrics::histogram& writeSeconds =
+    Metrics::addHistogram("machinevision_stage_seconds", STAGE_HELP,
+                          "pipeline=\"edges\",stage=\"write\"");
+
+static Metrics::counter& bytesRead =
+    Metrics::addCounter("machinevision_bytes_read_total", "Bytes of input files read",
+                        "pipeline=\"edges\"");
+static Metrics::counter& bytesWritten =
+    Metrics::addCounter("machinevision_bytes_written_total", "Bytes of output files written",
+                        "pipeline=\"edges\"");
+
+EdgePipelinePool::EdgePipelinePool(size_t maxIdle)
+    : maxIdle(maxIdle > 0 ? maxIdle : max(1u, thread::hardware_concurrency()))
+{
+}
+
+EdgePipelinePool::~EdgePipelinePool() = default;
+
+unique_ptr<EdgePipeline> EdgePipelinePool::take()
+{
+    {
+        lock_guard<mutex> guard(lock);
+
+        if(!idle.empty())
+        {
+            unique_ptr<EdgePipeline> pipeline = move(idle.back());
+            idle.pop_back();
+            return pipeline;
+        }
+    }
+
+    return unique_ptr<EdgePipeline>(new EdgePipeline());
+}
+
+void EdgePipelinePool::give(unique_ptr<EdgePipeline> pipeline)
+{
+    lock_guard<mutex> guard(lock);
+
+    if(pipeline && idle.size() < maxIdle)
+        idle.push_back(move(pipeline));
+}
+
+// A pipeline borrowed for one edge job, handed back however the job ends
+struct borrowedPipeline
+{
+    EdgePipelinePool* pool;
+    unique_ptr<EdgePipeline> pipeline;
+
+    explicit borrowedPipeline(EdgePipelinePool* pool)
+        : pool(pool), pipeline(pool ? pool->take() : unique_ptr<EdgePipeline>(new EdgePipeline()))
+    {
+    }
+
+    ~borrowedPipeline()
+    {
+        if(pool)
+            pool->give(move(pipeline));
+    }
+};
+
+BatchRunner::jobResult BatchJobs::run(const string& job,
+                                      ResultCache* cache,
+                                      EdgePipelinePool* pipelines)
+{
+    istringstream stream(job);
+    vector<string> fields;
+    string field;
+
+    while(stream >> field)
+        fields.push_back(field);
+
+    if(fields.empty())
+        return {false, "empty job"};
+
+    string type = fields[0];
+    fields.erase(fields.begin());
+
+    if(type == "key")
+        return runKey(fields, cache);
+
+    if(type == "edges")
+        return runEdges(fields, pipelines);
+
+    return {false, "unknown job type " + type};
+}
+
+// Purpose: Run the keying pipeline on one foreground / background pair
+// Preconditions: fields are foreground, background, output and optionally the three settings,
+//                then optionally the two adaptive settings
+// Postconditions: The overlay is written to the output path
+BatchRunner::jobResult BatchJobs::runKey(const vector<string>& fields, ResultCache* cache)
+{
+    if(fields.size() != 3 && fields.size() != 6 && fields.size() != 8)
+    {
+        return {false, "key expects <foreground> <background> <output>"
+                       " [buckets threshold scale [tiles maxDrift]]"};
+    }
+
+    keyingSettings settings = DEFAULT_KEYING;
+
+    if(fields.size() >= 6)
+    {
+        settings.buckets = stoi(fields[3]);
+        settings.threshold = stoi(fields[4]);
+        settings.decodeScale = stoi(fields[5]);
+    }
+
+    if(fields.size() == 8)
+    {
+        settings.tiles = stoi(fields[6]);
+        settings.maxDrift = stoi(fields[7]);
+    }
+
+    keyingOutcome outcome;
+
+    if(!KeyingJob::run(fields[0], fields[1], fields[2], settings, cache, outcome))
+        return {false, outcome.error};
+
+    //The output, and which steps came from the cache: color / mask / output
+    string detail = fields[2] + " cached " + (outcome.colorCached ? "c" : "-") +
+                    (outcome.maskCached ? "m" : "-") + (outcome.outputCached ? "o" : "-");
+
+    return {true, detail};
+}
+
+// Purpose: Run blur and Canny edge detection on one image
+// Preconditions: fields are input, output and optionally the six settings
+// Postconditions: The edge map is written to the output path
+BatchRunner::jobResult BatchJobs::runEdges(const vector<string>& fields,
+                                           EdgePipelinePool* pipelines)
+{
+    if(fields.size() != 2 && fields.size() != 8)
+        return {false, "edges expects <input> <output> [sizeX sizeY sigmaX sigmaY t1 t2]"};
+
+    //Read and decode separately (rather than with imread) so each is timed and the bytes counted
+    Metrics::timer stages;
+    vector<uchar> input;
+
+    if(!AsyncImageLoader::readFile(fields[0], input))
+        return {false, "cannot read " + fields[0]};
+
+    bytesRead.add(input.size());
+    stages.lap(readSeconds);
+
+    Trace::span decode("decode", fields[0]);
+    Mat image = imdecode(Mat(input), IMREAD_GRAYSCALE);
+    decode.end();
+
+    if(image.empty())
+        return {false, "cannot decode " + fields[0]};
+
+    stages.lap(decodeSeconds);
+
+    //Reused across jobs, so its stage buffers are only allocated again when the image size
+    //changes. setImage() reruns every stage.
+    borrowedPipeline borrowed(pipelines);
+    EdgePipeline& pipeline = *borrowed.pipeline;
+    pipeline.setImage(image);
+
+    if(fields.size() == 8)
+    {
+        pipeline.setBlurX(stoi(fields[2]), stod(fields[4]));
+        pipeline.setBlurY(stoi(fields[3]), stod(fields[5]));
+        pipeline.setThresholds(stod(fields[6]), stod(fields[7]));
+    }
+    else
+    {
+        pipeline.setBlurX(DEFAULT_EDGE_SIZE, DEFAULT_EDGE_SIGMA_X);
+        pipeline.setBlurY(DEFAULT_EDGE_SIZE, DEFAULT_EDGE_SIGMA_Y);
+        pipeline.setThresholds(DEFAULT_EDGE_THRESHOLD_1, DEFAULT_EDGE_THRESHOLD_2);
+    }
+
+    const Mat& edges = pipeline.edges();
+    stages.lap(edgesSeconds);
+
+    string extension = fields[1].substr(min(fields[1].find_last_of('.'), fields[1].size()));
+    vector<uchar> encoded;
+
+    Trace::span encode("encode", fields[1]);
+
+    if(extension.empty() || !imencode(extension, edges, encoded))
+        return {false, "cannot encode " + fields[1]};
+
+    encode.end();
+
+    stages.lap(encodeSeconds);
+
+    if(!ResultCache::writeFile(fields[1], encoded))
+        return {false, "cannot write " + fields[1]};
+
+    bytesWritten.add(encoded.size());
+    stages.lap(writeSeconds);
+
+    return {true, fields[1]};
+}
+
+bool BatchJobs::readJobFile(const string& path, vector<string>& jobs)
+{
+    ifstream file(path);
+
+    if(!file)
+        return false;
+
+    string line;
+
+    while(getline(file, line))
+    {
+        size_t start = line.find_first_not_of(" \t\r");
+
+        if(start == string::npos || line[start] == '#')
+            continue;
+
+        jobs.push_back(line.substr(start));
+    }
+
+    return true;
+}
@@ -0,0 +1,109 @@
+/*******************************************************************************
+ * Batch Jobs Signatures
+ *
+ * @author Matthew Munson
+ * @date 5/6/2021
+ *
+ * The jobs a batch run can be given, one per line of a job file:
+ *
+ *     key <foreground> <background> <output> [buckets threshold decodeScale
+ *         [tiles maxDrift]]
+ *     edges <input> <output> [sizeX sizeY sigmaX sigmaY threshold1 threshold2]
+ *
+ * "key" runs the program II pipeline (KeyingJob). "edges" runs program I's
+ * blur and Canny edge detection (EdgePipeline) on the image in grayscale.
+ * A key job with more than one tile keys each pixel against a tiles x tiles
+ * grid of local colors instead of one color (see overlayBackgroundAdaptive),
+ * which needs enough buckets to follow the lighting, such as 32. Omitted
+ * settings take the programs' defaults. Fields are separated by
+ * whitespace, so paths cannot contain spaces. Blank lines and lines starting
+ * with '#' are ignored by readJobFile().
+ *
+ * Header file documentation is user-focused. For implementation-level comments
+ * see BatchJobs.cpp
+ *
+ ******************************************************************************/
+
+#ifndef MACHINEVISION_BATCHJOBS_H
+#define MACHINEVISION_BATCHJOBS_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ResultCache.h"
+#include "../Common/BatchRunner.h"
+
+class EdgePipeline;
+
+/***************************************************************************************************
+ * Edge Pipeline Pool
+ *
+ * Edge pipelines kept between edge jobs, so that a pipeline's stage buffers are only allocated
+ * again when the image size changes. Each job borrows a pipeline for its duration. The pool
+ * belongs to whatever runs the jobs (a batch worker, the server), so the pipelines outlive the
+ * threads that use them, such as the server's connection threads. The pool grows to the number of
+ * jobs running at once, and keeps at most maxIdle pipelines between jobs.
+ **************************************************************************************************/
+class EdgePipelinePool {
+
+public:
+
+    // maxIdle of zero keeps one pipeline per CPU
+    explicit EdgePipelinePool(size_t maxIdle = 0);
+    ~EdgePipelinePool();
+
+    EdgePipelinePool(const EdgePipelinePool&) = delete;
+    EdgePipelinePool& operator=(const EdgePipelinePool&) = delete;
+
+    // An idle pipeline, or a new one if none is idle. May be called from several threads at once.
+    std::unique_ptr<EdgePipeline> take();
+
+    // Returns a pipeline taken with take(). It is freed instead if maxIdle are already idle.
+    void give(std::unique_ptr<EdgePipeline> pipeline);
+
+private:
+
+    std::mutex lock;
+    std::vector<std::unique_ptr<EdgePipeline>> idle;
+    size_t maxIdle;
+};
+
+class BatchJobs {
+
+public:
+
+    /***********************************************************************************************
+     * Run
+     *
+     * Parses and runs one job line.
+     *
+     * @param cache : The cache for key jobs, or nullptr
+     * @param pipelines : The pipelines for edge jobs, or nullptr to build one for each job
+     * @return Whether the job succeeded. The detail is the error, or the output path followed by
+     *         a short summary. May be called from several threads at once.
+     **********************************************************************************************/
+    static BatchRunner::jobResult run(const std::string& job,
+                                      ResultCache* cache,
+                                      EdgePipelinePool* pipelines);
+
+    /***********************************************************************************************
+     * Read Job File
+     *
+     * @param jobs : Receives the job lines, without blank lines and comments
+     * @return False if the file could not be opened
+     **********************************************************************************************/
+    static bool readJobFile(const std::string& path, std::vector<std::string>& jobs);
+
+private:
+
+    // Each takes the job's fields after the job type
+    static BatchRunner::jobResult runKey(const std::vector<std::string>& fields,
+                                         ResultCache* cache);
+    static BatchRunner::jobResult runEdges(const std::vector<std::string>& fields,
+                                           EdgePipelinePool* pipelines);
+};
+
+
+#endif //MACHINEVISION_BATCHJOBS_H
@@ -0,0 +1,299 @@
+/*******************************************************************************
+ * Color Histogram Implementation
+ *
+ * @author Matthew Munson
+ * @date 5/2/2021
+ *
+ * Counting a pixel is a handful of ALU operations and one increment, so with
+ * the per-pixel division gone the cost is the increment. Runs of pixels with
+ * the same color hit the same counter, and each increment has to wait for the
+ * previous store to that counter. The specialized loop therefore handles four
+ * pixels per iteration and gives each of the four its own copy of the table;
+ * the copies are summed at the end. Four tables of 32^3 counters would no
+ * longer fit in cache, so the largest specialization uses a single table.
+ *
+ * The planar fill separates the two halves of that work. Bin indices for a
+ * run of pixels are computed from the planes in one vectorized loop, and a
+ * second loop counts them into the same lane tables.
+ *
+ ******************************************************************************/
+
+#include "ColorHistogram.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "../Common/PixelFormat.h"
+#include "../Common/PlanarImage.h"
+
+using namespace std;
+using namespace cv;
+
+// Largest table (in counters) that is still split into one copy per unrolled pixel
+static const int MAX_SPLIT_BINS = 16 * 16 * 16;
+
+// Pixels handled per iteration of the specialized loop
+static const int UNROLL = 4;
+
+// Pixels per run of the planar fill, whose bin indices are staged in a buffer that stays in L1
+static const int INDEX_RUN = 256;
+
+/***************************************************************************************************
+ * Fill Specialized
+ *
+ * Purpose: Count an image into a power-of-two histogram
+ * Preconditions: counts holds Buckets^3 zeroed counters
+ * Postconditions: every pixel of image has been counted
+ **************************************************************************************************/
+template<class Format, int Buckets>
+void ColorHistogram::fillSpecialized(const Mat& image, int* counts)
+{
+    const int bins = Buckets * Buckets * Buckets;
+    const int copies = bins <= MAX_SPLIT_BINS ? UNROLL : 1;
+
+    vector<int> tables(bins * copies, 0);
+
+    // With a single table every lane points at it
+    int* lane0 = tables.data();
+    int* lane1 = tables.data() + (copies > 1 ? bins : 0);
+    int* lane2 = tables.data() + (copies > 1 ? 2 * bins : 0);
+    int* lane3 = tables.data() + (copies > 1 ? 3 * bins : 0);
+
+    const int step = Format::channels;
+    const int width = image.cols;
+
+    for(int i = 0; i < image.rows; i++)
+    {
+        const uchar* row = image.ptr<uchar>(i);
+
+        int j = 0;
+
+        for(; j + UNROLL <= width; j += UNROLL)
+        {
+            const uchar* p0 = row + j * step;
+            const uchar* p1 = p0 + step;
+            const uchar* p2 = p1 + step;
+            const uchar* p3 = p2 + step;
+
+            lane0[binIndex<Buckets>(p0[Format::blue], p0[Format::green], p0[Format::red])]++;
+            lane1[binIndex<Buckets>(p1[Format::blue], p1[Format::green], p1[Format::red])]++;
+            lane2[binIndex<Buckets>(p2[Format::blue], p2[Format::green], p2[Format::red])]++;
+            lane3[binIndex<Buckets>(p3[Format::blue], p3[Format::green], p3[Format::red])]++;
+        }
+
+        for(; j < width; j++)
+        {
+            const uchar* p = row + j * step;
+
+            lane0[binIndex<Buckets>(p[Format::blue], p[Format::green], p[Format::red])]++;
+        }
+    }
+
+    for(int c = 0; c < copies; c++)
+    {
+        const int* table = tables.data() + c * bins;
+
+        for(int b = 0; b < bins; b++)
+            counts[b] += table[b];
+    }
+}
+
+/***************************************************************************************************
+ * Fill Generic
+ *
+ * Purpose: Count an image into a histogram with any bucket count
+ * Preconditions: counts holds buckets^3 zeroed counters
+ * Postconditions: every pixel of image has been counted
+ **************************************************************************************************/
+template<class Format>
+void ColorHistogram::fillGeneric(const Mat& image, int* counts, int buckets)
+{
+    int bucketSize = 256 / buckets;
+
+    for(int i = 0; i < image.rows; i++)
+    {
+        const uchar* row = image.ptr<uchar>(i);
+
+        for(int j = 0; j < image.cols; j++)
+        {
+            const uchar* pixel = row + j * Format::channels;
+
+            // Values past the last full bucket (256 not divisible by buckets) join the last bucket
+            int z = min(pixel[Format::blue] / bucketSize, buckets - 1);
+            int y = min(pixel[Format::green] / bucketSize, buckets - 1);
+            int x = min(pixel[Format::red] / bucketSize, buckets - 1);
+
+            counts[(z * buckets + y) * buckets + x]++;
+        }
+    }
+}
+
+/***************************************************************************************************
+ * Planar Bin Indices
+ *
+ * Purpose: Compute the bin indices of a run of pixels from the planes
+ * Preconditions: blue, green and red hold count values. indices has room for count entries.
+ * Postconditions: indices[j] is the flat bin index of pixel j
+ **************************************************************************************************/
+template<int Buckets>
+static void planarBinIndices(const uchar* blue,
+                             const uchar* green,
+                             const uchar* red,
+                             uint16_t* indices,
+                             int count)
+{
+    //At most 32^3 bins, so every index fits in 16 bits and eight fit in a 128-bit register
+    for(int j = 0; j < count; j++)
+        indices[j] = (uint16_t)ColorHistogram::binIndex<Buckets>(blue[j], green[j], red[j]);
+}
+
+/***************************************************************************************************
+ * Fill Planar Specialized
+ *
+ * Purpose: Count a planar image into a power-of-two histogram
+ * Preconditions: counts holds Buckets^3 zeroed counters
+ * Postconditions: every pixel of image has been counted
+ **************************************************************************************************/
+template<int Buckets>
+void ColorHistogram::fillPlanarSpecialized(const PlanarImage& image, int* counts)
+{
+    static_assert(Buckets <= 32, "Bin indices are stored in 16 bits");
+
+    const int bins = Buckets * Buckets * Buckets;
+    const int copies = bins <= MAX_SPLIT_BINS ? UNROLL : 1;
+
+    vector<int> tables(bins * copies, 0);
+
+    int* lane0 = tables.data();
+    int* lane1 = tables.data() + (copies > 1 ? bins : 0);
+    int* lane2 = tables.data() + (copies > 1 ? 2 * bins : 0);
+    int* lane3 = tables.data() + (copies > 1 ? 3 * bins : 0);
+
+    uint16_t indices[INDEX_RUN];
+
+    for(int i = 0; i < image.rows(); i++)
+    {
+        const uchar* blue = image.row(image.bluePlane(), i);
+        const uchar* green = image.row(image.greenPlane(), i);
+        const uchar* red = image.row(image.redPlane(), i);
+
+        for(int start = 0; start < image.cols(); start += INDEX_RUN)
+        {
+            int count = min(INDEX_RUN, image.cols() - start);
+
+            planarBinIndices<Buckets>(blue + start, green + start, red + start, indices, count);
+
+            int j = 0;
+
+            for(; j + UNROLL <= count; j += UNROLL)
+            {
+                lane0[indices[j]]++;
+                lane1[indices[j + 1]]++;
+                lane2[indices[j + 2]]++;
+                lane3[indices[j + 3]]++;
+            }
+
+            for(; j < count; j++)
+                lane0[indices[j]]++;
+        }
+    }
+
+    for(int c = 0; c < copies; c++)
+    {
+        const int* table = tables.data() + c * bins;
+
+        for(int b = 0; b < bins; b++)
+            counts[b] += table[b];
+    }
+}
+
+/***************************************************************************************************
+ * Fill Planar Generic
+ *
+ * Purpose: Count a planar image into a histogram with any bucket count
+ * Preconditions: counts holds buckets^3 zeroed counters
+ * Postconditions: every pixel of image has been counted
+ **************************************************************************************************/
+void ColorHistogram::fillPlanarGeneric(const PlanarImage& image, int* counts, int buckets)
+{
+    int bucketSize = 256 / buckets;
+
+    //The bucket of each channel value, looked up instead of divided per pixel
+    int bucketOf[256];
+
+    for(int v = 0; v < 256; v++)
+        bucketOf[v] = min(v / bucketSize, buckets - 1);
+
+    for(int i = 0; i < image.rows(); i++)
+    {
+        const uchar* blue = image.row(image.bluePlane(), i);
+        const uchar* green = image.row(image.greenPlane(), i);
+        const uchar* red = image.row(image.redPlane(), i);
+
+        for(int j = 0; j < image.cols(); j++)
+        {
+            int z = bucketOf[blue[j]];
+            int y = bucketOf[green[j]];
+            int x = bucketOf[red[j]];
+
+            counts[(z * buckets + y) * buckets + x]++;
+        }
+    }
+}
+
+bool ColorHistogram::isSpecialized(int buckets)
+{
+    switch(buckets)
+    {
+        case 2: case 4: case 8: case 16: case 32:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void ColorHistogram::fill(const Mat& image, Mat& hist, int buckets)
+{
+    CV_Assert(buckets >= 1 && buckets <= 256);
+
+    int dims[] = {buckets, buckets, buckets};
+    hist = Mat(3, dims, CV_32S, Scalar::all(0));
+
+    int* counts = hist.ptr<int>();
+
+    dispatchPixelFormat(image, [&](auto format)
+    {
+        using Format = decltype(format);
+
+        //Chosen once per image; each case is a separate compiled loop
+        switch(buckets)
+        {
+            case 2: fillSpecialized<Format, 2>(image, counts); break;
+            case 4: fillSpecialized<Format, 4>(image, counts); break;
+            case 8: fillSpecialized<Format, 8>(image, counts); break;
+            case 16: fillSpecialized<Format, 16>(image, counts); break;
+            case 32: fillSpecialized<Format, 32>(image, counts); break;
+            default: fillGeneric<Format>(image, counts, buckets); break;
+        }
+    });
+}
+
+void ColorHistogram::fill(const PlanarImage& image, Mat& hist, int buckets)
+{
+    CV_Assert(buckets >= 1 && buckets <= 256);
+
+    int dims[] = {buckets, buckets, buckets};
+    hist = Mat(3, dims, CV_32S, Scalar::all(0));
+
+    int* counts = hist.ptr<int>();
+
+    switch(buckets)
+    {
+        case 2: fillPlanarSpecialized<2>(image, counts); break;
+        case 4: fillPlanarSpecialized<4>(image, counts); break;
+        case 8: fillPlanarSpecialized<8>(image, counts); break;
+        case 16: fillPlanarSpecialized<16>(image, counts); break;
+        case 32: fillPlanarSpecialized<32>(image, counts); break;
+        default: fillPlanarGeneric(image, counts, buckets); break;
+    }
+}
@@ -0,0 +1,102 @@
+/*******************************************************************************
+ * Color Histogram Signatures
+ *
+ * @author Matthew Munson
+ * @date 5/2/2021
+ *
+ * The 3D color histogram behind getMostCommonColor(). Each channel is split
+ * into the same number of equal buckets, and the count for a color lives at
+ * flat index (blue * buckets + green) * buckets + red, which is the layout of
+ * a continuous buckets x buckets x buckets Mat indexed (blue, green, red).
+ *
+ * Power-of-two bucket counts from 2 to 32 have a compiled specialization that
+ * finds the bucket with a shift instead of a division and spreads neighbouring
+ * pixels over separate copies of the table. A photo's dominant color puts long
+ * runs of pixels into the same bin, and without the copies every increment
+ * would wait for the previous one to reach memory. Other bucket counts take a
+ * generic path with the same result.
+ *
+ * A planar image (see PlanarImage.h) is counted in two steps per run of
+ * pixels: the bin indices are computed from the three planes into a small
+ * buffer, a loop of contiguous loads and shifts that the compiler vectorizes,
+ * and the buffer is then counted.
+ *
+ * Header file documentation is user-focused. For implementation-level comments
+ * see ColorHistogram.cpp
+ *
+ ******************************************************************************/
+
+#ifndef MACHINEVISION_COLORHISTOGRAM_H
+#define MACHINEVISION_COLORHISTOGRAM_H
+
+#include <opencv2/opencv.hpp>
+
+using namespace cv;
+
+class PlanarImage;
+
+class ColorHistogram {
+
+public:
+
+    /***********************************************************************************************
+     * Fill
+     *
+     * Counts every pixel of an image. Grey pixels count as a color with equal blue, green and red.
+     * Alpha is ignored. The image may be a region of a larger Mat.
+     *
+     * @param image : An 8-bit image with 1, 3 or 4 channels
+     * @param hist : Receives a buckets x buckets x buckets CV_32S histogram indexed
+     *               (blue, green, red)
+     * @param buckets : Buckets per channel, between 1 and 256
+     **********************************************************************************************/
+    static void fill(const Mat& image, Mat& hist, int buckets);
+
+    // The same count for a planar image, with the same result as filling its interleaved form
+    static void fill(const PlanarImage& image, Mat& hist, int buckets);
+
+    /***********************************************************************************************
+     * Is Specialized
+     *
+     * @return Whether fill() has a compiled specialization for this bucket count
+     **********************************************************************************************/
+    static bool isSpecialized(int buckets);
+
+    /***********************************************************************************************
+     * Bin Index
+     *
+     * Flat histogram index of a color, for a power-of-two bucket count known at compile time.
+     **********************************************************************************************/
+    template<int Buckets>
+    static int binIndex(int blue, int green, int red)
+    {
+        static_assert(Buckets >= 1 && Buckets <= 256 && (Buckets & (Buckets - 1)) == 0,
+                      "Buckets must be a power of two no larger than 256");
+
+        return (((blue >> shift(Buckets)) << (2 * bits(Buckets))) |
+                ((green >> shift(Buckets)) << bits(Buckets)) |
+                (red >> shift(Buckets)));
+    }
+
+private:
+
+    // log2 of a power-of-two bucket count
+    static constexpr int bits(int buckets) { return buckets <= 1 ? 0 : 1 + bits(buckets / 2); }
+
+    // Right shift taking a channel value to its bucket
+    static constexpr int shift(int buckets) { return 8 - bits(buckets); }
+
+    template<class Format, int Buckets>
+    static void fillSpecialized(const Mat& image, int* counts);
+
+    template<class Format>
+    static void fillGeneric(const Mat& image, int* counts, int buckets);
+
+    template<int Buckets>
+    static void fillPlanarSpecialized(const PlanarImage& image, int* counts);
+
+    static void fillPlanarGeneric(const PlanarImage& image, int* counts, int buckets);
+};
+
+
+#endif //MACHINEVISION_COLORHISTOGRAM_H
@@ -0,0 +1,228 @@
+/*******************************************************************************
+ * Integral Histogram Implementation
+ *
+ * @author Matthew Munson
+ * @date 5/3/2021
+ *
+ * The table has one entry per cell corner, (cellRows + 1) x (cellCols + 1),
+ * and each entry holds bins counts side by side. Row 0 and column 0 are zero.
+ * Building it is done in two parallel passes: every cell row counts its cells
+ * and takes a running sum along the row, then every range of table columns
+ * takes a running sum down the rows.
+ *
+ * A query splits its rectangle into the largest block of whole cells inside
+ * it plus up to four strips around that block. The block comes from the table
+ * and the strips are counted directly.
+ *
+ ******************************************************************************/
+
+#include "IntegralHistogram.h"
+
+#include <algorithm>
+
+#include "Keying.h"
+#include "../Common/PixelFormat.h"
+#include "../Common/TaskScheduler.h"
+
+using namespace std;
+using namespace cv;
+
+/***************************************************************************************************
+ * Count Pixels
+ *
+ * Purpose: Add the pixels of a rectangle to a histogram, reading channels through Format
+ * Preconditions: region lies inside image. counts holds buckets^3 counters.
+ * Postconditions: every pixel of region has been counted
+ **************************************************************************************************/
+template<class Format>
+static void countPixels(const Mat& image,
+                        const Rect& region,
+                        const uchar* bucketOf,
+                        int buckets,
+                        int* counts)
+{
+    for(int i = region.y; i < region.y + region.height; i++)
+    {
+        const uchar* pixel = image.ptr<uchar>(i) + region.x * Format::channels;
+
+        for(int j = 0; j < region.width; j++, pixel += Format::channels)
+        {
+            int z = bucketOf[pixel[Format::blue]];
+            int y = bucketOf[pixel[Format::green]];
+            int x = bucketOf[pixel[Format::red]];
+
+            counts[(z * buckets + y) * buckets + x]++;
+        }
+    }
+}
+
+IntegralHistogram::IntegralHistogram()
+    : bucketCount(0), cellSide(0), bins(0), cellCols(0), cellRows(0), bucketOf()
+{
+}
+
+IntegralHistogram::IntegralHistogram(const Mat& image, int buckets, int cellSize)
+    : IntegralHistogram()
+{
+    build(image, buckets, cellSize);
+}
+
+void IntegralHistogram::build(const Mat& image, int buckets, int cellSize)
+{
+    CV_Assert(!image.empty() && image.depth() == CV_8U);
+    CV_Assert(buckets >= 1 && buckets <= 256 && cellSize >= 1);
+
+    this->image = image;
+    bucketCount = buckets;
+    cellSide = cellSize;
+    bins = buckets * buckets * buckets;
+
+    cellCols = (image.cols + cellSize - 1) / cellSize;
+    cellRows = (image.rows + cellSize - 1) / cellSize;
+
+    //Same bucketing as ColorHistogram, including bucket counts that do not divide 256
+    int bucketSize = 256 / buckets;
+    for(int v = 0; v < 256; v++)
+        bucketOf[v] = (uchar)min(v / bucketSize, buckets - 1);
+
+    int stride = (cellCols + 1) * bins;
+    table.assign((size_t)(cellRows + 1) * stride, 0);
+
+    dispatchPixelFormat(image, [&](auto format)
+    {
+        using Format = decltype(format);
+
+        //Pass 1: count each cell into its bottom-right corner, then sum along the corner row
+        parallelFor(Range(0, cellRows), [&](const Range& range)
+        {
+            for(int cellY = range.start; cellY < range.end; cellY++)
+            {
+                int* row = table.data() + (size_t)(cellY + 1) * stride;
+
+                for(int cellX = 0; cellX < cellCols; cellX++)
+                {
+                    Rect cell(cellX * cellSide,
+                              cellY * cellSide,
+                              min(cellSide, image.cols - cellX * cellSide),
+                              min(cellSide, image.rows - cellY * cellSide));
+
+                    countPixels<Format>(image,
+                                        cell,
+                                        bucketOf,
+                                        bucketCount,
+                                        row + (cellX + 1) * bins);
+                }
+
+                for(int k = 2 * bins; k < stride; k++)
+                    row[k] += row[k - bins];
+            }
+        });
+    });
+
+    //Pass 2: sum down the corner rows. Each row depends on the one above, so the threads split the
+    //row width instead.
+    parallelFor(Range(0, stride), [&](const Range& range)
+    {
+        for(int cellY = 2; cellY <= cellRows; cellY++)
+        {
+            int* row = table.data() + (size_t)cellY * stride;
+            const int* above = row - stride;
+
+            for(int k = range.start; k < range.end; k++)
+                row[k] += above[k];
+        }
+    }, parallelThreads());
+}
+
+const int* IntegralHistogram::corner(int cellY, int cellX) const
+{
+    return table.data() + ((size_t)cellY * (cellCols + 1) + cellX) * bins;
+}
+
+void IntegralHistogram::addCells(int cellX0, int cellY0, int cellX1, int cellY1, int* counts) const
+{
+    const int* bottomRight = corner(cellY1, cellX1);
+    const int* topRight = corner(cellY0, cellX1);
+    const int* bottomLeft = corner(cellY1, cellX0);
+    const int* topLeft = corner(cellY0, cellX0);
+
+    for(int b = 0; b < bins; b++)
+        counts[b] += bottomRight[b] - topRight[b] - bottomLeft[b] + topLeft[b];
+}
+
+void IntegralHistogram::addPixels(const Rect& region, int* counts) const
+{
+    if(region.width <= 0 || region.height <= 0)
+        return;
+
+    dispatchPixelFormat(image, [&](auto format)
+    {
+        countPixels<decltype(format)>(image, region, bucketOf, bucketCount, counts);
+    });
+}
+
+void IntegralHistogram::count(const Rect& region, int* counts) const
+{
+    CV_Assert(!empty());
+
+    fill(counts, counts + bins, 0);
+
+    Rect clipped = region & Rect(0, 0, image.cols, image.rows);
+
+    if(clipped.empty())
+        return;
+
+    int x0 = clipped.x;
+    int y0 = clipped.y;
+    int x1 = clipped.x + clipped.width;
+    int y1 = clipped.y + clipped.height;
+
+    //Whole cells inside the region. A partial cell on the image edge counts as whole when the
+    //region reaches that edge.
+    int cellX0 = (x0 + cellSide - 1) / cellSide;
+    int cellY0 = (y0 + cellSide - 1) / cellSide;
+    int cellX1 = x1 == image.cols ? cellCols : x1 / cellSide;
+    int cellY1 = y1 == image.rows ? cellRows : y1 / cellSide;
+
+    if(cellX0 >= cellX1 || cellY0 >= cellY1)
+    {
+        //Thinner than a cell in one direction, so it has no more pixels than its edge strips would
+        addPixels(clipped, counts);
+        return;
+    }
+
+    int innerX0 = cellX0 * cellSide;
+    int innerY0 = cellY0 * cellSide;
+    int innerX1 = min(cellX1 * cellSide, image.cols);
+    int innerY1 = min(cellY1 * cellSide, image.rows);
+
+    addCells(cellX0, cellY0, cellX1, cellY1, counts);
+
+    //Top and bottom strips span the full width, left and right strips only the inner rows
+    addPixels(Rect(x0, y0, x1 - x0, innerY0 - y0), counts);
+    addPixels(Rect(x0, innerY1, x1 - x0, y1 - innerY1), counts);
+    addPixels(Rect(x0, innerY0, innerX0 - x0, innerY1 - innerY0), counts);
+    addPixels(Rect(innerX1, innerY0, x1 - innerX1, innerY1 - innerY0), counts);
+}
+
+void IntegralHistogram::histogram(const Rect& region, Mat& hist) const
+{
+    int dims[] = {bucketCount, bucketCount, bucketCount};
+    hist = Mat(3, dims, CV_32S, Scalar::all(0));
+
+    count(region, hist.ptr<int>());
+}
+
+Vec3i IntegralHistogram::mostCommonColor(const Rect& region) const
+{
+    vector<int> counts(bins);
+    count(region, counts.data());
+
+    //findMaxBucket keeps getMostCommonColor's choice between equal buckets
+    int dims[] = {bucketCount, bucketCount, bucketCount};
+    return findMaxBucket(Mat(3, dims, CV_32S, counts.data()), bucketCount);
+}
+
+int IntegralHistogram::buckets() const { return bucketCount; }
+int IntegralHistogram::cellSize() const { return cellSide; }
+bool IntegralHistogram::empty() const { return table.empty(); }
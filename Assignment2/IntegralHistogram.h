@@ -0,0 +1,135 @@
+/*******************************************************************************
+ * Integral Histogram Signatures
+ *
+ * @author Matthew Munson
+ * @date 5/3/2021
+ *
+ * Answers "what is the color histogram (or most common color) of this
+ * rectangle?" for many rectangles of the same image without recounting their
+ * pixels. The image is divided into square cells and, for every cell corner,
+ * the histogram of everything above and to the left of it is stored. The part
+ * of a query made of whole cells is then four table lookups per bin, whatever
+ * its size; only the strips along its edges that cut through cells are
+ * counted pixel by pixel. A query therefore costs O(bins + perimeter * cell
+ * size) rather than O(area), and results are exact.
+ *
+ * Memory is one int per bin per cell corner: (cellRows + 1) * (cellCols + 1) *
+ * buckets^3 ints, where cellRows and cellCols are the image size divided by
+ * the cell size, rounded up. For a 1920x1080 image and 8 pixel cells that is
+ * 241 * 136 corners: about 8 MB at 4 buckets, but about 0.5 GB at 16 buckets,
+ * since the table grows with the cube of the bucket count. A cell size of 1
+ * makes every query O(bins) at 64 times the memory.
+ *
+ * Header file documentation is user-focused. For implementation-level comments
+ * see IntegralHistogram.cpp
+ *
+ ******************************************************************************/
+
+#ifndef MACHINEVISION_INTEGRALHISTOGRAM_H
+#define MACHINEVISION_INTEGRALHISTOGRAM_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+using namespace cv;
+
+class IntegralHistogram {
+
+public:
+
+    /***********************************************************************************************
+     * Default Constructor
+     *
+     * Purpose: Creates an empty index, to be filled by build()
+     * Postconditions: empty() is true
+     **********************************************************************************************/
+    IntegralHistogram();
+
+    /***********************************************************************************************
+     * Constructor
+     *
+     * Purpose: Builds the index for an image, as build() does
+     * Preconditions: As for build()
+     * Postconditions: As for build()
+     **********************************************************************************************/
+    IntegralHistogram(const Mat& image, int buckets, int cellSize = 8);
+
+    /***********************************************************************************************
+     * Build
+     *
+     * Purpose: Indexes an image, in parallel. The image is shared rather than copied, and must
+     *          not be modified while the index is in use.
+     * Preconditions: image is non-empty and 8-bit, 1 <= buckets <= 256 and cellSize >= 1.
+     *                Violations throw cv::Exception.
+     * Postconditions: Any previous index is replaced. The table holds (cellRows + 1) *
+     *                 (cellCols + 1) * buckets^3 ints; see the memory note above.
+     *
+     * @param image : An 8-bit image with 1, 3 or 4 channels
+     * @param buckets : Buckets per channel, as for getMostCommonColor()
+     * @param cellSize : Side of the cells the index is stored at, in pixels
+     **********************************************************************************************/
+    void build(const Mat& image, int buckets, int cellSize = 8);
+
+    /***********************************************************************************************
+     * Histogram
+     *
+     * Purpose: Counts the colors of a rectangle of the indexed image
+     * Preconditions: build() has been called
+     * Postconditions: hist is a newly allocated histogram. A region entirely outside the image
+     *                 gives all zeros.
+     *
+     * @param region : The rectangle to count. Parts outside the image are ignored.
+     * @param hist : Receives a buckets x buckets x buckets CV_32S histogram indexed
+     *               (blue, green, red), identical to ColorHistogram::fill() on image(region)
+     **********************************************************************************************/
+    void histogram(const Rect& region, Mat& hist) const;
+
+    /***********************************************************************************************
+     * Most Common Color
+     *
+     * Purpose: Finds the most common color of a rectangle of the indexed image
+     * Preconditions: build() has been called
+     * Postconditions: Equal bins are chosen between as getMostCommonColor() does. The index is
+     *                 unchanged.
+     *
+     * @param region : The rectangle to search. Parts outside the image are ignored.
+     * @return The same color as getMostCommonColor(image(region), buckets)
+     **********************************************************************************************/
+    Vec3i mostCommonColor(const Rect& region) const;
+
+    int buckets() const;
+    int cellSize() const;
+    bool empty() const;
+
+private:
+
+    Mat image;
+
+    int bucketCount;
+    int cellSide;
+    int bins;
+
+    // Cells across and down. Cells on the right and bottom edges may be partial.
+    int cellCols;
+    int cellRows;
+
+    // Bucket of each channel value
+    uchar bucketOf[256];
+
+    // (cellRows + 1) x (cellCols + 1) corners, each holding bins counts
+    std::vector<int> table;
+
+    const int* corner(int cellY, int cellX) const;
+
+    // Adds the bins of the whole cells [cellX0, cellX1) x [cellY0, cellY1) to counts
+    void addCells(int cellX0, int cellY0, int cellX1, int cellY1, int* counts) const;
+
+    // Adds the pixels of region to counts one by one
+    void addPixels(const Rect& region, int* counts) const;
+
+    // Fills counts with the histogram of region
+    void count(const Rect& region, int* counts) const;
+};
+
+
+#endif //MACHINEVISION_INTEGRALHISTOGRAM_H
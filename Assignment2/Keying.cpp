@@ -0,0 +1,900 @@
+/***************************************************************************************************
+ * Keying Implementation
+ *
+ * @author Matthew Munson
+ * @date 4/17/21
+ *
+ * Implementation file for the keying functions of program II.
+ *
+ * Vec3i getMostCommonColor(const Mat&image, int buckets)
+ * - Returns the most common color in an image.
+ *
+ * Mat overlayBackground(const Mat& foreground, const Mat& background, const Vec3i& mostCommonColor,
+ *                    int threshold)
+ * - Overlays a background image onto the foreground image where the pixels are within a certain
+ * threshold of the provided most common color
+ *
+ * Mat getKeyMask(const Mat& foreground, const Vec3i& mostCommonColor, int threshold)
+ * Mat overlayWithMask(const Mat& foreground, const Mat& background, const Mat& mask)
+ * - overlayBackground in two steps, so the mask can be cached
+ *
+ * Mat overlayBackgroundYCbCr(const Mat& foreground, const Mat& background,
+ *                            const Vec3i& mostCommonColor, int lumaThreshold, int chromaThreshold)
+ * - overlayBackground, comparing luma and chroma separately
+ *
+ * Mat getTileColors(const Mat& image, int buckets, const Size& grid, const Vec3i& globalColor,
+ *                   int maxDrift)
+ * - Returns the most common color of each tile in a grid over the image
+ *
+ * Mat overlayBackgroundAdaptive(const Mat& foreground, const Mat& background,
+ *                               const Mat& tileColors, int threshold)
+ * - overlayBackground, with the key interpolated between tile colors at each pixel
+ *
+ * Vec3i getMostCommonColor(const PlanarImage& image, int buckets)
+ * PlanarImage overlayBackground(const PlanarImage& foreground, const PlanarImage& background,
+ *                               const Vec3i& mostCommonColor, int threshold)
+ * - getMostCommonColor and overlayBackground on planar images
+ *
+ * Mat decodeForHistogram(const vector<uchar>& encoded, const Mat& decoded, int scale)
+ * - Returns a reduced size decode of a JPEG, for getMostCommonColor
+ *
+ * Vec3i findMaxBucket(const Mat& hist, int buckets)
+ * - Finds the maximum bucket in a 3D histogram and returns it as a Vec3i representing a color
+ *
+ **************************************************************************************************/
+
+#include "Keying.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "ColorHistogram.h"
+#include "../Common/PixelFormat.h"
+#include "../Common/TaskScheduler.h"
+#include "../Common/Trace.h"
+
+using namespace std;
+using namespace cv;
+
+/***************************************************************************************************
+ * Overlay Pixels - Implementation
+ *
+ * Pixel loop of overlayBackground, templated on the foreground's PixelFormat so that channels are
+ * read at fixed offsets with no per-pixel checks on the layout.
+ *
+ * @pre: background has the same layout as overlay.
+ * @post: pixels of overlay close to mostCommonColor are replaced by tiled background pixels.
+ **************************************************************************************************/
+template<class Format>
+static void overlayPixels(Mat& overlay,
+                          const Mat& background,
+                          const Vec3i& mostCommonColor,
+                          int threshold)
+{
+    for(int i = 0; i < overlay.rows; i++)
+    {
+        uchar* row = overlay.ptr<uchar>(i);
+        const uchar* backgroundRow = background.ptr<uchar>(i % background.rows);
+
+        for(int j = 0; j < overlay.cols; j++)
+        {
+            uchar* pixel = row + j * Format::channels;
+
+            if(abs(pixel[Format::blue] - mostCommonColor[0]) < threshold &&
+               abs(pixel[Format::green] - mostCommonColor[1]) < threshold &&
+               abs(pixel[Format::red] - mostCommonColor[2]) < threshold)
+            {
+                const uchar* replacement = backgroundRow + (j % background.cols) * Format::channels;
+
+                for(int c = 0; c < Format::channels; c++)
+                    pixel[c] = replacement[c];
+            }
+        }
+    }
+}
+
+/***************************************************************************************************
+ * Overlay Background - Implementation
+ *
+ * @param foreground : The image which the background will be overlaid onto
+ * @param background : The image to overlay onto the foreground
+ * @param mostCommonColor : The most common color identified in the foreground image
+ * @param threshold : How close to the common color must a pixel be in order to be replaced
+ *
+ * Purpose:
+ *
+ * Overlays the background image onto the foreground where foreground pixels are close to the
+ * most common color. Loops through each pixel in the foreground image and determines if its
+ * red AND green AND blue pixels are all within the provided threshold of the most common color.
+ * If this is true, the pixel will be replaced with the corresponding pixel of the background image.
+ * If the background image is smaller than the foreground, it will be "tiled" onto the background
+ * and form a repeating pattern.
+ *
+ * Greyscale, BGR and BGRA foregrounds are supported. The pixel loop is a template on the layout
+ * (overlayPixels), instantiated once per format and chosen once per image. The background is
+ * converted to the foreground's layout before the loop.
+ *
+ * @pre: foreground, background, and mostCommonColor are all initialized. Threshold is greater
+ *       than zero.
+ * @post: background is overlaid onto common color foreground pixels, overlaid image is returned.
+ *
+ * @return A copy of foreground with background pixels overlaid.
+ **************************************************************************************************/
+Mat overlayBackground(const Mat& foreground,
+                      const Mat& background,
+                      const Vec3i& mostCommonColor,
+                      int threshold)
+{
+    Trace::span trace("overlayBackground");
+
+    Mat overlay = Mat();
+    foreground.copyTo(overlay);
+
+    //The background is converted to the foreground's layout once, so pixels copy across directly
+    Mat tile = Mat();
+    convertChannels(background, tile, overlay.channels());
+
+    dispatchPixelFormat(overlay, [&](auto format)
+    {
+        overlayPixels<decltype(format)>(overlay, tile, mostCommonColor, threshold);
+    });
+
+    return overlay;
+}
+
+/***************************************************************************************************
+ * Get Most Common Color - Implementation
+ *
+ * @param image : The image from which the most common color will be determined
+ * @param buckets : The amount of buckets in the color histogram used to determine most common color
+ *
+ * Purpose:
+ *
+ * Finds the most common color in the provided image using a color histogram. Goes through each
+ * pixel and determines which bucket it falls into. Uses findMaxBucket() to determine which bucket
+ * has the highest count, and returns this as a Vec3i.
+ *
+ * Greyscale, BGR and BGRA images are supported. A grey pixel counts as a color with equal blue,
+ * green and red. Alpha is ignored. The counting itself is done by ColorHistogram, which has
+ * compiled loops for the power-of-two bucket counts.
+ *
+ * @pre: image is initialized and buckets is greater than zero.
+ * @post: The most common color in the image is determined and returned as a Vector 3.
+ *
+ * @return a Vec3b representing the most common color in the provided image
+ **************************************************************************************************/
+Vec3i getMostCommonColor(const Mat& image, int buckets)
+{
+    Trace::span trace("getMostCommonColor");
+
+    Mat hist;
+    ColorHistogram::fill(image, hist, buckets);
+
+    return findMaxBucket(hist, buckets);
+}
+
+/***************************************************************************************************
+ * Mask Pixels - Implementation
+ *
+ * Pixel loop of getKeyMask, templated on the foreground's PixelFormat. Uses the same comparison
+ * as overlayPixels.
+ *
+ * @pre: mask is a CV_8UC1 image the size of foreground.
+ * @post: mask is 255 where foreground is close to mostCommonColor and 0 elsewhere.
+ **************************************************************************************************/
+template<class Format>
+static void maskPixels(const Mat& foreground,
+                       Mat& mask,
+                       const Vec3i& mostCommonColor,
+                       int threshold)
+{
+    for(int i = 0; i < foreground.rows; i++)
+    {
+        const uchar* row = foreground.ptr<uchar>(i);
+        uchar* maskRow = mask.ptr<uchar>(i);
+
+        for(int j = 0; j < foreground.cols; j++)
+        {
+            const uchar* pixel = row + j * Format::channels;
+
+            bool keyed = abs(pixel[Format::blue] - mostCommonColor[0]) < threshold &&
+                         abs(pixel[Format::green] - mostCommonColor[1]) < threshold &&
+                         abs(pixel[Format::red] - mostCommonColor[2]) < threshold;
+
+            maskRow[j] = keyed ? 255 : 0;
+        }
+    }
+}
+
+/***************************************************************************************************
+ * Get Key Mask - Implementation
+ *
+ * @param foreground : The image to key
+ * @param mostCommonColor : The most common color identified in the foreground image
+ * @param threshold : How close to the common color must a pixel be in order to be replaced
+ *
+ * Purpose:
+ *
+ * Marks the pixels overlayBackground would replace.
+ *
+ * @pre: foreground and mostCommonColor are initialized. Threshold is greater than zero.
+ * @post: None.
+ *
+ * @return A CV_8UC1 mask, 255 on pixels to replace and 0 elsewhere
+ **************************************************************************************************/
+Mat getKeyMask(const Mat& foreground, const Vec3i& mostCommonColor, int threshold)
+{
+    Trace::span trace("getKeyMask");
+
+    Mat mask(foreground.rows, foreground.cols, CV_8UC1);
+
+    dispatchPixelFormat(foreground, [&](auto format)
+    {
+        maskPixels<decltype(format)>(foreground, mask, mostCommonColor, threshold);
+    });
+
+    return mask;
+}
+
+/***************************************************************************************************
+ * Overlay With Mask - Implementation
+ *
+ * @param foreground : The image which the background will be overlaid onto
+ * @param background : The image to overlay onto the foreground
+ * @param mask : The output of getKeyMask for the foreground
+ *
+ * Purpose:
+ *
+ * Replaces the masked foreground pixels with the tiled background, as overlayBackground does.
+ *
+ * @pre: mask is a CV_8UC1 image the size of foreground.
+ * @post: background is overlaid onto masked foreground pixels, overlaid image is returned.
+ *
+ * @return A copy of foreground with background pixels overlaid.
+ **************************************************************************************************/
+Mat overlayWithMask(const Mat& foreground, const Mat& background, const Mat& mask)
+{
+    Trace::span trace("overlayWithMask");
+
+    CV_Assert(mask.type() == CV_8UC1 && mask.size() == foreground.size());
+
+    Mat overlay = Mat();
+    foreground.copyTo(overlay);
+
+    Mat tile = Mat();
+    convertChannels(background, tile, overlay.channels());
+
+    size_t pixelSize = overlay.elemSize();
+
+    for(int i = 0; i < overlay.rows; i++)
+    {
+        uchar* row = overlay.ptr<uchar>(i);
+        const uchar* maskRow = mask.ptr<uchar>(i);
+        const uchar* backgroundRow = tile.ptr<uchar>(i % tile.rows);
+
+        for(int j = 0; j < overlay.cols; j++)
+        {
+            if(maskRow[j])
+                memcpy(row + j * pixelSize, backgroundRow + (j % tile.cols) * pixelSize, pixelSize);
+        }
+    }
+
+    return overlay;
+}
+
+//Fixed point BGR to YCrCb coefficients, the same as cvtColor(COLOR_BGR2YCrCb) uses for 8-bit images
+static const int YCC_SHIFT = 14;
+static const int YCC_HALF = 1 << (YCC_SHIFT - 1);
+static const int YCC_DELTA = 128 << YCC_SHIFT;
+static const int Y_BLUE = 1868;
+static const int Y_GREEN = 9617;
+static const int Y_RED = 4899;
+static const int CR_SCALE = 11682;
+static const int CB_SCALE = 9241;
+
+/***************************************************************************************************
+ * To YCbCr - Implementation
+ *
+ * Converts one BGR color to luma and chroma with the fixed point coefficients above. Chroma is
+ * offset by 128 and saturated to 8 bits, as cvtColor does.
+ **************************************************************************************************/
+static inline void toYCbCr(int blue, int green, int red, int& luma, int& cb, int& cr)
+{
+    luma = (blue * Y_BLUE + green * Y_GREEN + red * Y_RED + YCC_HALF) >> YCC_SHIFT;
+    cr = min(max(((red - luma) * CR_SCALE + YCC_DELTA + YCC_HALF) >> YCC_SHIFT, 0), 255);
+    cb = min(max(((blue - luma) * CB_SCALE + YCC_DELTA + YCC_HALF) >> YCC_SHIFT, 0), 255);
+}
+
+/***************************************************************************************************
+ * Key Run YCbCr - Implementation
+ *
+ * Keys width pixels of one row against background pixels read from the same offset. Written as a
+ * standalone function of plain pointers and without branches (the replacement is a blend through
+ * a byte mask) so the compiler can vectorize it.
+ *
+ * @pre: row and backgroundRow hold width pixels of Format.
+ * @post: pixels of row within both thresholds of the key are replaced.
+ **************************************************************************************************/
+template<class Format>
+static void keyRunYCbCr(uchar* row,
+                        const uchar* backgroundRow,
+                        int width,
+                        int keyLuma,
+                        int keyCb,
+                        int keyCr,
+                        int lumaThreshold,
+                        int chromaThreshold)
+{
+    for(int j = 0; j < width; j++)
+    {
+        uchar* pixel = row + j * Format::channels;
+        const uchar* replacement = backgroundRow + j * Format::channels;
+
+        int luma, cb, cr;
+        toYCbCr(pixel[Format::blue], pixel[Format::green], pixel[Format::red], luma, cb, cr);
+
+        //All ones where the pixel is keyed, all zeros where it is kept
+        uchar mask = (uchar)-((abs(luma - keyLuma) < lumaThreshold) &
+                              (abs(cb - keyCb) < chromaThreshold) &
+                              (abs(cr - keyCr) < chromaThreshold));
+
+        for(int c = 0; c < Format::channels; c++)
+            pixel[c] = (uchar)((replacement[c] & mask) | (pixel[c] & ~mask));
+    }
+}
+
+/***************************************************************************************************
+ * Overlay Background YCbCr - Implementation
+ *
+ * @param foreground : The image which the background will be overlaid onto
+ * @param background : The image to overlay onto the foreground
+ * @param mostCommonColor : The most common color identified in the foreground image
+ * @param lumaThreshold : How close in brightness must a pixel be in order to be replaced
+ * @param chromaThreshold : How close in Cb AND Cr must a pixel be in order to be replaced
+ *
+ * Purpose:
+ *
+ * Works as overlayBackground, but each foreground pixel and the key are converted to YCbCr with
+ * 14-bit fixed point arithmetic (the coefficients of cvtColor's COLOR_BGR2YCrCb) and compared
+ * there. Converting inside the loop avoids writing and re-reading a converted copy of the image.
+ * Each row is processed in runs that line up with one repeat of the tiled background, so the
+ * inner loop reads the background linearly. Rows are split across threads.
+ *
+ * @pre: foreground, background, and mostCommonColor are all initialized. Thresholds are greater
+ *       than zero.
+ * @post: background is overlaid onto foreground pixels close to the key in luma and chroma,
+ *        overlaid image is returned.
+ *
+ * @return A copy of foreground with background pixels overlaid.
+ **************************************************************************************************/
+Mat overlayBackgroundYCbCr(const Mat& foreground,
+                           const Mat& background,
+                           const Vec3i& mostCommonColor,
+                           int lumaThreshold,
+                           int chromaThreshold)
+{
+    Trace::span trace("overlayBackgroundYCbCr");
+
+    Mat overlay = Mat();
+    foreground.copyTo(overlay);
+
+    Mat tile = Mat();
+    convertChannels(background, tile, overlay.channels());
+
+    int keyLuma, keyCb, keyCr;
+    toYCbCr(saturate_cast<uchar>(mostCommonColor[0]),
+            saturate_cast<uchar>(mostCommonColor[1]),
+            saturate_cast<uchar>(mostCommonColor[2]),
+            keyLuma, keyCb, keyCr);
+
+    dispatchPixelFormat(overlay, [&](auto format)
+    {
+        using Format = decltype(format);
+
+        parallelFor(Range(0, overlay.rows), [&](const Range& range)
+        {
+            for(int i = range.start; i < range.end; i++)
+            {
+                uchar* row = overlay.ptr<uchar>(i);
+                const uchar* backgroundRow = tile.ptr<uchar>(i % tile.rows);
+
+                for(int start = 0; start < overlay.cols; start += tile.cols)
+                {
+                    keyRunYCbCr<Format>(row + start * Format::channels,
+                                        backgroundRow,
+                                        min(tile.cols, overlay.cols - start),
+                                        keyLuma, keyCb, keyCr,
+                                        lumaThreshold, chromaThreshold);
+                }
+            }
+        });
+    });
+
+    return overlay;
+}
+
+/***************************************************************************************************
+ * Get Tile Colors - Implementation
+ *
+ * @param image : The image to divide into tiles
+ * @param buckets : The amount of buckets in each tile's color histogram
+ * @param grid : Tiles across (width) and down (height)
+ * @param globalColor : The most common color of the whole image
+ * @param maxDrift : How far, in any channel, a tile color may be from globalColor
+ *
+ * Purpose:
+ *
+ * Finds the local backdrop color of each tile. Tile boundaries are spread evenly over the image,
+ * and tiles are processed in parallel with getMostCommonColor(). Under uneven lighting the
+ * backdrop color drifts smoothly across the image, while a tile mostly covered by the subject
+ * jumps to an unrelated color, so tile colors more than maxDrift from the global color are
+ * replaced by it.
+ *
+ * @pre: image is initialized. grid is at least 1 x 1 and no larger than the image.
+ * @post: None.
+ *
+ * @return A grid.height x grid.width CV_32SC3 Mat of colors in the same order as
+ *         getMostCommonColor()
+ **************************************************************************************************/
+Mat getTileColors(const Mat& image,
+                  int buckets,
+                  const Size& grid,
+                  const Vec3i& globalColor,
+                  int maxDrift)
+{
+    CV_Assert(grid.width >= 1 && grid.height >= 1);
+    CV_Assert(grid.width <= image.cols && grid.height <= image.rows);
+
+    Mat tileColors(grid.height, grid.width, CV_32SC3);
+
+    parallelFor(Range(0, grid.area()), [&](const Range& range)
+    {
+        for(int t = range.start; t < range.end; t++)
+        {
+            int tileY = t / grid.width;
+            int tileX = t % grid.width;
+
+            int top = tileY * image.rows / grid.height;
+            int bottom = (tileY + 1) * image.rows / grid.height;
+            int left = tileX * image.cols / grid.width;
+            int right = (tileX + 1) * image.cols / grid.width;
+
+            Vec3i color = getMostCommonColor(image(Rect(left, top, right - left, bottom - top)),
+                                             buckets);
+
+            if(abs(color[0] - globalColor[0]) > maxDrift ||
+               abs(color[1] - globalColor[1]) > maxDrift ||
+               abs(color[2] - globalColor[2]) > maxDrift)
+            {
+                color = globalColor;
+            }
+
+            tileColors.at<Vec3i>(tileY, tileX) = color;
+        }
+    });
+
+    return tileColors;
+}
+
+//Fixed point precision of the interpolation weights
+static const int WEIGHT_BITS = 8;
+static const int WEIGHT_ONE = 1 << WEIGHT_BITS;
+
+/***************************************************************************************************
+ * Interpolation Taps - Implementation
+ *
+ * For each position along an axis split into tiles evenly, finds the tile centres on either side
+ * and the fixed point weight of the second one. Positions before the first centre or after the
+ * last clamp to it.
+ *
+ * @pre: length and tiles are greater than zero.
+ * @post: first, second and weight hold one entry per position.
+ **************************************************************************************************/
+static void interpolationTaps(int length,
+                              int tiles,
+                              vector<int>& first,
+                              vector<int>& second,
+                              vector<int>& weight)
+{
+    first.resize(length);
+    second.resize(length);
+    weight.resize(length);
+
+    double tileLength = (double)length / tiles;
+
+    for(int p = 0; p < length; p++)
+    {
+        double position = (p + 0.5) / tileLength - 0.5;
+        position = min(max(position, 0.0), (double)(tiles - 1));
+
+        first[p] = min((int)position, tiles - 1);
+        second[p] = min(first[p] + 1, tiles - 1);
+        weight[p] = cvRound((position - first[p]) * WEIGHT_ONE);
+    }
+}
+
+/***************************************************************************************************
+ * Overlay Pixels Adaptive - Implementation
+ *
+ * Pixel loop of overlayBackgroundAdaptive for the rows in range, templated on the foreground's
+ * PixelFormat. For each row the tile colors are first blended vertically into one key per tile
+ * column, and each pixel then blends the two keys around it horizontally.
+ *
+ * @pre: background has the same layout as overlay. The taps were built for overlay's size and the
+ *       tile grid.
+ * @post: pixels of overlay close to their local key are replaced by tiled background pixels.
+ **************************************************************************************************/
+template<class Format>
+static void overlayPixelsAdaptive(Mat& overlay,
+                                  const Mat& background,
+                                  const Mat& tileColors,
+                                  int threshold,
+                                  const Range& rows,
+                                  const vector<int>& rowFirst,
+                                  const vector<int>& rowSecond,
+                                  const vector<int>& rowWeight,
+                                  const vector<int>& colFirst,
+                                  const vector<int>& colSecond,
+                                  const vector<int>& colWeight)
+{
+    const int tilesX = tileColors.cols;
+    const int half = 1 << (2 * WEIGHT_BITS - 1);
+
+    //Keys of the current row, blue, green and red for each tile column, scaled by WEIGHT_ONE
+    vector<int> rowKeys(tilesX * 3);
+
+    for(int i = rows.start; i < rows.end; i++)
+    {
+        const Vec3i* above = tileColors.ptr<Vec3i>(rowFirst[i]);
+        const Vec3i* below = tileColors.ptr<Vec3i>(rowSecond[i]);
+        int wy = rowWeight[i];
+
+        for(int t = 0; t < tilesX; t++)
+        {
+            for(int c = 0; c < 3; c++)
+                rowKeys[t * 3 + c] = above[t][c] * (WEIGHT_ONE - wy) + below[t][c] * wy;
+        }
+
+        uchar* row = overlay.ptr<uchar>(i);
+        const uchar* backgroundRow = background.ptr<uchar>(i % background.rows);
+
+        for(int j = 0; j < overlay.cols; j++)
+        {
+            const int* left = &rowKeys[colFirst[j] * 3];
+            const int* right = &rowKeys[colSecond[j] * 3];
+            int wx = colWeight[j];
+
+            int blue = (left[0] * (WEIGHT_ONE - wx) + right[0] * wx + half) >> (2 * WEIGHT_BITS);
+            int green = (left[1] * (WEIGHT_ONE - wx) + right[1] * wx + half) >> (2 * WEIGHT_BITS);
+            int red = (left[2] * (WEIGHT_ONE - wx) + right[2] * wx + half) >> (2 * WEIGHT_BITS);
+
+            uchar* pixel = row + j * Format::channels;
+
+            if(abs(pixel[Format::blue] - blue) < threshold &&
+               abs(pixel[Format::green] - green) < threshold &&
+               abs(pixel[Format::red] - red) < threshold)
+            {
+                const uchar* replacement = backgroundRow + (j % background.cols) * Format::channels;
+
+                for(int c = 0; c < Format::channels; c++)
+                    pixel[c] = replacement[c];
+            }
+        }
+    }
+}
+
+/***************************************************************************************************
+ * Overlay Background Adaptive - Implementation
+ *
+ * @param foreground : The image which the background will be overlaid onto
+ * @param background : The image to overlay onto the foreground
+ * @param tileColors : The output of getTileColors for the foreground
+ * @param threshold : How close to the local key must a pixel be in order to be replaced
+ *
+ * Purpose:
+ *
+ * Works as overlayBackground, except that the color each pixel is compared against is
+ * interpolated bilinearly between the centres of the four tiles around it. The interpolation
+ * weights along each axis are computed once, and the blend is done in fixed point. Rows are split
+ * across threads. With a 1 x 1 grid the result is identical to overlayBackground.
+ *
+ * @pre: foreground, background, and tileColors are all initialized. Threshold is greater than
+ *       zero.
+ * @post: background is overlaid onto foreground pixels close to their local key, overlaid image is
+ *        returned.
+ *
+ * @return A copy of foreground with background pixels overlaid.
+ **************************************************************************************************/
+Mat overlayBackgroundAdaptive(const Mat& foreground,
+                              const Mat& background,
+                              const Mat& tileColors,
+                              int threshold)
+{
+    Trace::span trace("overlayBackgroundAdaptive");
+
+    CV_Assert(tileColors.type() == CV_32SC3 && !tileColors.empty());
+
+    Mat overlay = Mat();
+    foreground.copyTo(overlay);
+
+    Mat tile = Mat();
+    convertChannels(background, tile, overlay.channels());
+
+    vector<int> rowFirst, rowSecond, rowWeight, colFirst, colSecond, colWeight;
+    interpolationTaps(overlay.rows, tileColors.rows, rowFirst, rowSecond, rowWeight);
+    interpolationTaps(overlay.cols, tileColors.cols, colFirst, colSecond, colWeight);
+
+    dispatchPixelFormat(overlay, [&](auto format)
+    {
+        parallelFor(Range(0, overlay.rows), [&](const Range& range)
+        {
+            overlayPixelsAdaptive<decltype(format)>(overlay, tile, tileColors, threshold, range,
+                                                    rowFirst, rowSecond, rowWeight,
+                                                    colFirst, colSecond, colWeight);
+        });
+    });
+
+    return overlay;
+}
+
+/***************************************************************************************************
+ * Get Most Common Color (planar) - Implementation
+ *
+ * @param image : The planar image from which the most common color will be determined
+ * @param buckets : The amount of buckets in the color histogram used to determine most common color
+ *
+ * Purpose:
+ *
+ * getMostCommonColor for a planar image. ColorHistogram computes the bin indices of each run of
+ * pixels from the planes in one vectorized loop before counting them.
+ *
+ * @pre: image is initialized and buckets is greater than zero.
+ * @post: None.
+ *
+ * @return The same color as getMostCommonColor on the interleaved image
+ **************************************************************************************************/
+Vec3i getMostCommonColor(const PlanarImage& image, int buckets)
+{
+    Trace::span trace("getMostCommonColor planar");
+
+    Mat hist;
+    ColorHistogram::fill(image, hist, buckets);
+
+    return findMaxBucket(hist, buckets);
+}
+
+/***************************************************************************************************
+ * Key Bounds - Implementation
+ *
+ * The range of 8-bit values v with abs(v - key) < threshold, inclusive. When no value qualifies
+ * the range is empty (low > high), so comparing against it never matches.
+ **************************************************************************************************/
+static void keyBounds(int key, int threshold, uchar& low, uchar& high)
+{
+    int lowest = key - threshold + 1;
+    int highest = key + threshold - 1;
+
+    if(lowest > highest || highest < 0 || lowest > 255)
+    {
+        low = 1;
+        high = 0;
+        return;
+    }
+
+    low = (uchar)max(lowest, 0);
+    high = (uchar)min(highest, 255);
+}
+
+/***************************************************************************************************
+ * Key Mask Planar - Implementation
+ *
+ * Marks the pixels of one row that are close to the key. Each compare is between bytes of one
+ * plane and a constant, so a 128-bit register tests 16 pixels at once.
+ *
+ * @pre: blue, green and red hold width values. mask has room for width bytes.
+ * @post: mask is all ones where the pixel is keyed and zero elsewhere.
+ **************************************************************************************************/
+static void keyMaskPlanar(const uchar* blue,
+                          const uchar* green,
+                          const uchar* red,
+                          uchar* mask,
+                          int width,
+                          const uchar* low,
+                          const uchar* high)
+{
+    const uchar lowBlue = low[0], lowGreen = low[1], lowRed = low[2];
+    const uchar highBlue = high[0], highGreen = high[1], highRed = high[2];
+
+    for(int j = 0; j < width; j++)
+    {
+        mask[j] = (uchar)-((blue[j] >= lowBlue) & (blue[j] <= highBlue) &
+                           (green[j] >= lowGreen) & (green[j] <= highGreen) &
+                           (red[j] >= lowRed) & (red[j] <= highRed));
+    }
+}
+
+/***************************************************************************************************
+ * Blend Planar - Implementation
+ *
+ * Takes each byte of one plane's row from the background where the mask is set and from the
+ * foreground elsewhere, without branches.
+ *
+ * @pre: every pointer holds width bytes.
+ * @post: output[j] = mask[j] ? background[j] : foreground[j]
+ **************************************************************************************************/
+static void blendPlanar(const uchar* foreground,
+                        const uchar* background,
+                        const uchar* mask,
+                        uchar* output,
+                        int width)
+{
+    for(int j = 0; j < width; j++)
+        output[j] = (uchar)((background[j] & mask[j]) | (foreground[j] & ~mask[j]));
+}
+
+/***************************************************************************************************
+ * Overlay Background (planar) - Implementation
+ *
+ * @param foreground : The planar image which the background will be overlaid onto
+ * @param background : The planar image to overlay onto the foreground
+ * @param mostCommonColor : The most common color identified in the foreground image
+ * @param threshold : How close to the common color must a pixel be in order to be replaced
+ *
+ * Purpose:
+ *
+ * overlayBackground for planar images. The threshold test is turned into an inclusive byte range
+ * per channel, so each row's mask is built from byte compares on the planes. Every plane of the
+ * row is then blended through the mask, in runs that line up with one repeat of the tiled
+ * background as in overlayBackgroundYCbCr. Rows are split across threads.
+ *
+ * @pre: foreground and background are initialized with the same channel count.
+ * @post: None.
+ *
+ * @return A new planar image, the foreground with background pixels overlaid
+ **************************************************************************************************/
+PlanarImage overlayBackground(const PlanarImage& foreground,
+                              const PlanarImage& background,
+                              const Vec3i& mostCommonColor,
+                              int threshold)
+{
+    Trace::span trace("overlayBackground planar");
+
+    CV_Assert(!foreground.empty() && !background.empty());
+    CV_Assert(foreground.channels() == background.channels());
+
+    PlanarImage overlay(foreground.rows(), foreground.cols(), foreground.channels());
+
+    uchar low[3], high[3];
+
+    for(int c = 0; c < 3; c++)
+        keyBounds(mostCommonColor[c], threshold, low[c], high[c]);
+
+    const int cols = foreground.cols();
+    const int tileCols = background.cols();
+
+    parallelFor(Range(0, foreground.rows()), [&](const Range& range)
+    {
+        vector<uchar> mask(cols);
+
+        for(int i = range.start; i < range.end; i++)
+        {
+            keyMaskPlanar(foreground.row(foreground.bluePlane(), i),
+                          foreground.row(foreground.greenPlane(), i),
+                          foreground.row(foreground.redPlane(), i),
+                          mask.data(), cols, low, high);
+
+            int tileRow = i % background.rows();
+
+            for(int c = 0; c < foreground.channels(); c++)
+            {
+                const uchar* source = foreground.row(c, i);
+                const uchar* replacement = background.row(c, tileRow);
+                uchar* output = overlay.row(c, i);
+
+                for(int start = 0; start < cols; start += tileCols)
+                {
+                    blendPlanar(source + start, replacement, mask.data() + start, output + start,
+                                min(tileCols, cols - start));
+                }
+            }
+        }
+    });
+
+    return overlay;
+}
+
+/***************************************************************************************************
+ * Decode For Histogram - Implementation
+ *
+ * @param encoded : The encoded image file
+ * @param decoded : The full size decode of encoded, used when a reduced decode would not help
+ * @param scale : 1, 2, 4 or 8
+ *
+ * Purpose:
+ *
+ * Decodes a smaller copy of a JPEG for the histogram pass of getMostCommonColor, reusing bytes
+ * that were already read for the full decode. JPEG files are recognised by their start-of-image
+ * marker. Scaled decoding averages each 2x2, 4x4 or 8x8 block, so counts shift slightly between
+ * buckets compared to the full image; with a few buckets per channel the most common bucket of a
+ * backdrop does not change. An image without a dominant color can get a different bucket that is
+ * nearly as common: Overlay.jpg in data/ has 17.6% of its pixels in its most common bucket and
+ * 15.6% in the one the 1/8 decode picks.
+ *
+ * @pre: decoded is the IMREAD_COLOR decode of encoded.
+ * @post: None.
+ *
+ * @return A BGR image for getMostCommonColor
+ **************************************************************************************************/
+Mat decodeForHistogram(const vector<uchar>& encoded, const Mat& decoded, int scale)
+{
+    bool isJpeg = encoded.size() > 3 &&
+                  encoded[0] == 0xFF && encoded[1] == 0xD8 && encoded[2] == 0xFF;
+
+    int flags;
+
+    switch(scale)
+    {
+        case 2: flags = IMREAD_REDUCED_COLOR_2; break;
+        case 4: flags = IMREAD_REDUCED_COLOR_4; break;
+        case 8: flags = IMREAD_REDUCED_COLOR_8; break;
+        default: return decoded;
+    }
+
+    if(!isJpeg)
+        return decoded;
+
+    Trace::span trace("decode reduced");
+    Mat reduced = imdecode(Mat(encoded), flags);
+
+    return reduced.empty() ? decoded : reduced;
+}
+
+/***************************************************************************************************
+ * Find Max Bucket - Implementation
+ *
+ * @param hist : The 3D histogram from which the maximum bucket will be determined
+ * @param buckets : The amount of buckets in the color histogram used to determine most common color
+ *
+ * Purpose:
+ *
+ * From the populated 3D array of buckets, this function finds the max. Based on the number of
+ * buckets, it determines what the actual color was (bucket index to pixel conversion) and returns
+ * this as the most common color.
+ *
+ * @pre: hist is initialized and filled with bucket counts. Buckets is greater than 1. Max count is
+ *       greater than 0.
+ * @post: The bucket with the highest count is determined and returned as a Vector 3.
+ *
+ * @return a Vec3b representing the most common color in the provided image
+ **************************************************************************************************/
+Vec3i findMaxBucket(const Mat& hist, int buckets)
+{
+    Trace::span trace("findMaxBucket");
+
+    Vec3i mostCommonColor = Vec3i(0,0,0);
+
+    int max = 0;
+
+    for(int i = 0; i < buckets; i++)
+    {
+        for(int j = 0; j < buckets; j++)
+        {
+            for(int k = 0; k < buckets; k++)
+            {
+                int count = hist.at<int>(i, j, k);
+
+                if(count > max)
+                {
+                    max = count;
+
+                    mostCommonColor = Vec3i(i * (256 / buckets),
+                                            j * (256 / buckets),
+                                            k * (256 / buckets));
+                }
+            }
+        }
+    }
+
+    return mostCommonColor;
+}
@@ -0,0 +1,225 @@
+/*******************************************************************************
+ * Keying Job Implementation
+ *
+ * @author Matthew Munson
+ * @date 5/5/2021
+ *
+ * All three cache keys are computed from bytes that are read anyway, before
+ * anything is decoded, so a fully cached job costs two file reads, three
+ * hashes and one file write.
+ *
+ ******************************************************************************/
+
+#include "KeyingJob.h"
+
+#include "Keying.h"
+#include "../Common/AsyncImageLoader.h"
+#include "../Common/ContentHash.h"
+#include "../Common/Metrics.h"
+#include "../Common/Trace.h"
+
+using namespace std;
+using namespace cv;
+
+static const char STAGE_HELP[] = "Time spent in each stage of a job, in seconds";
+
+static Metrics::histogram& readSeconds =
+    Metrics::addHistogram("machinevision_stage_seconds", STAGE_HELP,
+                          "pipeline=\"keying\",stage=\"read\"");
+static Metrics::histogram& cacheSeconds =
+    Metrics::addHistogram("machinevision_stage_seconds", STAGE_HELP,
+                          "pipeline=\"keying\",stage=\"cache\"");
+static Metrics::histogram& decodeSeconds =
+    Metrics::addHistogram("machinevision_stage_seconds", STAGE_HELP,
+                          "pipeline=\"keying\",stage=\"decode\"");
+static Metrics::histogram& histogramSeconds =
+    Metrics::addHistogram("machinevision_stage_seconds", STAGE_HELP,
+                          "pipeline=\"keying\",stage=\"histogram\"");
+static Metrics::histogram& maskSeconds =
+    Metrics::addHistogram("machinevision_stage_seconds", STAGE_HELP,
+                          "pipeline=\"keying\",stage=\"mask\"");
+static Metrics::histogram& overlaySeconds =
+    Metrics::addHistogram("machinevision_stage_seconds", STAGE_HELP,
+                          "pipeline=\"keying\",stage=\"overlay\"");
+static Metrics::histogram& encodeSeconds =
+    Metrics::addHistogram("machinevision_stage_seconds", STAGE_HELP,
+                          "pipeline=\"keying\",stage=\"encode\"");
+static Metrics::histogram& writeSeconds =
+    Metrics::addHistogram("machinevision_stage_seconds", STAGE_HELP,
+                          "pipeline=\"keying\",stage=\"write\"");
+
+static Metrics::counter& bytesRead =
+    Metrics::addCounter("machinevision_bytes_read_total", "Bytes of input files read",
+                        "pipeline=\"keying\"");
+static Metrics::counter& bytesWritten =
+    Metrics::addCounter("machinevision_bytes_written_total", "Bytes of output files written",
+                        "pipeline=\"keying\"");
+
+// Purpose: Mark a job failed
+// Preconditions: None
+// Postconditions: outcome holds the error. Returns false for the caller to return.
+static bool fail(keyingOutcome& outcome, const string& error)
+{
+    outcome.ok = false;
+    outcome.error = error;
+
+    return false;
+}
+
+bool KeyingJob::run(const string& foregroundPath,
+                    const string& backgroundPath,
+                    const string& outputPath,
+                    const keyingSettings& settings,
+                    ResultCache* cache,
+                    keyingOutcome& outcome,
+                    bool keepOverlay)
+{
+    outcome = keyingOutcome();
+
+    //Each lap closes the stage that just ran, so stages cover the job without gaps
+    Metrics::timer stages;
+
+    vector<uchar> foregroundBytes;
+    vector<uchar> backgroundBytes;
+
+    if(!AsyncImageLoader::readFile(foregroundPath, foregroundBytes))
+        return fail(outcome, "cannot read " + foregroundPath);
+
+    if(!AsyncImageLoader::readFile(backgroundPath, backgroundBytes))
+        return fail(outcome, "cannot read " + backgroundPath);
+
+    bytesRead.add(foregroundBytes.size() + backgroundBytes.size());
+    stages.lap(readSeconds);
+
+    string extension = outputPath.substr(min(outputPath.find_last_of('.'), outputPath.size()));
+
+    if(extension.empty())
+        extension = ".jpg";
+
+    //Chain the keys so each one covers every input of the step before it
+    uint64_t colorKey = hashBytes(foregroundBytes.data(), foregroundBytes.size());
+    colorKey = hashValue(colorKey, CACHE_VERSION);
+    colorKey = hashValue(colorKey, settings.buckets);
+    colorKey = hashValue(colorKey, settings.decodeScale);
+
+    uint64_t maskKey = hashValue(colorKey, settings.threshold);
+    maskKey = hashValue(maskKey, settings.tiles);
+    maskKey = hashValue(maskKey, settings.maxDrift);
+
+    uint64_t outputKey = hashBytes(backgroundBytes.data(), backgroundBytes.size(), maskKey);
+    outputKey = hashBytes(extension.data(), extension.size(), outputKey);
+
+    outcome.outputCached = cache && cache->loadEncoded(outputKey, outcome.encoded);
+
+    if(outcome.outputCached && !keepOverlay)
+    {
+        //The color is still reported, and is almost always cached alongside the output
+        outcome.colorCached = cache->loadColor(colorKey, outcome.mostCommonColor);
+
+        stages.lap(cacheSeconds);
+    }
+    else
+    {
+        stages.lap(cacheSeconds);
+
+        Trace::span decodeForeground("decode", foregroundPath);
+        Mat foreground = imdecode(Mat(foregroundBytes), IMREAD_COLOR);
+        decodeForeground.end();
+
+        if(foreground.empty())
+            return fail(outcome, "cannot decode " + foregroundPath);
+
+        stages.lap(decodeSeconds);
+
+        outcome.colorCached = cache && cache->loadColor(colorKey, outcome.mostCommonColor);
+
+        if(!outcome.colorCached)
+        {
+            Mat histogramImage = decodeForHistogram(foregroundBytes,
+                                                    foreground,
+                                                    settings.decodeScale);
+
+            outcome.mostCommonColor = getMostCommonColor(histogramImage, settings.buckets);
+
+            if(cache)
+                cache->storeColor(colorKey, outcome.mostCommonColor);
+        }
+
+        stages.lap(histogramSeconds);
+
+        bool adaptive = settings.tiles > 1;
+        Mat mask = Mat();
+        Mat tileColors = Mat();
+
+        if(adaptive)
+        {
+            //The tile colors depend on the full-size foreground, so there is nothing to cache
+            Size grid(min(settings.tiles, foreground.cols), min(settings.tiles, foreground.rows));
+            tileColors = getTileColors(foreground,
+                                       settings.buckets,
+                                       grid,
+                                       outcome.mostCommonColor,
+                                       settings.maxDrift);
+        }
+        else
+        {
+            outcome.maskCached = cache && cache->loadMask(maskKey, mask) &&
+                                 mask.size() == foreground.size();
+
+            if(!outcome.maskCached)
+            {
+                mask = getKeyMask(foreground, outcome.mostCommonColor, settings.threshold);
+
+                if(cache)
+                    cache->storeMask(maskKey, mask);
+            }
+        }
+
+        stages.lap(maskSeconds);
+
+        Trace::span decodeBackground("decode", backgroundPath);
+        Mat background = imdecode(Mat(backgroundBytes), IMREAD_COLOR);
+        decodeBackground.end();
+
+        if(background.empty())
+            return fail(outcome, "cannot decode " + backgroundPath);
+
+        stages.lap(decodeSeconds);
+
+        Mat overlay = adaptive ? overlayBackgroundAdaptive(foreground,
+                                                           background,
+                                                           tileColors,
+                                                           settings.threshold)
+                               : overlayWithMask(foreground, background, mask);
+
+        stages.lap(overlaySeconds);
+
+        if(keepOverlay)
+            outcome.overlay = overlay;
+
+        if(!outcome.outputCached)
+        {
+            Trace::span encode("encode", outputPath);
+
+            if(!imencode(extension, overlay, outcome.encoded))
+                return fail(outcome, "cannot encode " + outputPath);
+
+            encode.end();
+
+            if(cache)
+                cache->storeEncoded(outputKey, outcome.encoded);
+
+            stages.lap(encodeSeconds);
+        }
+    }
+
+    if(!ResultCache::writeFile(outputPath, outcome.encoded))
+        return fail(outcome, "cannot write " + outputPath);
+
+    bytesWritten.add(outcome.encoded.size());
+    stages.lap(writeSeconds);
+
+    outcome.ok = true;
+
+    return true;
+}
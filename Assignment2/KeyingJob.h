@@ -0,0 +1,92 @@
+/*******************************************************************************
+ * Keying Job Signatures
+ *
+ * @author Matthew Munson
+ * @date 5/5/2021
+ *
+ * The whole program II pipeline for one foreground / background pair, from
+ * file paths to an encoded output file, with each step optionally served from
+ * a ResultCache:
+ *
+ * 1. The most common color, keyed by the foreground bytes and the histogram
+ *    settings
+ * 2. The key mask, keyed by (1) and the threshold. It does not depend on the
+ *    background, so a new background reuses it. With adaptive keying (more
+ *    than one tile) there is no mask step: the foreground is keyed and
+ *    overlaid in one pass by overlayBackgroundAdaptive.
+ * 3. The encoded output, keyed by (2), the background bytes and the output
+ *    format. On a hit nothing is decoded or encoded at all.
+ *
+ * Used by program II's main() and by batch runs.
+ *
+ ******************************************************************************/
+
+#ifndef MACHINEVISION_KEYINGJOB_H
+#define MACHINEVISION_KEYINGJOB_H
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+#include "ResultCache.h"
+
+using namespace cv;
+
+// Settings that change the output. All of them are part of the cache keys.
+struct keyingSettings
+{
+    int buckets;        // Histogram buckets per channel, see getMostCommonColor()
+    int threshold;      // See overlayBackground()
+    int decodeScale;    // Reduced decode for the histogram, see decodeForHistogram()
+    int tiles;          // Tiles across and down for overlayBackgroundAdaptive(), 1 for one key
+    int maxDrift;       // See getTileColors(). Unused with one tile.
+};
+
+// What happened to one job
+struct keyingOutcome
+{
+    bool ok;
+    std::string error;              // Why the job failed, if it did
+
+    Vec3i mostCommonColor;
+    std::vector<uchar> encoded;     // The output file's contents
+    Mat overlay;                    // The overlay before encoding, if it was asked for
+
+    bool colorCached;
+    bool maskCached;
+    bool outputCached;
+};
+
+class KeyingJob {
+
+public:
+
+    /***********************************************************************************************
+     * Run
+     *
+     * Keys foreground against its most common color, overlays background and writes the encoded
+     * result to outputPath. The output format follows outputPath's extension. With more than one
+     * tile, each pixel is keyed against the colors of the tiles around it instead.
+     *
+     * @param cache : The cache to use, or nullptr to compute everything
+     * @param keepOverlay : Also return the overlay itself, for display. It is computed even when
+     *                      the output is cached, from the cached color and mask where possible,
+     *                      since decoding a lossy output would not give it back.
+     * @return False if an input could not be read or the output could not be written
+     **********************************************************************************************/
+    static bool run(const std::string& foregroundPath,
+                    const std::string& backgroundPath,
+                    const std::string& outputPath,
+                    const keyingSettings& settings,
+                    ResultCache* cache,
+                    keyingOutcome& outcome,
+                    bool keepOverlay = false);
+
+private:
+
+    // Bumped whenever a change to the keying code changes its results, so old entries are ignored
+    static const int CACHE_VERSION = 1;
+};
+
+
+#endif //MACHINEVISION_KEYINGJOB_H
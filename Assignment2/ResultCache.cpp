@@ -0,0 +1,134 @@
+/*******************************************************************************
+ * Result Cache Implementation
+ *
+ * @author Matthew Munson
+ * @date 5/5/2021
+ *
+ * Plain files in one directory. The temporary name used while writing
+ * includes the process id and a per-process counter, so concurrent writers of
+ * the same entry (threads or worker processes) do not collide; whichever
+ * rename lands last wins, and both wrote the same content.
+ *
+ ******************************************************************************/
+
+#include "ResultCache.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../Common/AsyncImageLoader.h"
+#include "../Common/ContentHash.h"
+#include "../Common/Metrics.h"
+
+using namespace std;
+using namespace cv;
+
+static const char LOOKUP_HELP[] = "Result cache lookups, by whether they found an entry";
+
+static Metrics::counter& lookupHits =
+    Metrics::addCounter("machinevision_cache_lookups_total", LOOKUP_HELP, "result=\"hit\"");
+static Metrics::counter& lookupMisses =
+    Metrics::addCounter("machinevision_cache_lookups_total", LOOKUP_HELP, "result=\"miss\"");
+
+ResultCache::ResultCache(const string& directory)
+    : directory(directory)
+{
+    if(mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+        CV_Error(Error::StsError, "Cannot create cache directory " + directory);
+}
+
+string ResultCache::entryPath(uint64_t key, const string& suffix) const
+{
+    return directory + "/" + hashToHex(key) + suffix;
+}
+
+bool ResultCache::record(bool found)
+{
+    (found ? lookupHits : lookupMisses).add();
+
+    return found;
+}
+
+bool ResultCache::writeFile(const string& path, const vector<uchar>& bytes)
+{
+    static atomic<unsigned> sequence(0);
+
+    string temporary = path + ".tmp" + to_string(getpid()) + "." + to_string(sequence++);
+
+    {
+        ofstream file(temporary, ios::binary);
+        file.write((const char*)bytes.data(), (streamsize)bytes.size());
+
+        if(!file)
+        {
+            remove(temporary.c_str());
+            return false;
+        }
+    }
+
+    if(rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        remove(temporary.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool ResultCache::loadColor(uint64_t key, Vec3i& color)
+{
+    ifstream file(entryPath(key, ".color"));
+    Vec3i stored;
+
+    if(!(file >> stored[0] >> stored[1] >> stored[2]))
+        return record(false);
+
+    color = stored;
+    return record(true);
+}
+
+void ResultCache::storeColor(uint64_t key, const Vec3i& color)
+{
+    string text = to_string(color[0]) + " " + to_string(color[1]) + " " + to_string(color[2]);
+
+    writeFile(entryPath(key, ".color"), vector<uchar>(text.begin(), text.end()));
+}
+
+bool ResultCache::loadMask(uint64_t key, Mat& mask)
+{
+    vector<uchar> bytes;
+
+    if(!AsyncImageLoader::readFile(entryPath(key, ".mask.png"), bytes))
+        return record(false);
+
+    Mat stored = imdecode(Mat(bytes), IMREAD_GRAYSCALE);
+
+    if(stored.empty())
+        return record(false);
+
+    mask = stored;
+    return record(true);
+}
+
+void ResultCache::storeMask(uint64_t key, const Mat& mask)
+{
+    vector<uchar> bytes;
+
+    //Masks are almost all runs of 0 and 255, so light compression is enough
+    if(imencode(".png", mask, bytes, {IMWRITE_PNG_COMPRESSION, 1}))
+        writeFile(entryPath(key, ".mask.png"), bytes);
+}
+
+bool ResultCache::loadEncoded(uint64_t key, vector<uchar>& bytes)
+{
+    return record(AsyncImageLoader::readFile(entryPath(key, ".out"), bytes));
+}
+
+void ResultCache::storeEncoded(uint64_t key, const vector<uchar>& bytes)
+{
+    writeFile(entryPath(key, ".out"), bytes);
+}
@@ -0,0 +1,84 @@
+/*******************************************************************************
+ * Result Cache Signatures
+ *
+ * @author Matthew Munson
+ * @date 5/5/2021
+ *
+ * An on-disk cache for the keying pipeline, so that rerunning a batch only
+ * processes the inputs or settings that changed. Entries are named by a hash
+ * of everything they were computed from (see ContentHash.h) and are never
+ * updated in place: a changed input or setting produces a different name, and
+ * stale entries are simply never read again. Deleting the directory empties
+ * the cache.
+ *
+ * Three kinds of entry are stored, one file each:
+ *
+ * - <key>.color : the most common color, as text
+ * - <key>.mask.png : a key mask (see getKeyMask())
+ * - <key>.out : encoded output bytes, written out unchanged on a hit
+ *
+ * Entries are written to a temporary file and renamed into place, so a reader
+ * (or a second process sharing the cache) never sees a partial entry.
+ *
+ * Lookups are counted as hits and misses in machinevision_cache_lookups_total
+ * (see Metrics.h), which batch and server runs export.
+ *
+ * Header file documentation is user-focused. For implementation-level comments
+ * see ResultCache.cpp
+ *
+ ******************************************************************************/
+
+#ifndef MACHINEVISION_RESULTCACHE_H
+#define MACHINEVISION_RESULTCACHE_H
+
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+using namespace cv;
+
+class ResultCache {
+
+public:
+
+    /***********************************************************************************************
+     * Constructor
+     *
+     * @param directory : Where entries are stored. Created if it does not exist.
+     **********************************************************************************************/
+    explicit ResultCache(const std::string& directory);
+
+    // Each load returns false on a miss and leaves its output untouched
+
+    bool loadColor(uint64_t key, Vec3i& color);
+    void storeColor(uint64_t key, const Vec3i& color);
+
+    bool loadMask(uint64_t key, Mat& mask);
+    void storeMask(uint64_t key, const Mat& mask);
+
+    bool loadEncoded(uint64_t key, std::vector<uchar>& bytes);
+    void storeEncoded(uint64_t key, const std::vector<uchar>& bytes);
+
+    /***********************************************************************************************
+     * Write File
+     *
+     * Writes bytes to a file through a temporary file and a rename, so that the file never exists
+     * partially written.
+     *
+     * @return False if the file could not be written
+     **********************************************************************************************/
+    static bool writeFile(const std::string& path, const std::vector<uchar>& bytes);
+
+private:
+
+    std::string directory;
+
+    std::string entryPath(uint64_t key, const std::string& suffix) const;
+
+    // Counts the lookup in machinevision_cache_lookups_total and passes on whether it was found
+    static bool record(bool found);
+};
+
+
+#endif //MACHINEVISION_RESULTCACHE_H
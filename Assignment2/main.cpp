@@ -19,76 +19,132 @@
  *
  * Upon completion, this program will create:
  * - overlay.jpg : The overlay of background.jpg onto parts of foreground.jpg
+ * - overlay-cache/ : Cached intermediate results. Running again with the same images and settings
+ * copies overlay.jpg from the cache instead of encoding it again, and rebuilds the displayed
+ * overlay from the cached color and mask. Safe to delete.
  *
- *__________________________________________________________________________________________________
- * Implementation Details:
+ * Adaptive keying:
+ *
+ *     MachineVision --tiles N
+ *
+ * keys each pixel against an N x N grid of local backdrop colors (see overlayBackgroundAdaptive)
+ * instead of one color, for backdrops that are unevenly lit. It uses a finer histogram so that the
+ * tile colors follow the lighting.
+ *
+ * Batch mode:
  *
- * int main()
- * - Program entry point. Loads images, calls getMostCommonColor, then overlayBackground. Displays
- * the overlay image and saves it to file.
+ *     MachineVision --batch <job file> [--workers N] [--manifest path] [--cache dir]
+ *                   [--scheduler] [--pin] [--metrics path] [--metrics-port N] [--trace path]
  *
- * Vec3b getMostCommonColor(const Mat&image, int buckets)
- * - Returns the most common color in an image.
+ * runs every job in the job file (see BatchJobs.h) across N worker processes (see BatchRunner.h)
+ * instead, without displaying anything, and writes a manifest of the results (default
+ * manifest.tsv). The exit code is 1 if any job failed.
  *
+ * --scheduler runs the parallel kernels on the project's work-stealing scheduler (see
+ * TaskScheduler.h) instead of OpenCV's thread pool. --pin implies it and also binds each thread to
+ * a CPU in NUMA node order. Both apply to server mode too.
  *
- * Mat overlayBackground(const Mat& foreground, const Mat& background, const Vec3b& mostCommonColor,
- *                    int threshold)
- * - Overlays a background image onto the foreground image where the pixels are within a certain
- * threshold of the provided most common color
+ * --metrics rewrites a Prometheus text file (see Metrics.h) every second with job counts, queue
+ * depth, per-stage latency, bytes read and written and result cache hits, for node_exporter's
+ * textfile collector.
+ * --metrics-port serves the same text over HTTP on 127.0.0.1 for scraping. Both apply to server
+ * mode too.
  *
- * Vec3i findMaxBucket(const Mat& hist, int buckets)
- * - Finds the maximum bucket in a 3D histogram and returns it as a Vec3i representing a color
+ * --trace records spans around each job and its stages (decode, histogram, mask, overlay, blur,
+ * Canny, encode) and the parallel chunks under them, and writes them as Chrome trace-event JSON
+ * (see Trace.h) for chrome://tracing or ui.perfetto.dev. Batch mode writes it when the run
+ * finishes, server mode on shutdown.
+ *
+ * Server mode:
+ *
+ *     MachineVision --serve <socket path> [--cache dir] [--scheduler] [--pin] [--metrics path]
+ *                   [--metrics-port N] [--trace path]
+ *
+ * stays resident and runs the same jobs for clients of a Unix domain socket (see JobServer.h),
+ * replying with each job's output path, until a client sends "shutdown".
+ *
+ *__________________________________________________________________________________________________
+ * Implementation Details:
+ *
+ * int main(int argc, char** argv)
+ * - Program entry point. Runs the keying pipeline (KeyingJob) on the two images, which finds the
+ * most common color, keys the foreground and overlays the background, then saves the overlay to
+ * file and displays it. The foreground file is read once and decoded twice: at full size for the
+ * overlay, and at reduced size (see decodeForHistogram) for the histogram. Each step is looked up
+ * in the result cache first. With --batch or --serve, hands over to runBatch or runServer instead.
+ *
+ * int runBatch(int argc, char** argv)
+ * - Parses the batch mode arguments and runs the job file through BatchRunner
+ *
+ * int runServer(int argc, char** argv)
+ * - Parses the server mode arguments and serves jobs through JobServer until shut down
  *
  * void displayImage(const Mat& image, const string windowName)
  * - Displays an image, waits for user input, and destroys the window
  *
+ * The keying functions themselves (getMostCommonColor, overlayBackground and findMaxBucket) are
+ * declared in Keying.h and implemented in Keying.cpp. The pipeline and cache are in KeyingJob and
+ * ResultCache.
+ *
  **************************************************************************************************/
 
+#include <chrono>
 #include <iostream>
+#include <memory>
 #include <opencv2/core.hpp>
 #include <opencv2/opencv.hpp>
 
+#include "BatchJobs.h"
+#include "KeyingJob.h"
+#include "ResultCache.h"
+#include "../Common/BatchRunner.h"
+#include "../Common/JobServer.h"
+#include "../Common/Metrics.h"
+#include "../Common/TaskScheduler.h"
+#include "../Common/Trace.h"
+
 using namespace std;
 using namespace cv;
 
 static const int HISTOGRAM_BUCKETS = 4;
 static const int REPLACEMENT_THRESHOLD = 60;
 
-/***************************************************************************************************
- * Get Most Common Color
- *
- * Finds the most common color in an image.
- *
- * See function implementation for detailed documentation, including purpose, preconditions, and
- * postconditions.
- **************************************************************************************************/
-Vec3i getMostCommonColor(const Mat& image, int buckets);
+// Scale the foreground is decoded at for the histogram pass. 1/8 leaves plenty of pixels per
+// bucket.
+static const int HISTOGRAM_DECODE_SCALE = 8;
+
+// Settings for --tiles. With 4 buckets a tile color can be up to 63 levels off, more than the
+// threshold, so adaptive keying uses 32. A tile color further than the drift from the global key
+// is taken to be the subject.
+static const int ADAPTIVE_BUCKETS = 32;
+static const int TILE_MAX_DRIFT = 96;
+
+static const string CACHE_DIRECTORY = "overlay-cache";
+
+static const string DEFAULT_MANIFEST = "manifest.tsv";
+
+// How often server mode rewrites the --metrics file
+static const chrono::milliseconds METRICS_INTERVAL(1000);
 
 /***************************************************************************************************
- * Overlay Background
+ * Run Batch
  *
- * Overlays a background image onto a foreground, replacing colors within a certain threshold of
- * a provided most common color.
+ * Batch mode entry point, used when the first argument is --batch.
  *
  * See function implementation for detailed documentation, including purpose, preconditions, and
  * postconditions.
  **************************************************************************************************/
-Mat overlayBackground(const Mat& foreground,
-                      const Mat& background,
-                      const Vec3i& mostCommonColor,
-                      int threshold);
+int runBatch(int argc, char** argv);
 
 /***************************************************************************************************
- * Find Max Bucket
+ * Run Server
  *
- * Helper function for getMostCommonColor. From a 3D histogram, determines which bucket has the
- * greatest count (in other words, the most common color in the image) and returns it as a Vec3i
- * representing a pixel.
+ * Server mode entry point, used when the first argument is --serve.
  *
  * See function implementation for detailed documentation, including purpose, preconditions, and
  * postconditions.
  **************************************************************************************************/
-Vec3i findMaxBucket(const Mat& hist, int buckets);
+int runServer(int argc, char** argv);
 
 /***************************************************************************************************
  * Display Image
@@ -107,177 +163,255 @@ void displayImage(const Mat& image, const string& windowName);
  * Purpose:
  * Program entry point. Loads the foreground and background image from disk. Determines the most
  * common color in the foreground image. Overlays the background image onto the foreground based
- * on the most common color. Displays the image to the user and saves it to disk.
+ * on the most common color. Saves the image to disk and displays it to the user. Results already
+ * in the cache are reused.
  *
- * @pre: foreground.jpg and background.jpg are in the working directory.
+ * @pre: foreground.jpg and background.jpg are in the working directory, or --batch or --serve is
+ * given. The only other argument accepted is --tiles N.
  * @post: overlay image displayed to screen and saved to disk.
  *
  * @return exit code indicating program status. Zero indicates success.
  **************************************************************************************************/
-int main()
+int main(int argc, char** argv)
 {
+    if(argc > 1 && string(argv[1]) == "--batch")
+        return runBatch(argc, argv);
+
+    if(argc > 1 && string(argv[1]) == "--serve")
+        return runServer(argc, argv);
+
     string foreground_filename = "foreground.jpg";
     string background_filename = "background.jpg";
+    string overlay_filename = "overlay.jpg";
 
-    Mat foreground = imread(foreground_filename, IMREAD_COLOR);
-    Mat background = imread(background_filename, IMREAD_COLOR);
+    keyingSettings settings = {HISTOGRAM_BUCKETS,
+                               REPLACEMENT_THRESHOLD,
+                               HISTOGRAM_DECODE_SCALE,
+                               1,
+                               TILE_MAX_DRIFT};
 
-    Vec3i mostCommonColor = getMostCommonColor(foreground, HISTOGRAM_BUCKETS);
+    if(argc == 3 && string(argv[1]) == "--tiles" && atoi(argv[2]) >= 1)
+    {
+        settings.tiles = atoi(argv[2]);
+        settings.buckets = settings.tiles > 1 ? ADAPTIVE_BUCKETS : HISTOGRAM_BUCKETS;
+    }
+    else if(argc > 1)
+    {
+        cerr << "usage: " << argv[0] << " [--tiles N | --batch <job file> ... | --serve <socket>"
+             << " ...]" << endl;
+        return 1;
+    }
 
-    Mat overlay = overlayBackground(foreground, background, mostCommonColor, REPLACEMENT_THRESHOLD);
+    ResultCache cache(CACHE_DIRECTORY);
+    keyingOutcome outcome;
 
-    displayImage(overlay, "Overlay Image");
+    if(!KeyingJob::run(foreground_filename,
+                       background_filename,
+                       overlay_filename,
+                       settings,
+                       &cache,
+                       outcome,
+                       true))
+    {
+        cerr << outcome.error << endl;
+        return 1;
+    }
 
-    imwrite("overlay.jpg", overlay);
+    displayImage(outcome.overlay, "Overlay Image");
 
     return 0;
 }
 
 /***************************************************************************************************
- * Overlay Background - Implementation
+ * Run Batch - Implementation
  *
- * @param foreground : The image which the background will be overlaid onto
- * @param background : The image to overlay onto the foreground
- * @param mostCommonColor : The most common color identified in the foreground image
- * @param threshold : How close to the common color must a pixel be in order to be replaced
+ * @param argc, argv : main()'s arguments, starting with --batch <job file>
  *
  * Purpose:
  *
- * Overlays the background image onto the foreground where foreground pixels are close to the
- * most common color. Loops through each pixel in the foreground image and determines if its
- * red AND green AND blue pixels are all within the provided threshold of the most common color.
- * If this is true, the pixel will be replaced with the corresponding pixel of the background image.
- * If the background image is smaller than the foreground, it will be "tiled" onto the background
- * and form a repeating pattern.
+ * Reads the job file and runs it with BatchRunner. Workers share one result cache directory;
+ * entries are renamed into place, so concurrent writers are safe. Nothing is displayed.
  *
- * @pre: foreground, background, and mostCommonColor are all initialized. Threshold is greater
- *       than zero.
- * @post: background is overlaid onto common color foreground pixels, overlaid image is returned.
+ * @pre: Called before any OpenCV threads are started, since BatchRunner forks.
+ * @post: Every job has run and the manifest is written.
  *
- * @return A copy of foreground with background pixels overlaid.
+ * @return Zero if every job succeeded, 1 otherwise.
  **************************************************************************************************/
-Mat overlayBackground(const Mat& foreground,
-                      const Mat& background,
-                      const Vec3i& mostCommonColor,
-                      int threshold)
+int runBatch(int argc, char** argv)
 {
-    Mat overlay = Mat();
-    foreground.copyTo(overlay);
+    if(argc < 3)
+    {
+        cerr << "usage: " << argv[0]
+             << " --batch <job file> [--workers N] [--manifest path] [--cache dir]"
+             << " [--scheduler] [--pin] [--metrics path] [--metrics-port N] [--trace path]" << endl;
+        return 1;
+    }
 
-    for(int i = 0; i < overlay.rows; i++)
+    string jobPath = argv[2];
+    string manifestPath = DEFAULT_MANIFEST;
+    string cacheDirectory = CACHE_DIRECTORY;
+    BatchRunner::options settings;
+
+    for(int i = 3; i < argc; i++)
     {
-        for(int j = 0; j < overlay.cols; j++)
+        string flag = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if(flag == "--scheduler")
+            settings.scheduler = true;
+        else if(flag == "--pin")
+            settings.scheduler = settings.pin = true;
+        else if(flag == "--workers" && hasValue)
+            settings.workers = atoi(argv[++i]);
+        else if(flag == "--manifest" && hasValue)
+            manifestPath = argv[++i];
+        else if(flag == "--cache" && hasValue)
+            cacheDirectory = argv[++i];
+        else if(flag == "--metrics" && hasValue)
+            settings.metricsPath = argv[++i];
+        else if(flag == "--metrics-port" && hasValue)
+            settings.metricsPort = atoi(argv[++i]);
+        else if(flag == "--trace" && hasValue)
+            settings.tracePath = argv[++i];
+        else
         {
-            Vec3b pixel = overlay.at<Vec3b>(i, j);
-
-            if(abs(pixel[0] - mostCommonColor[0]) < threshold &&
-               abs(pixel[1] - mostCommonColor[1]) < threshold &&
-               abs(pixel[2] - mostCommonColor[2]) < threshold)
-            {
+            cerr << "unknown option " << flag << endl;
+            return 1;
+        }
+    }
 
-                pixel = background.at<Vec3b>(i % background.rows, j % background.cols);
+    vector<string> jobs;
 
-                overlay.at<Vec3b>(i, j) = pixel;
-            }
-        }
+    if(!BatchJobs::readJobFile(jobPath, jobs))
+    {
+        cerr << "cannot read " << jobPath << endl;
+        return 1;
     }
 
-    return overlay;
+    ResultCache cache(cacheDirectory);
+
+    //Each worker process gets its own copy, still empty, when it is forked
+    EdgePipelinePool pipelines;
+
+    int failures = BatchRunner::run(jobs,
+                                    [&](const string& job)
+                                    {
+                                        return BatchJobs::run(job, &cache, &pipelines);
+                                    },
+                                    manifestPath,
+                                    settings);
+
+    cout << jobs.size() - failures << " of " << jobs.size() << " jobs succeeded, see "
+         << manifestPath << endl;
+
+    return failures == 0 ? 0 : 1;
 }
 
 /***************************************************************************************************
- * Get Most Common Color - Implementation
+ * Run Server - Implementation
  *
- * @param image : The image from which the most common color will be determined
- * @param buckets : The amount of buckets in the color histogram used to determine most common color
+ * @param argc, argv : main()'s arguments, starting with --serve <socket path>
  *
  * Purpose:
  *
- * Finds the most common color in the provided image using a color histogram. Goes through each
- * pixel and determines which bucket it falls into. Uses findMaxBucket() to determine which bucket
- * has the highest count, and returns this as a Vec3i.
+ * Serves keying and edge jobs (see BatchJobs.h) on a Unix domain socket. The result cache, OpenCV's
+ * thread pool (or the task scheduler) and a pool of edge pipelines stay alive between jobs.
  *
- * @pre: image is initialized and buckets is greater than zero.
- * @post: The most common color in the image is determined and returned as a Vector 3.
+ * @pre: None
+ * @post: A client has sent shutdown, and the socket file is removed.
  *
- * @return a Vec3b representing the most common color in the provided image
+ * @return Zero after a shutdown request, 1 if the socket could not be created.
  **************************************************************************************************/
-Vec3i getMostCommonColor(const Mat& image, int buckets)
+int runServer(int argc, char** argv)
 {
-    int dims[] = {buckets, buckets, buckets};
-    Mat hist(3, dims, CV_32S, Scalar::all(0));
+    string cacheDirectory = CACHE_DIRECTORY;
+    bool useScheduler = false;
+    TaskScheduler::options schedulerSettings;
+    string metricsPath;
+    int metricsPort = 0;
+    string tracePath;
 
-    //Initialize all loop variables
-    int blue, green, red, x, y, z, bucketSize;
-    Vec3b pixel;
+    bool valid = argc >= 3;
 
-    for(int i = 0; i < image.rows; i++)
+    for(int i = 3; valid && i < argc; i++)
     {
-        for(int j = 0; j < image.cols; j++)
-        {
-            pixel = image.at<Vec3b>(i, j);
+        string flag = argv[i];
+
+        if(flag == "--scheduler")
+            useScheduler = true;
+        else if(flag == "--pin")
+            useScheduler = schedulerSettings.pin = true;
+        else if(flag == "--cache" && i + 1 < argc)
+            cacheDirectory = argv[++i];
+        else if(flag == "--metrics" && i + 1 < argc)
+            metricsPath = argv[++i];
+        else if(flag == "--metrics-port" && i + 1 < argc)
+            metricsPort = atoi(argv[++i]);
+        else if(flag == "--trace" && i + 1 < argc)
+            tracePath = argv[++i];
+        else
+            valid = false;
+    }
 
-            blue = pixel[0];
-            green = pixel[1];
-            red = pixel[2];
+    if(!valid)
+    {
+        cerr << "usage: " << argv[0]
+             << " --serve <socket path> [--cache dir] [--scheduler] [--pin] [--metrics path]"
+             << " [--metrics-port N] [--trace path]" << endl;
+        return 1;
+    }
 
-            bucketSize = 256 / buckets;
-            x = red / bucketSize;
-            y = green / bucketSize;
-            z = blue / bucketSize;
+    ResultCache cache(cacheDirectory);
 
-            hist.at<int>(z, y, x)++;
-        }
+    //Before the scheduler starts, so its workers are named in the trace
+    if(!tracePath.empty())
+        Trace::enable();
+
+    //Lives until the server returns, like the cache
+    unique_ptr<TaskScheduler> scheduler;
+
+    if(useScheduler)
+    {
+        scheduler.reset(new TaskScheduler(schedulerSettings));
+        TaskScheduler::install(scheduler.get());
     }
 
-    return findMaxBucket(hist, buckets);
-}
+    unique_ptr<MetricsFile> metricsFile;
+    unique_ptr<MetricsEndpoint> metricsEndpoint;
 
-/***************************************************************************************************
- * Find Max Bucket - Implementation
- *
- * @param hist : The 3D histogram from which the maximum bucket will be determined
- * @param buckets : The amount of buckets in the color histogram used to determine most common color
- *
- * Purpose:
- *
- * From the populated 3D array of buckets, this function finds the max. Based on the number of
- * buckets, it determines what the actual color was (bucket index to pixel conversion) and returns
- * this as the most common color.
- *
- * @pre: hist is initialized and filled with bucket counts. Buckets is greater than 1. Max count is
- *       greater than 0.
- * @post: The bucket with the highest count is determined and returned as a Vector 3.
- *
- * @return a Vec3b representing the most common color in the provided image
- **************************************************************************************************/
-Vec3i findMaxBucket(const Mat& hist, int buckets)
-{
-    Vec3i mostCommonColor = Vec3i(0,0,0);
+    if(!metricsPath.empty())
+        metricsFile.reset(new MetricsFile(metricsPath, METRICS_INTERVAL));
+
+    if(metricsPort > 0)
+    {
+        metricsEndpoint.reset(new MetricsEndpoint(metricsPort));
 
-    int max = 0;
+        if(metricsEndpoint->listening())
+            metricsEndpoint->start();
+        else
+            cerr << "cannot serve metrics on port " << metricsPort << endl;
+    }
+
+    cout << "serving on " << argv[2] << endl;
+
+    //Shared by every connection, so pipelines outlive the connection threads that use them
+    EdgePipelinePool pipelines;
 
-    for(int i = 0; i < buckets; i++)
+    bool served = JobServer::serve(argv[2], [&](const string& job)
     {
-        for(int j = 0; j < buckets; j++)
-        {
-            for(int k = 0; k < buckets; k++)
-            {
-                int count = hist.at<int>(i, j, k);
-
-                if(count > max)
-                {
-                    max = count;
-
-                    mostCommonColor = Vec3i(i * (256 / buckets),
-                                            j * (256 / buckets),
-                                            k * (256 / buckets));
-                }
-            }
-        }
+        return BatchJobs::run(job, &cache, &pipelines);
+    });
+
+    if(!served)
+    {
+        cerr << "cannot listen on " << argv[2] << endl;
+        return 1;
     }
 
-    return mostCommonColor;
+    if(!tracePath.empty() && !Trace::writeFile(tracePath))
+        cerr << "cannot write trace " << tracePath << endl;
+
+    return 0;
 }
 
 /***************************************************************************************************
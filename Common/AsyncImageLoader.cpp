@@ -0,0 +1,678 @@
+/*******************************************************************************
+ * Async Image Loader Implementation
+ *
+ * @author Matthew Munson
+ * @date 5/4/2021
+ *
+ * Three stages connected by two queues, all guarded by one mutex:
+ *
+ *     reader thread --toDecode--> decode threads --decoded--> next()
+ *
+ * The reader opens each file, sizes a buffer with fstat() and reads the whole
+ * file into it. With io_uring it owns the submission and completion rings
+ * (mapped directly, without liburing) and keeps one READV per open file in
+ * the submission ring, resubmitting the remainder after a short read. A read
+ * that fails inside the ring is retried with a blocking pread() before the
+ * file is given up on, which also covers kernels that lack the operation.
+ *
+ * If io_uring_enter() itself starts failing, the reads already in the ring
+ * are cancelled and drained before their buffers are touched. If even that
+ * fails, their buffers and descriptors are leaked rather than freed under a
+ * read the kernel may still complete, and those files are read again.
+ *
+ * Memory is bounded by capacity(): the reader does not start another file
+ * while that many are read, decoded or waiting in next()'s queue.
+ *
+ ******************************************************************************/
+
+#include "AsyncImageLoader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifdef MACHINEVISION_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace std;
+using namespace cv;
+
+/***************************************************************************************************
+ * Ring
+ *
+ * The mapped submission and completion queues of one io_uring instance. Only the reader thread
+ * touches it.
+ **************************************************************************************************/
+struct AsyncImageLoader::ring
+{
+#ifdef MACHINEVISION_HAVE_IO_URING
+    int fd = -1;
+
+    void* sqMap = MAP_FAILED;
+    size_t sqMapSize = 0;
+    void* cqMap = MAP_FAILED;
+    size_t cqMapSize = 0;
+    void* sqeMap = MAP_FAILED;
+    size_t sqeMapSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqEntries = nullptr;
+    unsigned* sqArray = nullptr;
+    io_uring_sqe* sqes = nullptr;
+
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    // Purpose: Create the ring and map its queues
+    // Preconditions: None
+    // Postconditions: Returns false if io_uring is unavailable; the ring is then unusable
+    bool open(unsigned entries)
+    {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+
+        fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+
+        if(fd < 0)
+            return false;
+
+        sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+        //Newer kernels share one mapping between both rings
+        bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+
+        if(singleMap)
+            sqMapSize = cqMapSize = max(sqMapSize, cqMapSize);
+
+        sqMap = mmap(nullptr, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     fd, IORING_OFF_SQ_RING);
+
+        if(sqMap == MAP_FAILED)
+            return false;
+
+        if(singleMap)
+        {
+            cqMap = sqMap;
+        }
+        else
+        {
+            cqMap = mmap(nullptr, cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         fd, IORING_OFF_CQ_RING);
+
+            if(cqMap == MAP_FAILED)
+                return false;
+        }
+
+        sqeMapSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqeMap = mmap(nullptr, sqeMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_SQES);
+
+        if(sqeMap == MAP_FAILED)
+            return false;
+
+        char* sq = (char*)sqMap;
+        sqHead = (unsigned*)(sq + params.sq_off.head);
+        sqTail = (unsigned*)(sq + params.sq_off.tail);
+        sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+        sqEntries = (unsigned*)(sq + params.sq_off.ring_entries);
+        sqArray = (unsigned*)(sq + params.sq_off.array);
+        sqes = (io_uring_sqe*)sqeMap;
+
+        char* cq = (char*)cqMap;
+        cqHead = (unsigned*)(cq + params.cq_off.head);
+        cqTail = (unsigned*)(cq + params.cq_off.tail);
+        cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+        cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+        return true;
+    }
+
+    // Purpose: Whether another entry fits in the submission queue
+    // Preconditions: None
+    // Postconditions: None
+    bool hasRoom() const
+    {
+        return *sqTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) < *sqEntries;
+    }
+
+    // Purpose: Claim the next submission queue entry
+    // Preconditions: The submission queue has room
+    // Postconditions: The entry is zeroed. publish() makes it visible to the kernel.
+    io_uring_sqe* nextEntry()
+    {
+        io_uring_sqe* sqe = &sqes[*sqTail & *sqMask];
+        memset(sqe, 0, sizeof(*sqe));
+
+        return sqe;
+    }
+
+    // Purpose: Add the entry claimed by nextEntry() to the submission queue
+    // Preconditions: nextEntry() was called and the entry filled in
+    // Postconditions: The entry is queued, not yet submitted to the kernel
+    void publish()
+    {
+        unsigned tail = *sqTail;
+        unsigned index = tail & *sqMask;
+
+        sqArray[index] = index;
+
+        //The entry must be visible before the kernel sees the new tail
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    }
+
+    // Purpose: Queue a read of one buffer at an offset
+    // Preconditions: The submission queue has room. iov stays valid until the read completes.
+    // Postconditions: The read is in the submission queue, not yet submitted to the kernel
+    void queueReadv(int file, const iovec* iov, off_t offset, unsigned long long userData)
+    {
+        io_uring_sqe* sqe = nextEntry();
+
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = file;
+        sqe->addr = (unsigned long long)iov;
+        sqe->len = 1;
+        sqe->off = (unsigned long long)offset;
+        sqe->user_data = userData;
+
+        publish();
+    }
+
+    // Purpose: Queue a cancellation of the request queued with target as its user data
+    // Preconditions: The submission queue has room
+    // Postconditions: The cancellation completes with userData, the request itself with its own
+    //                 user data (-ECANCELED if it was cancelled, its result if it had finished)
+    void queueCancel(unsigned long long target, unsigned long long userData)
+    {
+        io_uring_sqe* sqe = nextEntry();
+
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = target;
+        sqe->user_data = userData;
+
+        publish();
+    }
+
+    // Purpose: Submit queued reads and wait for at least one completion
+    // Preconditions: None
+    // Postconditions: Returns the number submitted, or -1 with errno set
+    int enter(unsigned toSubmit, unsigned minComplete)
+    {
+        return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete,
+                            IORING_ENTER_GETEVENTS, nullptr, 0);
+    }
+
+    // Purpose: Hand every available completion to handle(userData, result)
+    // Preconditions: None
+    // Postconditions: The completions are consumed
+    template<class Handler>
+    void reap(Handler handle)
+    {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+
+        for(; head != tail; head++)
+        {
+            const io_uring_cqe& cqe = cqes[head & *cqMask];
+            handle(cqe.user_data, cqe.res);
+        }
+
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    ~ring()
+    {
+        if(sqeMap != MAP_FAILED)
+            munmap(sqeMap, sqeMapSize);
+
+        if(cqMap != MAP_FAILED && cqMap != sqMap)
+            munmap(cqMap, cqMapSize);
+
+        if(sqMap != MAP_FAILED)
+            munmap(sqMap, sqMapSize);
+
+        if(fd >= 0)
+            close(fd);
+    }
+#endif
+};
+
+/***************************************************************************************************
+ * Read Remaining
+ *
+ * Purpose: Read the rest of a file with blocking reads
+ * Preconditions: bytes is sized to the file. The first done bytes are already read.
+ * Postconditions: Returns false on a read error. If the file turned out shorter, bytes is trimmed.
+ **************************************************************************************************/
+static bool readRemaining(int file, vector<uchar>& bytes, size_t done)
+{
+    while(done < bytes.size())
+    {
+        ssize_t count = pread(file, bytes.data() + done, bytes.size() - done, (off_t)done);
+
+        if(count < 0 && errno == EINTR)
+            continue;
+
+        if(count < 0)
+            return false;
+
+        if(count == 0)
+        {
+            bytes.resize(done);
+            break;
+        }
+
+        done += (size_t)count;
+    }
+
+    return !bytes.empty();
+}
+
+/***************************************************************************************************
+ * Open File
+ *
+ * Purpose: Open a file for reading and size a buffer for it
+ * Preconditions: None
+ * Postconditions: Returns the descriptor, or -1 if the file cannot be opened or is empty
+ **************************************************************************************************/
+static int openFile(const string& path, vector<uchar>& bytes)
+{
+    int file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if(file < 0)
+        return -1;
+
+    struct stat info;
+
+    if(fstat(file, &info) != 0 || info.st_size <= 0)
+    {
+        close(file);
+        return -1;
+    }
+
+    bytes.resize((size_t)info.st_size);
+
+    return file;
+}
+
+AsyncImageLoader::AsyncImageLoader(const vector<string>& paths,
+                                   int flags,
+                                   int readsInFlight,
+                                   int decodeThreads,
+                                   bool keepBytes)
+    : paths(paths),
+      flags(flags),
+      readsInFlight(max(1, readsInFlight)),
+      keepBytes(keepBytes),
+      outstanding(0),
+      returned(0),
+      readingDone(false),
+      stopping(false)
+{
+#ifdef MACHINEVISION_HAVE_IO_URING
+    uring.reset(new ring());
+
+    if(!uring->open((unsigned)this->readsInFlight))
+        uring.reset();
+#endif
+
+    reader = thread([this]()
+    {
+        if(uring)
+            readWithIoUring();
+        else
+            readBlocking();
+
+        lock_guard<mutex> guard(lock);
+        readingDone = true;
+        readable.notify_all();
+    });
+
+    int threads = decodeThreads > 0 ? decodeThreads : getNumberOfCPUs();
+
+    for(int t = 0; t < threads; t++)
+        decoders.emplace_back(&AsyncImageLoader::decodeLoop, this);
+}
+
+AsyncImageLoader::~AsyncImageLoader()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+
+    readable.notify_all();
+    finished.notify_all();
+    roomToRead.notify_all();
+
+    reader.join();
+
+    for(thread& decoder : decoders)
+        decoder.join();
+}
+
+bool AsyncImageLoader::readFile(const string& path, vector<uchar>& bytes)
+{
+    int descriptor = openFile(path, bytes);
+
+    if(descriptor < 0)
+    {
+        bytes.clear();
+        return false;
+    }
+
+    bool ok = readRemaining(descriptor, bytes, 0);
+    close(descriptor);
+
+    return ok;
+}
+
+bool AsyncImageLoader::usingIoUring() const
+{
+    return uring != nullptr;
+}
+
+size_t AsyncImageLoader::capacity() const
+{
+    return 2 * (size_t)readsInFlight;
+}
+
+bool AsyncImageLoader::reserve(bool wait)
+{
+    unique_lock<mutex> guard(lock);
+
+    if(wait)
+        roomToRead.wait(guard, [this]() { return stopping || outstanding < capacity(); });
+
+    if(stopping || outstanding >= capacity())
+        return false;
+
+    outstanding++;
+    return true;
+}
+
+void AsyncImageLoader::queueRead(encodedFile file)
+{
+    lock_guard<mutex> guard(lock);
+    toDecode.push_back(move(file));
+    readable.notify_one();
+}
+
+// Purpose: Read every file with blocking reads
+// Preconditions: Called on the reader thread
+// Postconditions: Every file has been queued for decoding, unless the loader is stopping
+void AsyncImageLoader::readBlocking()
+{
+    for(size_t index = 0; index < paths.size(); index++)
+    {
+        if(!reserve(true))
+            return;
+
+        encodedFile file = {(int)index, vector<uchar>(), false};
+        file.ok = readFile(paths[index], file.bytes);
+
+        queueRead(move(file));
+    }
+}
+
+// Purpose: Read every file through io_uring, keeping up to readsInFlight reads queued
+// Preconditions: Called on the reader thread. The ring is open.
+// Postconditions: Every file has been queued for decoding, unless the loader is stopping. No read
+//                 is left in flight.
+void AsyncImageLoader::readWithIoUring()
+{
+#ifdef MACHINEVISION_HAVE_IO_URING
+    // A file being read. The iovec must stay put while its read is in the ring.
+    struct pendingRead
+    {
+        int index;
+        int descriptor;
+        vector<uchar> bytes;
+        size_t done;
+        iovec iov;
+    };
+
+    vector<pendingRead> slots(readsInFlight);
+    vector<int> freeSlots;
+
+    for(int s = readsInFlight - 1; s >= 0; s--)
+        freeSlots.push_back(s);
+
+    size_t nextPath = 0;
+    int inFlight = 0;
+    unsigned toSubmit = 0;
+    bool ringFailed = false;
+
+    //Set once io_uring_enter() fails: no new reads are started and the busy slots are cancelled
+    bool draining = false;
+    vector<bool> cancelled(readsInFlight, false);
+
+    //User data of cancellations, which no slot uses
+    const unsigned long long CANCEL_REQUEST = ~0ull;
+
+    auto busy = [&](int s)
+    {
+        return find(freeSlots.begin(), freeSlots.end(), s) == freeSlots.end();
+    };
+
+    auto submit = [&](int s)
+    {
+        pendingRead& read = slots[s];
+        read.iov.iov_base = read.bytes.data() + read.done;
+        read.iov.iov_len = read.bytes.size() - read.done;
+
+        uring->queueReadv(read.descriptor, &read.iov, (off_t)read.done, (unsigned long long)s);
+        toSubmit++;
+    };
+
+    auto complete = [&](int s, bool ok)
+    {
+        pendingRead& read = slots[s];
+        close(read.descriptor);
+
+        queueRead({read.index, move(read.bytes), ok});
+
+        freeSlots.push_back(s);
+        inFlight--;
+    };
+
+    while(true)
+    {
+        //Start new files while there are free slots, blocking for room only when nothing is in
+        //flight
+        while(!draining && !freeSlots.empty() && nextPath < paths.size())
+        {
+            if(!reserve(inFlight == 0))
+                break;
+
+            int index = (int)nextPath++;
+            vector<uchar> bytes;
+            int descriptor = openFile(paths[index], bytes);
+
+            if(descriptor < 0)
+            {
+                queueRead({index, vector<uchar>(), false});
+                continue;
+            }
+
+            int s = freeSlots.back();
+            freeSlots.pop_back();
+
+            slots[s].index = index;
+            slots[s].descriptor = descriptor;
+            slots[s].bytes = move(bytes);
+            slots[s].done = 0;
+
+            inFlight++;
+            submit(s);
+        }
+
+        if(inFlight == 0)
+            break;
+
+        for(int s = 0; draining && s < readsInFlight && uring->hasRoom(); s++)
+        {
+            if(busy(s) && !cancelled[s])
+            {
+                uring->queueCancel((unsigned long long)s, CANCEL_REQUEST);
+                cancelled[s] = true;
+                toSubmit++;
+            }
+        }
+
+        int submitted = uring->enter(toSubmit, 1);
+
+        if(submitted < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            if(!draining)
+            {
+                //Reads already in the ring may still land in their buffers, so they are cancelled
+                //and waited for before the rest of their files are read without the ring
+                draining = true;
+                ringFailed = true;
+                continue;
+            }
+
+            //The ring cannot even be drained. The kernel may still write into the busy slots, so
+            //their buffers and descriptors are left to it and those files are read again.
+            for(int s = 0; s < readsInFlight; s++)
+            {
+                if(busy(s))
+                {
+                    encodedFile file = {slots[s].index, vector<uchar>(), false};
+                    file.ok = readFile(paths[slots[s].index], file.bytes);
+
+                    queueRead(move(file));
+                }
+            }
+
+            new vector<pendingRead>(move(slots));
+            break;
+        }
+
+        //A full completion queue (EBUSY) is emptied by reaping, so transient failures reap too
+        toSubmit -= (unsigned)max(submitted, 0);
+
+        uring->reap([&](unsigned long long userData, int result)
+        {
+            if(userData == CANCEL_REQUEST)
+                return;
+
+            int s = (int)userData;
+            pendingRead& read = slots[s];
+
+            if(result > 0)
+                read.done += (size_t)result;
+
+            if(draining)
+                complete(s, readRemaining(read.descriptor, read.bytes, read.done));
+            else if(result == -EINTR || result == -EAGAIN)
+                submit(s);
+            else if(result <= 0)
+                complete(s, readRemaining(read.descriptor, read.bytes, read.done));
+            else if(read.done < read.bytes.size())
+                submit(s);
+            else
+                complete(s, true);
+        });
+    }
+
+    if(!ringFailed)
+        return;
+
+    //Blocking fallback for whatever the ring did not get to
+    for(; nextPath < paths.size(); nextPath++)
+    {
+        if(!reserve(true))
+            return;
+
+        encodedFile file = {(int)nextPath, vector<uchar>(), false};
+        file.ok = readFile(paths[nextPath], file.bytes);
+
+        queueRead(move(file));
+    }
+#endif
+}
+
+// Purpose: Decode read files until reading has finished and the queue is empty
+// Preconditions: Called on a decode thread
+// Postconditions: Every file taken from toDecode has been queued for next()
+void AsyncImageLoader::decodeLoop()
+{
+    while(true)
+    {
+        encodedFile file;
+
+        {
+            unique_lock<mutex> guard(lock);
+            readable.wait(guard, [this]() { return stopping || readingDone || !toDecode.empty(); });
+
+            if(stopping || toDecode.empty())
+                return;
+
+            file = move(toDecode.front());
+            toDecode.pop_front();
+        }
+
+        Mat image;
+
+        if(file.ok)
+            image = imdecode(Mat(file.bytes), flags);
+
+        if(!keepBytes)
+            file.bytes = vector<uchar>();
+
+        lock_guard<mutex> guard(lock);
+        decoded.push_back({file.index, paths[file.index], image, move(file.bytes)});
+        finished.notify_one();
+    }
+}
+
+bool AsyncImageLoader::next(loadedImage& loaded)
+{
+    unique_lock<mutex> guard(lock);
+
+    finished.wait(guard, [this]()
+    {
+        return stopping || !decoded.empty() || returned == paths.size();
+    });
+
+    if(decoded.empty())
+        return false;
+
+    loaded = move(decoded.front());
+    decoded.pop_front();
+
+    returned++;
+    outstanding--;
+    roomToRead.notify_one();
+
+    return true;
+}
+
+vector<AsyncImageLoader::loadedImage> AsyncImageLoader::loadAll(const vector<string>& paths,
+                                                                int flags,
+                                                                bool keepBytes)
+{
+    vector<loadedImage> images(paths.size());
+
+    AsyncImageLoader loader(paths, flags, 32, 0, keepBytes);
+    loadedImage loaded;
+
+    while(loader.next(loaded))
+        images[loaded.index] = move(loaded);
+
+    return images;
+}
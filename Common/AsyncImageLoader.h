@@ -0,0 +1,169 @@
+/*******************************************************************************
+ * Async Image Loader Signatures
+ *
+ * @author Matthew Munson
+ * @date 5/4/2021
+ *
+ * Loads a list of image files in the background. Plain imread() blocks on
+ * each file read in turn, so a run over thousands of files spends much of its
+ * time waiting on storage. The loader instead keeps many reads in
+ * flight at once and decodes the bytes with imdecode() on a pool of decode
+ * threads as they arrive. The caller takes finished images off a queue with
+ * next() while the rest are still being read and decoded.
+ *
+ * On Linux the reads are submitted through io_uring: one reader thread queues
+ * up to readsInFlight reads and collects completions, without a thread per
+ * outstanding read. Where io_uring is unavailable (not compiled in, an old
+ * kernel, or a sandbox that forbids it) the reader thread falls back to
+ * ordinary blocking reads, which still overlap with decoding.
+ *
+ * Images come back in the order they finish, not the order of the list; each
+ * result carries its index in the list.
+ *
+ * The regression harness loads its inputs through loadAll(). Batch and server
+ * jobs only use readFile(): each job reads one or two files whose paths are
+ * known only when the job starts, and the reads of different jobs already
+ * overlap across worker processes and connection threads.
+ *
+ * Header file documentation is user-focused. For implementation-level comments
+ * see AsyncImageLoader.cpp
+ *
+ ******************************************************************************/
+
+#ifndef MACHINEVISION_ASYNCIMAGELOADER_H
+#define MACHINEVISION_ASYNCIMAGELOADER_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace cv;
+
+class AsyncImageLoader {
+
+public:
+
+    // One finished file
+    struct loadedImage
+    {
+        int index;              // Position of the file in the list given to the constructor
+        std::string path;
+        Mat image;              // Empty if the file could not be read or decoded, as for imread()
+        std::vector<uchar> bytes;   // The encoded file, if the loader was asked to keep it
+    };
+
+    /***********************************************************************************************
+     * Constructor
+     *
+     * Starts loading immediately.
+     *
+     * @param paths : The files to load
+     * @param flags : imread() flags passed to imdecode()
+     * @param readsInFlight : How many file reads to keep queued at once
+     * @param decodeThreads : Decode threads. Zero uses one per CPU.
+     * @param keepBytes : Also return each file's encoded bytes, for callers that decode it again
+     *                    (for example at a reduced size)
+     **********************************************************************************************/
+    explicit AsyncImageLoader(const std::vector<std::string>& paths,
+                              int flags = IMREAD_COLOR,
+                              int readsInFlight = 32,
+                              int decodeThreads = 0,
+                              bool keepBytes = false);
+
+    // Stops loading. Files not yet taken with next() are discarded.
+    ~AsyncImageLoader();
+
+    AsyncImageLoader(const AsyncImageLoader&) = delete;
+    AsyncImageLoader& operator=(const AsyncImageLoader&) = delete;
+
+    /***********************************************************************************************
+     * Next
+     *
+     * Waits for the next finished file.
+     *
+     * @param loaded : Receives the file
+     * @return False once every file has been returned
+     **********************************************************************************************/
+    bool next(loadedImage& loaded);
+
+    /***********************************************************************************************
+     * Load All
+     *
+     * Convenience for small batches: loads every file and returns them in list order.
+     *
+     * @param keepBytes : As for the constructor
+     **********************************************************************************************/
+    static std::vector<loadedImage> loadAll(const std::vector<std::string>& paths,
+                                            int flags = IMREAD_COLOR,
+                                            bool keepBytes = false);
+
+    /***********************************************************************************************
+     * Read File
+     *
+     * Reads a whole file into memory with blocking reads, for single files that are decoded more
+     * than once.
+     *
+     * @return False if the file could not be read or is empty
+     **********************************************************************************************/
+    static bool readFile(const std::string& path, std::vector<uchar>& bytes);
+
+    // Whether reads are going through io_uring rather than the blocking fallback
+    bool usingIoUring() const;
+
+private:
+
+    // A file whose bytes have been read but not yet decoded
+    struct encodedFile
+    {
+        int index;
+        std::vector<uchar> bytes;
+        bool ok;
+    };
+
+    // io_uring state, defined in AsyncImageLoader.cpp
+    struct ring;
+
+    std::vector<std::string> paths;
+    int flags;
+    int readsInFlight;
+    bool keepBytes;
+
+    std::unique_ptr<ring> uring;
+
+    std::mutex lock;
+    std::condition_variable readable;     // Signalled when a read file is queued or reading ends
+    std::condition_variable finished;     // Signalled when a decoded file is queued
+    std::condition_variable roomToRead;   // Signalled when next() frees room for another file
+
+    std::deque<encodedFile> toDecode;
+    std::deque<loadedImage> decoded;
+
+    size_t outstanding;   // Files started by the reader and not yet returned by next()
+    size_t returned;      // Files returned by next()
+    bool readingDone;
+    bool stopping;
+
+    std::thread reader;
+    std::vector<std::thread> decoders;
+
+    // Files in memory at once, read or decoded but not yet returned
+    size_t capacity() const;
+
+    void readWithIoUring();
+    void readBlocking();
+    void decodeLoop();
+
+    // Counts another file as started if there is room, waiting for room if asked to. False if there
+    // is no room or the loader is stopping.
+    bool reserve(bool wait);
+
+    void queueRead(encodedFile file);
+};
+
+
+#endif //MACHINEVISION_ASYNCIMAGELOADER_H
@@ -0,0 +1,514 @@
+/*******************************************************************************
+ * Batch Runner Implementation
+ *
+ * @author Matthew Munson
+ * @date 5/6/2021
+ *
+ * Protocol, one line per message over each socket pair:
+ *
+ *     coordinator -> worker :  <job id> TAB <job line>
+ *     worker -> coordinator :  <job id> TAB ok|failed TAB <milliseconds> TAB <detail>
+ *
+ * A worker holds at most one job at a time, so the coordinator always knows
+ * which job to requeue when a socket reaches end of file early. Closing a
+ * worker's socket tells it there is no more work.
+ *
+ * The coordinator is single threaded and blocks in poll() on all worker
+ * sockets, so it never has threads of its own when it forks a replacement.
+ * Metrics scrapes are polled alongside them on non-blocking sockets, so a
+ * slow scraper never delays a worker's next job.
+ *
+ ******************************************************************************/
+
+#include "BatchRunner.h"
+#include "LineProtocol.h"
+#include "Metrics.h"
+#include "TaskScheduler.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace cv;
+
+// How often the metrics file is rewritten during a run
+static const int METRICS_INTERVAL_MS = 1000;
+
+static const char JOBS_HELP[] = "Batch jobs finished, by outcome";
+
+static Metrics::counter& jobsOk =
+    Metrics::addCounter("machinevision_batch_jobs_total", JOBS_HELP, "status=\"ok\"");
+static Metrics::counter& jobsFailed =
+    Metrics::addCounter("machinevision_batch_jobs_total", JOBS_HELP, "status=\"failed\"");
+static Metrics::counter& jobsCrashed =
+    Metrics::addCounter("machinevision_batch_jobs_total", JOBS_HELP, "status=\"crashed\"");
+static Metrics::gauge& queueDepth =
+    Metrics::addGauge("machinevision_batch_queue_depth", "Batch jobs waiting for a worker");
+static Metrics::gauge& jobsRunning =
+    Metrics::addGauge("machinevision_batch_jobs_running", "Batch jobs currently on a worker");
+static Metrics::histogram& jobSeconds =
+    Metrics::addHistogram("machinevision_batch_job_seconds",
+                          "Time each batch job took on its worker, in seconds");
+static Metrics::counter& workerRestarts =
+    Metrics::addCounter("machinevision_batch_worker_restarts_total",
+                        "Workers forked to replace one that died");
+
+// Purpose: Name the trace part a worker writes for the coordinator to merge
+// Preconditions: None
+// Postconditions: None
+static string tracePart(const string& tracePath, pid_t pid)
+{
+    return tracePath + ".part." + to_string(pid);
+}
+
+BatchRunner::jobResult BatchRunner::runJob(const jobFunction& execute,
+                                           const string& job,
+                                           double& milliseconds)
+{
+    Trace::span trace("job", job);
+
+    auto start = chrono::steady_clock::now();
+    jobResult result;
+
+    try
+    {
+        result = execute(job);
+    }
+    catch(const exception& error)
+    {
+        result = {false, error.what()};
+    }
+
+    milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    return result;
+}
+
+void BatchRunner::workerMain(int socket,
+                             const jobFunction& execute,
+                             int threads,
+                             int slot,
+                             const options& settings)
+{
+    //Keep this process's share of the machine, instead of one OpenCV thread per CPU in every worker
+    setNumThreads(threads);
+
+    //Started after the fork, since threads do not survive one. A replacement worker takes over
+    //its slot's CPUs.
+    unique_ptr<TaskScheduler> scheduler;
+
+    if(settings.scheduler)
+    {
+        TaskScheduler::options schedulerSettings;
+        schedulerSettings.threads = threads;
+        schedulerSettings.pin = settings.pin;
+        schedulerSettings.firstCpu = slot * threads;
+
+        scheduler.reset(new TaskScheduler(schedulerSettings));
+        TaskScheduler::install(scheduler.get());
+    }
+
+    Trace::nameThread("batch worker " + to_string(slot));
+
+    string buffer;
+    string message;
+
+    //End of file means the coordinator closed the socket: no more work
+    while(readLine(socket, buffer, message))
+    {
+        string id = nextField(message);
+
+        double milliseconds = 0;
+        jobResult result = runJob(execute, message, milliseconds);
+
+        string reply = id + "\t" + (result.ok ? "ok" : "failed") + "\t" +
+                       to_string(milliseconds) + "\t" + oneLine(result.detail) + "\n";
+
+        if(!writeAll(socket, reply))
+            break;
+    }
+
+    //The coordinator merges the parts once every worker has exited
+    if(!settings.tracePath.empty())
+        Trace::writePart(tracePart(settings.tracePath, getpid()));
+}
+
+// The coordinator's view of one worker slot
+struct workerSlot
+{
+    pid_t pid = -1;
+    int socket = -1;      // -1 once the worker has been told to stop or has died
+    int shard = 0;        // The shard this slot serves first
+    int job = -1;         // The job the worker is running, or -1
+    string buffer;        // Unparsed reply bytes
+};
+
+// One row of the manifest
+struct manifestRow
+{
+    string status = "pending";
+    double milliseconds = 0;
+    pid_t worker = 0;
+    int attempts = 0;
+    string detail;
+};
+
+int BatchRunner::run(const vector<string>& jobs,
+                     const jobFunction& execute,
+                     const string& manifestPath,
+                     const options& settings)
+{
+    int cpus = max(1, getNumberOfCPUs());
+    int workerCount = settings.workers > 0 ? settings.workers : max(1, cpus / 4);
+    workerCount = max(1, min(workerCount, (int)jobs.size()));
+
+    int threads = settings.threadsPerWorker > 0 ? settings.threadsPerWorker
+                                                : max(1, cpus / workerCount);
+
+    //A worker dying between our poll and our write must not kill the coordinator
+    signal(SIGPIPE, SIG_IGN);
+
+    //Contiguous shards, so neighbouring jobs (often similar in cost) stay with one worker
+    vector<deque<int>> shards(workerCount);
+
+    for(int id = 0; id < (int)jobs.size(); id++)
+        shards[(long)id * workerCount / jobs.size()].push_back(id);
+
+    queueDepth.set((int64_t)jobs.size());
+
+    //Opened before the first fork. Workers close their copy of the socket.
+    unique_ptr<MetricsEndpoint> endpoint;
+
+    if(settings.metricsPort > 0)
+    {
+        endpoint.reset(new MetricsEndpoint(settings.metricsPort));
+
+        if(!endpoint->listening())
+        {
+            cerr << "cannot serve metrics on port " << settings.metricsPort << endl;
+            endpoint.reset();
+        }
+    }
+
+    auto lastMetricsWrite = chrono::steady_clock::now();
+
+    //Enabled before the first fork so every worker records. Each worker, replacements included,
+    //writes a part named after its pid.
+    vector<string> traceParts;
+
+    if(!settings.tracePath.empty())
+        Trace::enable();
+
+    vector<manifestRow> rows(jobs.size());
+    vector<workerSlot> slots(workerCount);
+    size_t finished = 0;
+
+    // Takes the next job for a slot: its own shard first, then the back of the fullest shard
+    auto takeJob = [&](int shard)
+    {
+        if(shards[shard].empty())
+        {
+            for(int s = 0; s < workerCount; s++)
+            {
+                if(shards[s].size() > shards[shard].size())
+                    shard = s;
+            }
+
+            if(shards[shard].empty())
+                return -1;
+
+            int id = shards[shard].back();
+            shards[shard].pop_back();
+            queueDepth.add(-1);
+            return id;
+        }
+
+        int id = shards[shard].front();
+        shards[shard].pop_front();
+        queueDepth.add(-1);
+        return id;
+    };
+
+    auto jobsLeft = [&]()
+    {
+        for(const deque<int>& shard : shards)
+        {
+            if(!shard.empty())
+                return true;
+        }
+
+        return false;
+    };
+
+    auto spawn = [&](workerSlot& slot)
+    {
+        int pair[2];
+
+        if(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0)
+            return false;
+
+        pid_t pid = fork();
+
+        if(pid < 0)
+        {
+            close(pair[0]);
+            close(pair[1]);
+            return false;
+        }
+
+        if(pid == 0)
+        {
+            //Worker: drop the coordinator's ends of every socket, including other workers'
+            close(pair[0]);
+
+            for(const workerSlot& other : slots)
+            {
+                if(other.socket >= 0)
+                    close(other.socket);
+            }
+
+            if(endpoint)
+                endpoint->release();
+
+            workerMain(pair[1], execute, threads, (int)(&slot - slots.data()), settings);
+            _exit(0);
+        }
+
+        close(pair[1]);
+
+        if(!settings.tracePath.empty())
+            traceParts.push_back(tracePart(settings.tracePath, pid));
+
+        slot.pid = pid;
+        slot.socket = pair[0];
+        slot.job = -1;
+        slot.buffer.clear();
+
+        return true;
+    };
+
+    // Sends a slot its next job, or closes its socket if there is none
+    auto assign = [&](workerSlot& slot)
+    {
+        int id = takeJob(slot.shard);
+
+        if(id < 0)
+        {
+            close(slot.socket);
+            slot.socket = -1;
+            return;
+        }
+
+        slot.job = id;
+        rows[id].attempts++;
+        jobsRunning.add(1);
+
+        //A failed write shows up as end of file on the next poll, and the job is requeued there
+        writeAll(slot.socket, to_string(id) + "\t" + jobs[id] + "\n");
+    };
+
+    for(int w = 0; w < workerCount; w++)
+    {
+        slots[w].shard = w;
+
+        if(spawn(slots[w]))
+            assign(slots[w]);
+    }
+
+    while(finished < jobs.size())
+    {
+        vector<pollfd> polls;
+        vector<int> polled;
+
+        for(int w = 0; w < workerCount; w++)
+        {
+            if(slots[w].socket >= 0)
+            {
+                polls.push_back({slots[w].socket, POLLIN, 0});
+                polled.push_back(w);
+            }
+        }
+
+        if(polls.empty())
+        {
+            queueDepth.set(0);
+
+            //No worker could be started: give up on whatever is left
+            for(manifestRow& row : rows)
+            {
+                if(row.status == "pending")
+                {
+                    row.status = "failed";
+                    row.detail = "no worker could be started";
+                    finished++;
+                }
+            }
+
+            break;
+        }
+
+        //The endpoint's sockets go last
+        size_t workerPolls = polls.size();
+
+        if(endpoint)
+            endpoint->addPolls(polls);
+
+        if(!settings.metricsPath.empty() &&
+           chrono::steady_clock::now() - lastMetricsWrite >=
+           chrono::milliseconds(METRICS_INTERVAL_MS))
+        {
+            Metrics::writeFile(settings.metricsPath);
+            lastMetricsWrite = chrono::steady_clock::now();
+        }
+
+        int timeout = settings.metricsPath.empty() ? -1 : METRICS_INTERVAL_MS;
+        int scrapeTimeout = endpoint ? endpoint->pollTimeout() : -1;
+
+        //Wake for whichever comes first, where -1 means never
+        if(scrapeTimeout >= 0 && (timeout < 0 || scrapeTimeout < timeout))
+            timeout = scrapeTimeout;
+
+        if(poll(polls.data(), polls.size(), timeout) < 0)
+        {
+            if(errno == EINTR)
+                continue;
+
+            CV_Error(Error::StsError, "poll failed in BatchRunner");
+        }
+
+        //Answers scrapes whose request is complete or overdue, and accepts new ones
+        if(endpoint)
+            endpoint->handlePolls(&polls[workerPolls]);
+
+        for(size_t p = 0; p < workerPolls; p++)
+        {
+            if(polls[p].revents == 0)
+                continue;
+
+            workerSlot& slot = slots[polled[p]];
+
+            char chunk[4096];
+            ssize_t count = read(slot.socket, chunk, sizeof(chunk));
+
+            if(count < 0 && errno == EINTR)
+                continue;
+
+            if(count > 0)
+            {
+                slot.buffer.append(chunk, (size_t)count);
+
+                size_t newline;
+
+                while(slot.socket >= 0 && (newline = slot.buffer.find('\n')) != string::npos)
+                {
+                    string message = slot.buffer.substr(0, newline);
+                    slot.buffer.erase(0, newline + 1);
+
+                    int id = atoi(nextField(message).c_str());
+                    manifestRow& row = rows[id];
+
+                    row.status = nextField(message);
+                    row.milliseconds = atof(nextField(message).c_str());
+                    row.detail = message;
+                    row.worker = slot.pid;
+
+                    (row.status == "ok" ? jobsOk : jobsFailed).add();
+                    jobSeconds.observe(row.milliseconds / 1000);
+                    jobsRunning.add(-1);
+
+                    finished++;
+                    slot.job = -1;
+
+                    assign(slot);
+                }
+
+                continue;
+            }
+
+            //End of file with a job outstanding: the worker died
+            int status = 0;
+            waitpid(slot.pid, &status, 0);
+
+            close(slot.socket);
+            slot.socket = -1;
+
+            if(slot.job >= 0)
+            {
+                manifestRow& row = rows[slot.job];
+                jobsRunning.add(-1);
+
+                if(row.attempts >= settings.maxAttempts)
+                {
+                    jobsCrashed.add();
+
+                    row.status = "crashed";
+                    row.worker = slot.pid;
+                    row.detail = WIFSIGNALED(status)
+                                 ? "worker killed by signal " + to_string(WTERMSIG(status))
+                                 : "worker exited with status " + to_string(WEXITSTATUS(status));
+                    finished++;
+                }
+                else
+                {
+                    shards[slot.shard].push_front(slot.job);
+                    queueDepth.add(1);
+                }
+
+                slot.job = -1;
+            }
+
+            if(jobsLeft() && spawn(slot))
+            {
+                workerRestarts.add();
+                assign(slot);
+            }
+        }
+    }
+
+    //Every socket is closed by now, so the workers are exiting
+    for(workerSlot& slot : slots)
+    {
+        if(slot.socket >= 0)
+            close(slot.socket);
+
+        if(slot.pid > 0)
+            waitpid(slot.pid, nullptr, 0);
+    }
+
+    if(!settings.metricsPath.empty())
+        Metrics::writeFile(settings.metricsPath);
+
+    if(!settings.tracePath.empty() && !Trace::writeFile(settings.tracePath, traceParts))
+        cerr << "cannot write trace " << settings.tracePath << endl;
+
+    ofstream manifest(manifestPath);
+    manifest << "id\tstatus\tmilliseconds\tworker\tattempts\tjob\tdetail\n";
+
+    int failures = 0;
+
+    for(size_t id = 0; id < jobs.size(); id++)
+    {
+        const manifestRow& row = rows[id];
+
+        manifest << id << "\t" << row.status << "\t" << row.milliseconds << "\t" << row.worker
+                 << "\t" << row.attempts << "\t" << oneLine(jobs[id]) << "\t" << row.detail << "\n";
+
+        failures += row.status != "ok";
+    }
+
+    return failures;
+}
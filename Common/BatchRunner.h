@@ -0,0 +1,120 @@
+/*******************************************************************************
+ * Batch Runner Signatures
+ *
+ * @author Matthew Munson
+ * @date 5/6/2021
+ *
+ * Runs a list of independent jobs across several worker processes on one
+ * machine. A single process cannot keep a large machine busy on image jobs:
+ * the codecs are single threaded, and OpenCV's thread pool and several decode
+ * threads end up competing for the same cores. Separate processes, each with
+ * a small OpenCV thread pool, scale much better.
+ *
+ * The coordinator (the calling process) forks the workers and talks to each
+ * over its own Unix socket pair. Jobs are first split into one contiguous
+ * shard per worker. A worker that finishes its job is sent the next one from
+ * its own shard, and once that is empty it steals from the back of whichever
+ * shard has the most jobs left, so slow shards do not hold up the batch.
+ *
+ * If a worker dies mid-job, its job goes back to the front of its shard and a
+ * replacement worker is forked to take over the shard. A job that kills
+ * maxAttempts workers is recorded as crashed and skipped.
+ *
+ * Every result comes back to the coordinator, which writes one manifest for
+ * the whole batch: a tab-separated file with a row per job, in job order.
+ *
+ * With the scheduler option each worker runs the project's kernels on its own
+ * TaskScheduler (see TaskScheduler.h). With pinning as well, worker slot k's
+ * threads are bound to the k-th block of CPUs in NUMA node order, so each
+ * worker process stays on one node where the machine allows.
+ *
+ * The coordinator exports metrics (see Metrics.h) covering the workers too:
+ * jobs finished by outcome, queue depth, jobs running, job latency and worker
+ * restarts, plus whatever the jobs record. The HTTP endpoint is served from
+ * the coordinator's poll loop, so it stays single threaded.
+ *
+ * With a trace path, tracing (see Trace.h) is enabled in every worker. Each
+ * worker writes its spans as it exits and the coordinator merges them into
+ * one Chrome trace, with one process per worker. Crashed workers' spans are
+ * lost.
+ *
+ * POSIX only (fork, socketpair, poll).
+ *
+ * Header file documentation is user-focused. For implementation-level comments
+ * see BatchRunner.cpp
+ *
+ ******************************************************************************/
+
+#ifndef MACHINEVISION_BATCHRUNNER_H
+#define MACHINEVISION_BATCHRUNNER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class BatchRunner {
+
+public:
+
+    // What a job reports back
+    struct jobResult
+    {
+        bool ok;
+        std::string detail;     // Free text for the manifest, for example an error or cache hits
+    };
+
+    // Runs one job, given its line from the job list. Called in the worker processes.
+    typedef std::function<jobResult(const std::string& job)> jobFunction;
+
+    struct options
+    {
+        int workers = 0;            // Worker processes. Zero uses one per four CPUs, at least one.
+        int threadsPerWorker = 0;   // OpenCV threads in each worker. Zero divides the CPUs evenly.
+        int maxAttempts = 2;        // Workers a job may crash before it is given up on
+        bool scheduler = false;     // Run the kernels on a TaskScheduler in each worker
+        bool pin = false;           // With scheduler, pin each worker's threads to its own CPUs
+        std::string metricsPath;    // If set, metrics are written here during and after the run
+        int metricsPort = 0;        // If set, metrics are served over HTTP on this local port
+        std::string tracePath;      // If set, the workers' spans are written here as one trace
+    };
+
+    /***********************************************************************************************
+     * Run
+     *
+     * Runs every job and writes the manifest. Must be called before the calling process starts
+     * any threads of its own (including OpenCV's), since it forks.
+     *
+     * @param jobs : One line per job, passed to execute as is
+     * @param execute : Runs a job
+     * @param manifestPath : Where to write the manifest
+     * @param settings : Worker counts and retry limit
+     * @return The number of jobs that failed or crashed
+     **********************************************************************************************/
+    static int run(const std::vector<std::string>& jobs,
+                   const jobFunction& execute,
+                   const std::string& manifestPath,
+                   const options& settings);
+
+    /***********************************************************************************************
+     * Run Job
+     *
+     * Runs one job in the calling process, turning an exception into a failed result.
+     *
+     * @param milliseconds : Receives how long the job took
+     **********************************************************************************************/
+    static jobResult runJob(const jobFunction& execute,
+                            const std::string& job,
+                            double& milliseconds);
+
+private:
+
+    // The loop run by each worker process until the coordinator closes its socket
+    static void workerMain(int socket,
+                           const jobFunction& execute,
+                           int threads,
+                           int slot,
+                           const options& settings);
+};
+
+
+#endif //MACHINEVISION_BATCHRUNNER_H
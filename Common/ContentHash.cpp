@@ -0,0 +1,137 @@
+/*******************************************************************************
+ * Content Hash Implementation
+ *
+ * @author Matthew Munson
+ * @date 5/5/2021
+ *
+ * XXH64 as specified by its reference implementation. Input is read with
+ * memcpy, which compiles to plain unaligned loads, and assumed little endian
+ * like every machine we run on.
+ *
+ ******************************************************************************/
+
+#include "ContentHash.h"
+
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+static const uint64_t PRIME1 = 11400714785074694791ULL;
+static const uint64_t PRIME2 = 14029467366897019727ULL;
+static const uint64_t PRIME3 = 1609587929392839161ULL;
+static const uint64_t PRIME4 = 9650029242287828579ULL;
+static const uint64_t PRIME5 = 2870177450012600261ULL;
+
+static inline uint64_t rotateLeft(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t read64(const unsigned char* p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t read32(const unsigned char* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// Mixes eight bytes of input into one lane
+static inline uint64_t round64(uint64_t lane, uint64_t input)
+{
+    lane += input * PRIME2;
+    lane = rotateLeft(lane, 31);
+    return lane * PRIME1;
+}
+
+// Folds a lane into the final hash
+static inline uint64_t mergeLane(uint64_t hash, uint64_t lane)
+{
+    hash ^= round64(0, lane);
+    return hash * PRIME1 + PRIME4;
+}
+
+uint64_t hashBytes(const void* data, size_t length, uint64_t seed)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    const unsigned char* end = p + length;
+
+    uint64_t hash;
+
+    if(length >= 32)
+    {
+        //Four independent lanes over 32 byte stripes
+        uint64_t lane1 = seed + PRIME1 + PRIME2;
+        uint64_t lane2 = seed + PRIME2;
+        uint64_t lane3 = seed;
+        uint64_t lane4 = seed - PRIME1;
+
+        const unsigned char* lastStripe = end - 32;
+
+        do
+        {
+            lane1 = round64(lane1, read64(p));
+            lane2 = round64(lane2, read64(p + 8));
+            lane3 = round64(lane3, read64(p + 16));
+            lane4 = round64(lane4, read64(p + 24));
+            p += 32;
+        }
+        while(p <= lastStripe);
+
+        hash = rotateLeft(lane1, 1) + rotateLeft(lane2, 7) +
+               rotateLeft(lane3, 12) + rotateLeft(lane4, 18);
+
+        hash = mergeLane(hash, lane1);
+        hash = mergeLane(hash, lane2);
+        hash = mergeLane(hash, lane3);
+        hash = mergeLane(hash, lane4);
+    }
+    else
+    {
+        hash = seed + PRIME5;
+    }
+
+    hash += (uint64_t)length;
+
+    //The tail: eight, then four, then single bytes
+    for(; p + 8 <= end; p += 8)
+    {
+        hash ^= round64(0, read64(p));
+        hash = rotateLeft(hash, 27) * PRIME1 + PRIME4;
+    }
+
+    if(p + 4 <= end)
+    {
+        hash ^= (uint64_t)read32(p) * PRIME1;
+        hash = rotateLeft(hash, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+
+    for(; p < end; p++)
+    {
+        hash ^= (*p) * PRIME5;
+        hash = rotateLeft(hash, 11) * PRIME1;
+    }
+
+    //Avalanche
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+string hashToHex(uint64_t hash)
+{
+    char text[17];
+    snprintf(text, sizeof(text), "%016llx", (unsigned long long)hash);
+    return string(text);
+}
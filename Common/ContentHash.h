@@ -0,0 +1,55 @@
+/*******************************************************************************
+ * Content Hash Signatures
+ *
+ * @author Matthew Munson
+ * @date 5/5/2021
+ *
+ * A fast, non-cryptographic 64-bit hash (XXH64) for naming cached results by
+ * the content they were computed from. It reads eight bytes per step across
+ * four independent lanes, so hashing an input file costs a small fraction of
+ * decoding it.
+ *
+ * Hashes are chained by passing the previous hash as the seed:
+ *
+ *     uint64_t key = hashBytes(foreground.data(), foreground.size());
+ *     key = hashValue(key, threshold);
+ *
+ ******************************************************************************/
+
+#ifndef MACHINEVISION_CONTENTHASH_H
+#define MACHINEVISION_CONTENTHASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/***************************************************************************************************
+ * Hash Bytes
+ *
+ * @param data : The bytes to hash
+ * @param length : How many bytes
+ * @param seed : Zero, or a previous hash to chain from
+ * @return The XXH64 hash of the bytes
+ **************************************************************************************************/
+uint64_t hashBytes(const void* data, size_t length, uint64_t seed = 0);
+
+/***************************************************************************************************
+ * Hash Value
+ *
+ * Chains a plain value (an int, a double, a small struct without padding) onto a hash.
+ **************************************************************************************************/
+template<class T>
+uint64_t hashValue(uint64_t seed, T value)
+{
+    return hashBytes(&value, sizeof(value), seed);
+}
+
+/***************************************************************************************************
+ * Hash To Hex
+ *
+ * @return The hash as 16 lowercase hex digits, for use in file names
+ **************************************************************************************************/
+std::string hashToHex(uint64_t hash);
+
+
+#endif //MACHINEVISION_CONTENTHASH_H
@@ -0,0 +1,231 @@
+/*******************************************************************************
+ * Job Server Implementation
+ *
+ * @author Matthew Munson
+ * @date 5/7/2021
+ *
+ * Connection threads are detached and remove their socket from the state as
+ * they finish, so a long-running server does not collect finished threads.
+ * Stopping shuts down the listening socket, which wakes accept(), and every
+ * client socket, which wakes the reads; serve() then waits for the connection
+ * set to empty before returning.
+ *
+ ******************************************************************************/
+
+#include "JobServer.h"
+#include "LineProtocol.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <opencv2/opencv.hpp>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+using namespace cv;
+
+static Metrics::counter& jobsOk =
+    Metrics::addCounter("machinevision_server_jobs_total", "Jobs the server finished",
+                        "status=\"ok\"");
+
+static Metrics::counter& jobsFailed =
+    Metrics::addCounter("machinevision_server_jobs_total", "Jobs the server finished",
+                        "status=\"failed\"");
+
+static Metrics::gauge& jobsRunning =
+    Metrics::addGauge("machinevision_server_jobs_running", "Jobs the server is running now");
+
+static Metrics::gauge& openConnections =
+    Metrics::addGauge("machinevision_server_connections", "Clients connected to the server");
+
+static Metrics::histogram& jobSeconds =
+    Metrics::addHistogram("machinevision_server_job_seconds", "Time to run one server job");
+
+// How long accept() waits for a connection to close after running out of descriptors or memory
+static const chrono::milliseconds ACCEPT_BACKOFF(100);
+
+// Purpose: Stop accepting and wake every blocked read
+// Preconditions: state.lock is held
+// Postconditions: serve() and every connection thread will return
+static void stopServer(int listener, const set<int>& connections)
+{
+    shutdown(listener, SHUT_RDWR);
+
+    for(int connection : connections)
+        shutdown(connection, SHUT_RDWR);
+}
+
+// Purpose: Remove the socket file of a server that has exited, so its path can be bound again
+// Preconditions: address is the Unix address of socketPath
+// Postconditions: Returns true if the path is free. Anything but a socket nobody answers on is
+//                 left alone: a running server keeps its socket, and other files are not deleted.
+static bool removeStaleSocket(const string& socketPath, const sockaddr_un& address)
+{
+    struct stat status;
+
+    if(lstat(socketPath.c_str(), &status) != 0)
+        return errno == ENOENT;
+
+    if(!S_ISSOCK(status.st_mode))
+    {
+        cerr << socketPath << " exists and is not a socket" << endl;
+        return false;
+    }
+
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if(probe < 0)
+        return false;
+
+    //Refused means nobody listens. A server with a full backlog answers EAGAIN, and is live.
+    bool refused = connect(probe, (const sockaddr*)&address, sizeof(address)) != 0 &&
+                   errno == ECONNREFUSED;
+    close(probe);
+
+    if(!refused)
+    {
+        cerr << "already serving on " << socketPath << endl;
+        return false;
+    }
+
+    return unlink(socketPath.c_str()) == 0;
+}
+
+bool JobServer::serve(const string& socketPath, const BatchRunner::jobFunction& execute)
+{
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if(socketPath.size() >= sizeof(address.sun_path))
+        return false;
+
+    strcpy(address.sun_path, socketPath.c_str());
+
+    //A client hanging up mid-reply must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    serverState state;
+    state.stopping = false;
+    state.listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if(state.listener < 0)
+        return false;
+
+    if(!removeStaleSocket(socketPath, address))
+    {
+        close(state.listener);
+        return false;
+    }
+
+    if(::bind(state.listener, (sockaddr*)&address, sizeof(address)) != 0 ||
+       listen(state.listener, SOMAXCONN) != 0)
+    {
+        close(state.listener);
+        return false;
+    }
+
+    //Start OpenCV's worker threads now rather than in the first client's job
+    parallel_for_(Range(0, getNumThreads()), [](const Range&) {});
+
+    while(true)
+    {
+        int connection = accept(state.listener, nullptr, nullptr);
+        int error = errno;
+
+        unique_lock<mutex> guard(state.lock);
+
+        if(state.stopping)
+        {
+            if(connection >= 0)
+                close(connection);
+
+            break;
+        }
+
+        if(connection < 0)
+        {
+            //Interrupted, or a client that gave up before being accepted, are retried at once.
+            //Anything else, such as running out of descriptors (EMFILE, ENFILE), would fail again
+            //straight away, so wait until a connection closes or the backoff passes.
+            if(error != EINTR && error != ECONNABORTED)
+                state.closed.wait_for(guard, ACCEPT_BACKOFF);
+
+            continue;
+        }
+
+        state.connections.insert(connection);
+        openConnections.add(1);
+
+        thread(connectionMain, connection, cref(execute), ref(state)).detach();
+    }
+
+    unique_lock<mutex> guard(state.lock);
+    state.closed.wait(guard, [&]() { return state.connections.empty(); });
+
+    close(state.listener);
+    unlink(socketPath.c_str());
+
+    return true;
+}
+
+void JobServer::connectionMain(int connection,
+                               const BatchRunner::jobFunction& execute,
+                               serverState& state)
+{
+    Trace::nameThread("connection " + to_string(connection));
+
+    string buffer;
+    string request;
+
+    while(readLine(connection, buffer, request))
+    {
+        string reply;
+
+        if(request == "ping")
+            reply = "ok\t0\tpong\n";
+        else if(request == "shutdown")
+            reply = "ok\t0\tshutting down\n";
+        else
+        {
+            double milliseconds = 0;
+
+            jobsRunning.add(1);
+            BatchRunner::jobResult result = BatchRunner::runJob(execute, request, milliseconds);
+            jobsRunning.add(-1);
+
+            (result.ok ? jobsOk : jobsFailed).add();
+            jobSeconds.observe(milliseconds / 1000);
+
+            reply = string(result.ok ? "ok" : "failed") + "\t" + to_string(milliseconds) + "\t" +
+                    oneLine(result.detail) + "\n";
+        }
+
+        if(!writeAll(connection, reply))
+            break;
+
+        if(request == "shutdown")
+        {
+            lock_guard<mutex> guard(state.lock);
+
+            state.stopping = true;
+            stopServer(state.listener, state.connections);
+            break;
+        }
+    }
+
+    lock_guard<mutex> guard(state.lock);
+
+    close(connection);
+    state.connections.erase(connection);
+    openConnections.add(-1);
+    state.closed.notify_all();
+}
@@ -0,0 +1,81 @@
+/*******************************************************************************
+ * Job Server Signatures
+ *
+ * @author Matthew Munson
+ * @date 5/7/2021
+ *
+ * Runs jobs for clients of a Unix domain socket, from one long-running
+ * process. Starting a process for every image pays for process start, OpenCV
+ * initialization, thread pool spin-up and first-touch allocation before any
+ * work is done; a resident server pays for them once, so a job costs only its
+ * compute time.
+ *
+ * The protocol is line based. A client sends one request per line and gets
+ * one reply line per request, in order:
+ *
+ *     <job line>  ->  ok|failed TAB <milliseconds> TAB <detail>
+ *     ping        ->  ok TAB 0 TAB pong
+ *     shutdown    ->  ok TAB 0 TAB shutting down, and the server stops
+ *
+ * Any number of clients may be connected. Each connection is served by its
+ * own thread, so jobs from different clients run concurrently and share
+ * OpenCV's thread pool; jobs on one connection run one after another.
+ *
+ * For example, with socat:
+ *
+ *     echo "key fg.jpg bg.jpg out.jpg" | socat - UNIX-CONNECT:/tmp/keying.sock
+ *
+ * The server records jobs finished, jobs running, connections and job latency
+ * in the metrics registry (see Metrics.h); exporting them is up to the caller.
+ *
+ * Header file documentation is user-focused. For implementation-level comments
+ * see JobServer.cpp
+ *
+ ******************************************************************************/
+
+#ifndef MACHINEVISION_JOBSERVER_H
+#define MACHINEVISION_JOBSERVER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include "BatchRunner.h"
+
+class JobServer {
+
+public:
+
+    /***********************************************************************************************
+     * Serve
+     *
+     * Listens on socketPath and runs jobs until a client sends shutdown. A socket file left by a
+     * server that has exited is replaced. If a server still answers on socketPath, or the path is
+     * not a socket, it is left alone, the reason is printed, and serve() fails. execute may be
+     * called from several threads at once.
+     *
+     * @return False if the socket could not be created
+     **********************************************************************************************/
+    static bool serve(const std::string& socketPath, const BatchRunner::jobFunction& execute);
+
+private:
+
+    // What the accept loop and the connection threads share
+    struct serverState
+    {
+        int listener;
+        bool stopping;
+        std::set<int> connections;          // Open client sockets
+        std::mutex lock;
+        std::condition_variable closed;     // Signalled when a connection thread finishes
+    };
+
+    // Serves one client until it disconnects or the server stops
+    static void connectionMain(int connection,
+                               const BatchRunner::jobFunction& execute,
+                               serverState& state);
+};
+
+
+#endif //MACHINEVISION_JOBSERVER_H
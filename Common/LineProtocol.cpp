@@ -0,0 +1,78 @@
+/*******************************************************************************
+ * Line Protocol Implementation
+ *
+ * @author Matthew Munson
+ * @date 5/7/2021
+ *
+ ******************************************************************************/
+
+#include "LineProtocol.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+
+using namespace std;
+
+bool writeAll(int socket, const string& text)
+{
+    size_t done = 0;
+
+    while(done < text.size())
+    {
+        ssize_t count = write(socket, text.data() + done, text.size() - done);
+
+        if(count < 0 && errno == EINTR)
+            continue;
+
+        if(count <= 0)
+            return false;
+
+        done += (size_t)count;
+    }
+
+    return true;
+}
+
+bool readLine(int socket, string& buffer, string& line)
+{
+    char chunk[4096];
+    size_t newline;
+
+    while((newline = buffer.find('\n')) == string::npos)
+    {
+        ssize_t count = read(socket, chunk, sizeof(chunk));
+
+        if(count < 0 && errno == EINTR)
+            continue;
+
+        if(count <= 0)
+            return false;
+
+        buffer.append(chunk, (size_t)count);
+    }
+
+    line = buffer.substr(0, newline);
+    buffer.erase(0, newline + 1);
+
+    return true;
+}
+
+string oneLine(string text)
+{
+    replace(text.begin(), text.end(), '\t', ' ');
+    replace(text.begin(), text.end(), '\n', ' ');
+    replace(text.begin(), text.end(), '\r', ' ');
+
+    return text;
+}
+
+string nextField(string& text)
+{
+    size_t tab = text.find('\t');
+    string field = text.substr(0, tab);
+
+    text = tab == string::npos ? string() : text.substr(tab + 1);
+
+    return field;
+}
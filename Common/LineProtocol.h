@@ -0,0 +1,52 @@
+/*******************************************************************************
+ * Line Protocol Signatures
+ *
+ * @author Matthew Munson
+ * @date 5/7/2021
+ *
+ * Helpers for the plain text protocols spoken over Unix sockets by the batch
+ * runner and the job server: one message per line, fields separated by tabs.
+ *
+ ******************************************************************************/
+
+#ifndef MACHINEVISION_LINEPROTOCOL_H
+#define MACHINEVISION_LINEPROTOCOL_H
+
+#include <string>
+
+/***************************************************************************************************
+ * Write All
+ *
+ * Writes all of text to a socket or file descriptor, retrying after interruptions and partial
+ * writes.
+ *
+ * @return False if the other end has gone
+ **************************************************************************************************/
+bool writeAll(int socket, const std::string& text);
+
+/***************************************************************************************************
+ * Read Line
+ *
+ * Reads the next line from a socket, without its newline. Bytes read past the line are kept in
+ * buffer for the next call, so the same buffer must be passed every time.
+ *
+ * @return False at end of file or on an error
+ **************************************************************************************************/
+bool readLine(int socket, std::string& buffer, std::string& line);
+
+/***************************************************************************************************
+ * One Line
+ *
+ * @return text with tabs and line breaks replaced by spaces, safe to use as a field
+ **************************************************************************************************/
+std::string oneLine(std::string text);
+
+/***************************************************************************************************
+ * Next Field
+ *
+ * @return The text before the first tab. text keeps what follows the tab, or becomes empty.
+ **************************************************************************************************/
+std::string nextField(std::string& text);
+
+
+#endif //MACHINEVISION_LINEPROTOCOL_H
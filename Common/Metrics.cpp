@@ -0,0 +1,600 @@
+/*******************************************************************************
+ * Metrics Implementation
+ *
+ * @author Matthew Munson
+ * @date 5/12/2021
+ *
+ * Metric values are 64-bit atomics handed out from one arena, mapped shared
+ * and anonymous on first use so that forked children update the same memory
+ * as their parent. The allocation cursor lives in the arena too, so a metric
+ * registered in a child never reuses a slot taken in another process. If the
+ * arena fills up, further slots come from the heap and are process-local.
+ *
+ * The names, labels and bounds of each metric are kept in an ordinary
+ * registry behind a mutex. Only registration and format() take it.
+ *
+ * A histogram's sum is a double stored as its bits and updated with a
+ * compare-and-swap loop. Its buckets are stored per bucket and made
+ * cumulative when formatted.
+ *
+ ******************************************************************************/
+
+#include "Metrics.h"
+#include "LineProtocol.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <fstream>
+#include <new>
+#include <netinet/in.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Values in the shared arena: enough for a few hundred histograms
+static const size_t ARENA_SLOTS = 8192;
+
+// How long a scrape may take to send its request before it is answered anyway
+static const int REQUEST_TIMEOUT_SECONDS = 1;
+
+// Longest scrape request read; the rest is ignored
+static const size_t MAX_REQUEST_BYTES = 8192;
+
+namespace
+{
+    struct arena
+    {
+        atomic<uint64_t> next;
+        atomic<uint64_t> slots[ARENA_SLOTS];
+    };
+
+    enum class metricType { counter, gauge, histogram };
+
+    struct series
+    {
+        string name;
+        string help;
+        string labels;
+        metricType type;
+
+        Metrics::counter counterMetric;
+        Metrics::gauge gaugeMetric;
+        Metrics::histogram histogramMetric;
+    };
+
+    struct registry
+    {
+        mutex lock;
+        arena* shared = nullptr;
+        deque<series> entries;      // A deque, so references stay valid
+    };
+}
+
+// Purpose: The process's registry, created on first use
+// Preconditions: None
+// Postconditions: The arena is mapped, or left null if mmap failed (every slot is then overflow)
+static registry& getRegistry()
+{
+    static registry* instance = []()
+    {
+        registry* created = new registry();
+
+        void* memory = mmap(nullptr, sizeof(arena), PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+        //Anonymous mappings are zeroed, which is a valid state for the atomics
+        if(memory != MAP_FAILED)
+            created->shared = new(memory) arena();
+
+        return created;
+    }();
+
+    return *instance;
+}
+
+// Purpose: Hand out zeroed value slots
+// Preconditions: state.lock is held
+// Postconditions: Returns count consecutive slots
+static atomic<uint64_t>* allocateSlots(registry& state, size_t count)
+{
+    if(state.shared)
+    {
+        uint64_t first = state.shared->next.fetch_add(count);
+
+        if(first + count <= ARENA_SLOTS)
+            return &state.shared->slots[first];
+    }
+
+    //Consecutive overflow slots must be contiguous, so allocate them as one array
+    atomic<uint64_t>* slots = new atomic<uint64_t>[count];
+
+    for(size_t k = 0; k < count; k++)
+        slots[k] = 0;
+
+    return slots;
+}
+
+// Purpose: Find a metric, or add it
+// Preconditions: state.lock is held
+// Postconditions: Returns the entry and whether it was just added
+static series& findOrAdd(registry& state,
+                         const string& name,
+                         const string& help,
+                         const string& labels,
+                         metricType type,
+                         bool& added)
+{
+    //Every series of a name shares its TYPE line, so the type is checked across labels too
+    for(series& entry : state.entries)
+    {
+        if(entry.name != name)
+            continue;
+
+        if(entry.type != type)
+            throw invalid_argument("metric " + name + " registered with two types");
+
+        if(entry.labels == labels)
+        {
+            added = false;
+            return entry;
+        }
+    }
+
+    state.entries.emplace_back();
+
+    series& entry = state.entries.back();
+    entry.name = name;
+    entry.help = help;
+    entry.labels = labels;
+    entry.type = type;
+
+    added = true;
+    return entry;
+}
+
+Metrics::counter& Metrics::addCounter(const string& name, const string& help, const string& labels)
+{
+    registry& state = getRegistry();
+    lock_guard<mutex> guard(state.lock);
+
+    bool added;
+    series& entry = findOrAdd(state, name, help, labels, metricType::counter, added);
+
+    if(added)
+        entry.counterMetric.slot = allocateSlots(state, 1);
+
+    return entry.counterMetric;
+}
+
+Metrics::gauge& Metrics::addGauge(const string& name, const string& help, const string& labels)
+{
+    registry& state = getRegistry();
+    lock_guard<mutex> guard(state.lock);
+
+    bool added;
+    series& entry = findOrAdd(state, name, help, labels, metricType::gauge, added);
+
+    if(added)
+        entry.gaugeMetric.slot = allocateSlots(state, 1);
+
+    return entry.gaugeMetric;
+}
+
+Metrics::histogram& Metrics::addHistogram(const string& name,
+                                          const string& help,
+                                          const string& labels,
+                                          const vector<double>& bounds)
+{
+    registry& state = getRegistry();
+    lock_guard<mutex> guard(state.lock);
+
+    bool added;
+    series& entry = findOrAdd(state, name, help, labels, metricType::histogram, added);
+
+    if(added)
+    {
+        //Buckets, the +Inf bucket, then the sum
+        atomic<uint64_t>* slots = allocateSlots(state, bounds.size() + 2);
+
+        entry.histogramMetric.bounds = bounds;
+        entry.histogramMetric.buckets = slots;
+        entry.histogramMetric.sum = slots + bounds.size() + 1;
+    }
+
+    return entry.histogramMetric;
+}
+
+vector<double> Metrics::latencyBounds()
+{
+    return {0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60};
+}
+
+void Metrics::histogram::observe(double value)
+{
+    //A dozen or so bounds: a linear scan is as fast as a binary search
+    size_t bucket = 0;
+
+    while(bucket < bounds.size() && value > bounds[bucket])
+        bucket++;
+
+    buckets[bucket].fetch_add(1, memory_order_relaxed);
+
+    uint64_t expected = sum->load(memory_order_relaxed);
+    uint64_t desired;
+
+    do
+    {
+        double total;
+        memcpy(&total, &expected, sizeof(total));
+        total += value;
+        memcpy(&desired, &total, sizeof(desired));
+    }
+    while(!sum->compare_exchange_weak(expected, desired, memory_order_relaxed));
+}
+
+void Metrics::timer::lap(histogram& stage)
+{
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+    stage.observe(chrono::duration<double>(now - start).count());
+    start = now;
+}
+
+// Purpose: Format a number the way Prometheus reads it
+// Preconditions: None
+// Postconditions: Returns the shortest text that reads back as the same double
+static string formatNumber(double value)
+{
+    char text[32];
+
+    for(int precision = 6; precision <= 17; precision++)
+    {
+        snprintf(text, sizeof(text), "%.*g", precision, value);
+
+        if(strtod(text, nullptr) == value)
+            break;
+    }
+
+    return text;
+}
+
+// Purpose: Join a series' labels with one more label
+// Preconditions: None
+// Postconditions: Returns the label set in braces, or nothing when there are no labels
+static string labelSet(const string& labels, const string& extra = "")
+{
+    string joined = labels;
+
+    if(!extra.empty())
+        joined += (joined.empty() ? "" : ",") + extra;
+
+    return joined.empty() ? "" : "{" + joined + "}";
+}
+
+string Metrics::format()
+{
+    registry& state = getRegistry();
+    lock_guard<mutex> guard(state.lock);
+
+    string text;
+    vector<bool> written(state.entries.size(), false);
+
+    //Every series of a name goes under one HELP and TYPE header, in registration order
+    for(size_t first = 0; first < state.entries.size(); first++)
+    {
+        if(written[first])
+            continue;
+
+        const series& family = state.entries[first];
+        const char* type = family.type == metricType::counter ? "counter"
+                         : family.type == metricType::gauge ? "gauge" : "histogram";
+
+        text += "# HELP " + family.name + " " + family.help + "\n";
+        text += "# TYPE " + family.name + " " + type + "\n";
+
+        for(size_t k = first; k < state.entries.size(); k++)
+        {
+            const series& entry = state.entries[k];
+
+            if(written[k] || entry.name != family.name)
+                continue;
+
+            written[k] = true;
+
+            if(entry.type == metricType::counter)
+            {
+                text += entry.name + labelSet(entry.labels) + " " +
+                        to_string(entry.counterMetric.value()) + "\n";
+            }
+            else if(entry.type == metricType::gauge)
+            {
+                text += entry.name + labelSet(entry.labels) + " " +
+                        to_string(entry.gaugeMetric.value()) + "\n";
+            }
+            else
+            {
+                const histogram& values = entry.histogramMetric;
+                uint64_t cumulative = 0;
+
+                for(size_t b = 0; b <= values.bounds.size(); b++)
+                {
+                    cumulative += values.buckets[b].load(memory_order_relaxed);
+
+                    string bound = b < values.bounds.size() ? formatNumber(values.bounds[b])
+                                                            : "+Inf";
+
+                    text += entry.name + "_bucket" +
+                            labelSet(entry.labels, "le=\"" + bound + "\"") + " " +
+                            to_string(cumulative) + "\n";
+                }
+
+                uint64_t bits = values.sum->load(memory_order_relaxed);
+                double sum;
+                memcpy(&sum, &bits, sizeof(sum));
+
+                text += entry.name + "_sum" + labelSet(entry.labels) + " " +
+                        formatNumber(sum) + "\n";
+                text += entry.name + "_count" + labelSet(entry.labels) + " " +
+                        to_string(cumulative) + "\n";
+            }
+        }
+    }
+
+    return text;
+}
+
+bool Metrics::writeFile(const string& path)
+{
+    string temporary = path + ".tmp." + to_string(getpid());
+
+    {
+        ofstream file(temporary, ios::binary);
+        file << format();
+
+        if(!file)
+        {
+            unlink(temporary.c_str());
+            return false;
+        }
+    }
+
+    if(rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        unlink(temporary.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+// Purpose: Read what has arrived of a scrape's request
+// Preconditions: None
+// Postconditions: Returns true once the request has ended, been cut off, or cannot be read further.
+//                 Every path gets the metrics, so the request itself is not parsed.
+static bool readRequest(int connection, string& request)
+{
+    char chunk[1024];
+
+    while(request.find("\r\n\r\n") == string::npos && request.size() < MAX_REQUEST_BYTES)
+    {
+        ssize_t count = read(connection, chunk, sizeof(chunk));
+
+        if(count < 0 && errno == EINTR)
+            continue;
+
+        if(count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return false;
+
+        if(count <= 0)
+            return true;
+
+        request.append(chunk, (size_t)count);
+    }
+
+    return true;
+}
+
+// Purpose: Send every metric to a scraper
+// Preconditions: connection is an accepted socket
+// Postconditions: connection is closed. On a non-blocking socket the reply is written without
+//                 waiting: it fits a loopback socket's buffer unless the scraper stopped reading.
+static void reply(int connection)
+{
+    string body = Metrics::format();
+
+    writeAll(connection, "HTTP/1.0 200 OK\r\n"
+                         "Content-Type: text/plain; version=0.0.4\r\n"
+                         "Content-Length: " + to_string(body.size()) + "\r\n"
+                         "Connection: close\r\n\r\n" + body);
+
+    close(connection);
+}
+
+MetricsEndpoint::MetricsEndpoint(int port) : listenSocket(-1), stopping(false)
+{
+    int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+
+    if(listener < 0)
+        return;
+
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    //Local only: the metrics are for a scraper on this machine
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons((uint16_t)port);
+
+    if(::bind(listener, (sockaddr*)&address, sizeof(address)) != 0 ||
+       listen(listener, SOMAXCONN) != 0)
+    {
+        close(listener);
+        return;
+    }
+
+    listenSocket = listener;
+}
+
+MetricsEndpoint::~MetricsEndpoint()
+{
+    stopping = true;
+
+    //Wakes accept() in the serving thread
+    if(listenSocket >= 0)
+        shutdown(listenSocket, SHUT_RDWR);
+
+    if(server.joinable())
+        server.join();
+
+    if(listenSocket >= 0)
+        close(listenSocket);
+
+    for(const scrape& pending : scrapes)
+        close(pending.socket);
+}
+
+bool MetricsEndpoint::listening() const
+{
+    return listenSocket >= 0;
+}
+
+int MetricsEndpoint::listener() const
+{
+    return listenSocket;
+}
+
+void MetricsEndpoint::start()
+{
+    if(!listening())
+        return;
+
+    server = thread([this]()
+    {
+        while(!stopping)
+            serveOne();
+    });
+}
+
+void MetricsEndpoint::serveOne()
+{
+    int connection = accept(listenSocket, nullptr, nullptr);
+
+    if(connection < 0)
+        return;
+
+    //A scraper that connects and sends nothing must not hold up the thread
+    timeval timeout = {REQUEST_TIMEOUT_SECONDS, 0};
+    setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    string request;
+    readRequest(connection, request);
+
+    reply(connection);
+}
+
+void MetricsEndpoint::addPolls(vector<pollfd>& polls) const
+{
+    polls.push_back({listenSocket, POLLIN, 0});
+
+    for(const scrape& pending : scrapes)
+        polls.push_back({pending.socket, POLLIN, 0});
+}
+
+void MetricsEndpoint::handlePolls(const pollfd* polls)
+{
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    vector<scrape> waiting;
+
+    //polls[0] is the listener, then the scrapes in order
+    for(size_t k = 0; k < scrapes.size(); k++)
+    {
+        scrape& pending = scrapes[k];
+        bool ended = polls[k + 1].revents != 0 && readRequest(pending.socket, pending.request);
+
+        if(ended || now >= pending.deadline)
+            reply(pending.socket);
+        else
+            waiting.push_back(move(pending));
+    }
+
+    scrapes.swap(waiting);
+
+    if(!(polls[0].revents & POLLIN))
+        return;
+
+    //Non-blocking here rather than at construction, since start()'s thread waits in accept().
+    //A connection reset between poll() and accept() then cannot block the loop.
+    fcntl(listenSocket, F_SETFL, fcntl(listenSocket, F_GETFL) | O_NONBLOCK);
+
+    int connection = accept(listenSocket, nullptr, nullptr);
+
+    if(connection < 0)
+        return;
+
+    fcntl(connection, F_SETFL, fcntl(connection, F_GETFL) | O_NONBLOCK);
+
+    scrapes.push_back({connection, string(), now + chrono::seconds(REQUEST_TIMEOUT_SECONDS)});
+}
+
+int MetricsEndpoint::pollTimeout() const
+{
+    if(scrapes.empty())
+        return -1;
+
+    chrono::steady_clock::time_point first = scrapes[0].deadline;
+
+    for(const scrape& pending : scrapes)
+        first = min(first, pending.deadline);
+
+    //Rounded up, so the loop does not wake just before the deadline and poll again with zero
+    chrono::microseconds left =
+        chrono::duration_cast<chrono::microseconds>(first - chrono::steady_clock::now());
+
+    return left.count() <= 0 ? 0 : (int)((left.count() + 999) / 1000);
+}
+
+void MetricsEndpoint::release()
+{
+    if(listenSocket >= 0)
+        close(listenSocket);
+
+    for(const scrape& pending : scrapes)
+        close(pending.socket);
+
+    listenSocket = -1;
+    scrapes.clear();
+}
+
+MetricsFile::MetricsFile(const string& path, chrono::milliseconds interval)
+    : path(path), interval(interval), stopping(false)
+{
+    writer = thread([this]()
+    {
+        unique_lock<mutex> guard(lock);
+
+        while(!wake.wait_for(guard, this->interval, [this]() { return stopping; }))
+            Metrics::writeFile(this->path);
+    });
+}
+
+MetricsFile::~MetricsFile()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+
+    wake.notify_all();
+    writer.join();
+
+    Metrics::writeFile(path);
+}
@@ -0,0 +1,233 @@
+/*******************************************************************************
+ * Metrics Signatures
+ *
+ * @author Matthew Munson
+ * @date 5/12/2021
+ *
+ * A process-wide registry of counters, gauges and histograms for monitoring
+ * batch and server runs, exported in the Prometheus text format to a file
+ * (for node_exporter's textfile collector) or over HTTP for scraping.
+ *
+ * Updating a metric is one relaxed atomic add, or a few for a histogram, with
+ * no locks. Metrics are updated once per job or per stage, never per pixel.
+ * Registering takes a lock, so metrics are registered once and kept by
+ * reference, normally at namespace scope:
+ *
+ *     static Metrics::histogram& decodeSeconds =
+ *         Metrics::addHistogram("machinevision_stage_seconds",
+ *                               "Time spent in each stage of a job",
+ *                               "pipeline=\"keying\",stage=\"decode\"");
+ *
+ * The values live in memory shared with child processes, so updates made by
+ * BatchRunner's forked workers show up in the coordinator's export. This
+ * only works for metrics registered before the fork; namespace-scope
+ * registration happens before main() and always qualifies. A metric
+ * registered after a fork still works, but only the process that registered
+ * it exports it.
+ *
+ * Percentiles come from the histograms on the Prometheus side, with
+ * histogram_quantile().
+ *
+ * POSIX only (mmap, sockets).
+ *
+ * Header file documentation is user-focused. For implementation-level comments
+ * see Metrics.cpp
+ *
+ ******************************************************************************/
+
+#ifndef MACHINEVISION_METRICS_H
+#define MACHINEVISION_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <poll.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Metrics {
+
+public:
+
+    // Only ever goes up, for totals such as jobs or bytes
+    class counter
+    {
+    public:
+        void add(uint64_t amount = 1) { slot->fetch_add(amount, std::memory_order_relaxed); }
+        uint64_t value() const { return slot->load(std::memory_order_relaxed); }
+
+    private:
+        friend class Metrics;
+        std::atomic<uint64_t>* slot;
+    };
+
+    // Goes up and down, for levels such as queue depth
+    class gauge
+    {
+    public:
+        void add(int64_t amount) { slot->fetch_add((uint64_t)amount, std::memory_order_relaxed); }
+        void set(int64_t value) { slot->store((uint64_t)value, std::memory_order_relaxed); }
+        int64_t value() const { return (int64_t)slot->load(std::memory_order_relaxed); }
+
+    private:
+        friend class Metrics;
+        std::atomic<uint64_t>* slot;
+    };
+
+    // Counts observations into buckets by upper bound, for latencies and sizes
+    class histogram
+    {
+    public:
+        void observe(double value);
+
+    private:
+        friend class Metrics;
+        std::vector<double> bounds;
+        std::atomic<uint64_t>* buckets;     // One per bound, then one for +Inf. Not cumulative.
+        std::atomic<uint64_t>* sum;         // The bits of a double
+    };
+
+    // Times consecutive stages: each lap() records the time since the previous one
+    class timer
+    {
+    public:
+        timer() : start(std::chrono::steady_clock::now()) {}
+
+        void lap(histogram& stage);
+
+    private:
+        std::chrono::steady_clock::time_point start;
+    };
+
+    /***********************************************************************************************
+     * Add Counter / Add Gauge / Add Histogram
+     *
+     * Registers a metric, or returns the one already registered with the same name and labels.
+     * The reference stays valid for the life of the process.
+     *
+     * @param name : Prometheus metric name, for example machinevision_jobs_total
+     * @param help : One line description, taken from the first registration of the name
+     * @param labels : Empty, or Prometheus label pairs without braces: stage="decode"
+     * @param bounds : Ascending bucket upper bounds. The +Inf bucket is added.
+     **********************************************************************************************/
+    static counter& addCounter(const std::string& name,
+                               const std::string& help,
+                               const std::string& labels = "");
+
+    static gauge& addGauge(const std::string& name,
+                           const std::string& help,
+                           const std::string& labels = "");
+
+    static histogram& addHistogram(const std::string& name,
+                                   const std::string& help,
+                                   const std::string& labels = "",
+                                   const std::vector<double>& bounds = latencyBounds());
+
+    // Bucket bounds in seconds, from half a millisecond to a minute
+    static std::vector<double> latencyBounds();
+
+    // Every registered metric in the Prometheus text exposition format
+    static std::string format();
+
+    /***********************************************************************************************
+     * Write File
+     *
+     * Writes format() to a file through a temporary file and a rename, so a collector never reads
+     * a partial file.
+     *
+     * @return False if the file could not be written
+     **********************************************************************************************/
+    static bool writeFile(const std::string& path);
+};
+
+/*******************************************************************************
+ * Metrics Endpoint
+ *
+ * Answers every HTTP request on a local TCP port with Metrics::format(). Either
+ * call start() to serve from a background thread, or serve from an existing
+ * event loop with addPolls() and handlePolls().
+ ******************************************************************************/
+class MetricsEndpoint {
+
+public:
+
+    // Listens on 127.0.0.1:port. Check listening() for failure.
+    explicit MetricsEndpoint(int port);
+
+    // Stops the thread, if started, and closes the socket
+    ~MetricsEndpoint();
+
+    MetricsEndpoint(const MetricsEndpoint&) = delete;
+    MetricsEndpoint& operator=(const MetricsEndpoint&) = delete;
+
+    bool listening() const;
+    int listener() const;
+
+    void start();
+
+    /***********************************************************************************************
+     * Event Loop Use
+     *
+     * Instead of start(), a poll() loop appends the endpoint's sockets with addPolls(), waits at
+     * most pollTimeout() milliseconds (-1 for no limit), and hands the same entries back to
+     * handlePolls(), even after a timeout. Connections are non-blocking, so a scraper that sends
+     * nothing never holds up the loop: it is answered after a second whatever it has sent.
+     **********************************************************************************************/
+    void addPolls(std::vector<pollfd>& polls) const;
+    void handlePolls(const pollfd* polls);
+    int pollTimeout() const;
+
+    // Closes this process's copies of the sockets without replying, in a child forked from the
+    // loop, so only the parent serves
+    void release();
+
+private:
+
+    // A connection whose request has not all arrived
+    struct scrape
+    {
+        int socket;
+        std::string request;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    int listenSocket;
+    std::atomic<bool> stopping;
+    std::thread server;
+    std::vector<scrape> scrapes;
+
+    // Accepts one connection and replies to it, for start()'s thread
+    void serveOne();
+};
+
+/*******************************************************************************
+ * Metrics File
+ *
+ * Rewrites a metrics file from a background thread every interval, and once
+ * more when destroyed.
+ ******************************************************************************/
+class MetricsFile {
+
+public:
+
+    MetricsFile(const std::string& path, std::chrono::milliseconds interval);
+    ~MetricsFile();
+
+    MetricsFile(const MetricsFile&) = delete;
+    MetricsFile& operator=(const MetricsFile&) = delete;
+
+private:
+
+    std::string path;
+    std::chrono::milliseconds interval;
+    bool stopping;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::thread writer;
+};
+
+
+#endif //MACHINEVISION_METRICS_H
@@ -0,0 +1,144 @@
+/*******************************************************************************
+ * Pixel Format
+ *
+ * @author Matthew Munson
+ * @date 4/29/2021
+ *
+ * Compile-time descriptions of the 8-bit pixel layouts we load: greyscale,
+ * BGR and BGRA (plus their RGB-ordered twins). Per-pixel kernels are written
+ * once as a template on the format and read channels through its constant
+ * offsets, so each instantiation indexes pixels correctly with no per-pixel
+ * branching on the layout.
+ *
+ * dispatchPixelFormat() looks at an image's channel count once and calls a
+ * generic lambda with the matching format tag:
+ *
+ *     dispatchPixelFormat(image, [&](auto format)
+ *     {
+ *         using Format = decltype(format);
+ *         ... image.ptr<uchar>(i)[j * Format::channels + Format::red] ...
+ *     });
+ *
+ * Greyscale images report the same offset for blue, green and red, so a
+ * kernel written for color reads a grey pixel as (v, v, v).
+ *
+ ******************************************************************************/
+
+#ifndef MACHINEVISION_PIXELFORMAT_H
+#define MACHINEVISION_PIXELFORMAT_H
+
+#include <opencv2/opencv.hpp>
+
+using namespace cv;
+
+// Offsets of each channel within a pixel. An alpha offset of -1 means there is no alpha channel.
+template<int Channels, int Blue, int Green, int Red, int Alpha = -1>
+struct PixelFormat
+{
+    static const int channels = Channels;
+
+    static const int blue = Blue;
+    static const int green = Green;
+    static const int red = Red;
+    static const int alpha = Alpha;
+
+    static const bool hasAlpha = Alpha >= 0;
+    static const bool isGray = Channels == 1;
+};
+
+typedef PixelFormat<1, 0, 0, 0> Gray8;
+typedef PixelFormat<3, 0, 1, 2> Bgr8;
+typedef PixelFormat<4, 0, 1, 2, 3> Bgra8;
+typedef PixelFormat<3, 2, 1, 0> Rgb8;
+typedef PixelFormat<4, 2, 1, 0, 3> Rgba8;
+
+/***************************************************************************************************
+ * Dispatch Pixel Format
+ *
+ * Calls kernel with the format tag matching an 8-bit image with 1, 3 or 4 channels. Images loaded
+ * by OpenCV are BGR ordered; pass rgbOrder for images known to be RGB ordered.
+ *
+ * @param image : The image the kernel will run on
+ * @param kernel : A callable taking any of the format tags by value
+ * @param rgbOrder : Whether color channels are stored red first
+ * @return Whatever the kernel returns
+ **************************************************************************************************/
+template<typename Kernel>
+auto dispatchPixelFormat(const Mat& image, Kernel&& kernel, bool rgbOrder = false)
+    -> decltype(kernel(Bgr8()))
+{
+    CV_Assert(image.depth() == CV_8U);
+
+    switch(image.channels())
+    {
+        case 1:
+            return kernel(Gray8());
+
+        case 3:
+            return rgbOrder ? kernel(Rgb8()) : kernel(Bgr8());
+
+        case 4:
+            return rgbOrder ? kernel(Rgba8()) : kernel(Bgra8());
+
+        default:
+            CV_Error(Error::StsBadArg, "Only 1, 3 and 4 channel images are supported");
+    }
+}
+
+/***************************************************************************************************
+ * To Gray
+ *
+ * Converts an image of the given format to greyscale. Greyscale images are copied as they are.
+ *
+ * @param image : An image in Format's layout
+ * @param gray : Receives the CV_8UC1 image. May be the same Mat as image.
+ **************************************************************************************************/
+template<class Format>
+void toGray(const Mat& image, Mat& gray)
+{
+    if(Format::isGray)
+        image.copyTo(gray);
+    else if(Format::red == 2)
+        cvtColor(image, gray, Format::hasAlpha ? COLOR_BGRA2GRAY : COLOR_BGR2GRAY);
+    else
+        cvtColor(image, gray, Format::hasAlpha ? COLOR_RGBA2GRAY : COLOR_RGB2GRAY);
+}
+
+/***************************************************************************************************
+ * Convert Channels
+ *
+ * Converts a BGR-ordered 8-bit image with 1, 3 or 4 channels to another channel count. Images that
+ * already have that many channels are shared, not copied.
+ *
+ * @param image : The image to convert
+ * @param converted : Receives the converted image. Must not be the same Mat as image.
+ * @param channels : 1, 3 or 4
+ **************************************************************************************************/
+inline void convertChannels(const Mat& image, Mat& converted, int channels)
+{
+    CV_Assert(image.depth() == CV_8U);
+
+    int from = image.channels();
+
+    if(from == channels)
+    {
+        converted = image;
+        return;
+    }
+
+    switch(from * 10 + channels)
+    {
+        case 13: cvtColor(image, converted, COLOR_GRAY2BGR); break;
+        case 14: cvtColor(image, converted, COLOR_GRAY2BGRA); break;
+        case 31: cvtColor(image, converted, COLOR_BGR2GRAY); break;
+        case 34: cvtColor(image, converted, COLOR_BGR2BGRA); break;
+        case 41: cvtColor(image, converted, COLOR_BGRA2GRAY); break;
+        case 43: cvtColor(image, converted, COLOR_BGRA2BGR); break;
+
+        default:
+            CV_Error(Error::StsBadArg, "Only 1, 3 and 4 channel images are supported");
+    }
+}
+
+
+#endif //MACHINEVISION_PIXELFORMAT_H
@@ -0,0 +1,224 @@
+/***************************************************************************************************
+ * Pixel Kernels Implementation
+ *
+ * @author Matthew Munson
+ * @date 4/28/2021
+ *
+ * Implementation file for the PixelKernels class. Functions include:
+ *
+ *     - int thresholdReplace(Mat& image, const Vec3b& threshold, const Vec3b& replacement)
+ *     - void flipToGray(const Mat& image, Mat& gray, int flipCode)
+ *     - void flipToGray(const vector<Mat>& images, Mat& stack, int flipCode)
+ *
+ * The per-row loops live in their own functions so that the row pointer and width are plain
+ * arguments. That keeps the compiler from reloading them after every byte store, which would
+ * otherwise stop it from vectorizing the loop.
+ *
+ **************************************************************************************************/
+
+#include "PixelKernels.h"
+
+#include <algorithm>
+#include <atomic>
+
+#include "TaskScheduler.h"
+
+using namespace std;
+using namespace cv;
+
+// OpenCV 4's fixed-point BGR to grey weights: 0.299 R + 0.587 G + 0.114 B, scaled by 2^15. They
+// sum to 2^15, so grey input comes back unchanged. (OpenCV 3 used 2^14, as YCrCb still does.)
+static const int GRAY_SHIFT = 15;
+static const int GRAY_RED = 9798;
+static const int GRAY_GREEN = 19235;
+static const int GRAY_BLUE = 3735;
+
+// Pixels mirrored per step. The grey values are staged in a buffer of this many bytes.
+static const int MIRROR_CHUNK = 256;
+
+// Purpose: Threshold and replace one row of pixels in a given format
+// Preconditions: row holds cols pixels laid out as Format
+// Postconditions: Matching pixels are replaced. Returns the number of matches. Alpha is untouched.
+template<class Format>
+static int thresholdReplaceRow(uchar* row,
+                               int cols,
+                               const Vec3b& threshold,
+                               const Vec3b& replacement)
+{
+    const uchar t0 = threshold[0], t1 = threshold[1], t2 = threshold[2];
+    const uchar r0 = replacement[0], r1 = replacement[1], r2 = replacement[2];
+
+    int count = 0;
+
+    for(int j = 0; j < cols; j++)
+    {
+        uchar* pixel = row + j * Format::channels;
+
+        uchar blue = pixel[Format::blue];
+        uchar green = pixel[Format::green];
+        uchar red = pixel[Format::red];
+
+        // All-or-nothing compare mask for the pixel, summed rather than branched on
+        uchar match = (uchar)((blue < t0) & (green < t1) & (red < t2));
+        uchar mask = (uchar)-match;
+
+        count += match;
+
+        // Grey pixels have a single channel, which takes the blue replacement
+        if(Format::isGray)
+        {
+            pixel[0] = (uchar)((r0 & mask) | (blue & ~mask));
+            continue;
+        }
+
+        pixel[Format::blue] = (uchar)((r0 & mask) | (blue & ~mask));
+        pixel[Format::green] = (uchar)((r1 & mask) | (green & ~mask));
+        pixel[Format::red] = (uchar)((r2 & mask) | (red & ~mask));
+    }
+
+    return count;
+}
+
+// Purpose: Recolor dark pixels and count them in one pass
+// Preconditions: image is an 8-bit image with 1, 3 or 4 channels
+// Postconditions: Matching pixels are replaced. The layout is dispatched once for the whole image.
+//                 Each stripe of rows counts its own matches and adds them to the total once, so
+//                 threads never contend on the counter.
+int PixelKernels::thresholdReplace(Mat& image, const Vec3b& threshold, const Vec3b& replacement)
+{
+    return dispatchPixelFormat(image, [&](auto format)
+    {
+        using Format = decltype(format);
+
+        atomic<int> total(0);
+
+        parallelFor(Range(0, image.rows), [&](const Range& range)
+        {
+            int count = 0;
+
+            for(int i = range.start; i < range.end; i++)
+            {
+                count += thresholdReplaceRow<Format>(image.ptr<uchar>(i),
+                                                     image.cols,
+                                                     threshold,
+                                                     replacement);
+            }
+
+            total += count;
+        });
+
+        return total.load();
+    });
+}
+
+// Purpose: Convert one row of pixels in a given format to grey
+// Preconditions: src holds cols pixels laid out as Format, dst has room for cols bytes
+// Postconditions: dst holds the grey values in the same order
+template<class Format>
+static void grayRow(const uchar* src, uchar* dst, int cols)
+{
+    for(int j = 0; j < cols; j++)
+    {
+        const uchar* pixel = src + j * Format::channels;
+
+        dst[j] = (uchar)((pixel[Format::blue] * GRAY_BLUE +
+                          pixel[Format::green] * GRAY_GREEN +
+                          pixel[Format::red] * GRAY_RED +
+                          (1 << (GRAY_SHIFT - 1))) >> GRAY_SHIFT);
+    }
+}
+
+// Purpose: Copy bytes in reverse order
+// Preconditions: src and dst hold count bytes and do not overlap
+// Postconditions: dst[k] = src[count - 1 - k]
+static void reverseRow(const uchar* src, uchar* dst, int count)
+{
+    for(int k = 0; k < count; k++)
+        dst[k] = src[count - 1 - k];
+}
+
+// Purpose: Convert one row to grey, mirrored left to right
+// Preconditions: src holds cols pixels laid out as Format, dst has room for cols bytes
+// Postconditions: dst[j] is the grey value of source pixel cols - 1 - j
+template<class Format>
+static void mirrorGrayRow(const uchar* src, uchar* dst, int cols)
+{
+    //A loop reading pixels backwards does not vectorize, but a forward conversion and a byte
+    //reversal each do (the reversal becomes a shuffle). Chunks are staged in a buffer that stays
+    //in L1, so the image is still read and written only once.
+    uchar buffer[MIRROR_CHUNK];
+
+    for(int j = 0; j < cols; j += MIRROR_CHUNK)
+    {
+        int count = min(MIRROR_CHUNK, cols - j);
+
+        //Output pixels j to j + count - 1 come from input pixels cols - j - count to cols - j - 1
+        grayRow<Format>(src + (cols - j - count) * Format::channels, buffer, count);
+        reverseRow(buffer, dst + j, count);
+    }
+}
+
+// Purpose: Flip and convert one output row to grey
+// Preconditions: image is laid out as Format. dst has room for image.cols bytes.
+// Postconditions: dst holds row i of the flipped grey image
+template<class Format>
+static void flipToGrayRow(const Mat& image, int i, uchar* dst, int flipCode)
+{
+    const uchar* src = image.ptr<uchar>(flipCode <= 0 ? image.rows - 1 - i : i);
+
+    if(flipCode != 0)
+        mirrorGrayRow<Format>(src, dst, image.cols);
+    else
+        grayRow<Format>(src, dst, image.cols);
+}
+
+// Purpose: Flip and convert to grey in one pass
+// Preconditions: image is an 8-bit image with 1, 3 or 4 channels
+// Postconditions: gray is a new CV_8UC1 image, so image is not overwritten while it is read
+void PixelKernels::flipToGray(const Mat& image, Mat& gray, int flipCode)
+{
+    Mat output = allocateImage(image.rows, image.cols, CV_8UC1);
+
+    dispatchPixelFormat(image, [&](auto format)
+    {
+        using Format = decltype(format);
+
+        parallelFor(Range(0, image.rows), [&](const Range& range)
+        {
+            for(int i = range.start; i < range.end; i++)
+                flipToGrayRow<Format>(image, i, output.ptr<uchar>(i), flipCode);
+        });
+    });
+
+    gray = output;
+}
+
+// Purpose: Flip and convert a batch of same-size images to grey planes in one pass
+// Preconditions: images is not empty and every image has the same size and type
+// Postconditions: stack is a new CV_8UC1 image of the planes, one below the other. The rows of all
+//                 planes are split across the thread pool together, in a single dispatch.
+void PixelKernels::flipToGray(const vector<Mat>& images, Mat& stack, int flipCode)
+{
+    CV_Assert(!images.empty());
+
+    int rows = images[0].rows;
+    int cols = images[0].cols;
+
+    for(const Mat& image : images)
+        CV_Assert(image.size() == images[0].size() && image.type() == images[0].type());
+
+    Mat output = allocateImage((int)images.size() * rows, cols, CV_8UC1);
+
+    dispatchPixelFormat(images[0], [&](auto format)
+    {
+        using Format = decltype(format);
+
+        parallelFor(Range(0, output.rows), [&](const Range& range)
+        {
+            for(int i = range.start; i < range.end; i++)
+                flipToGrayRow<Format>(images[i / rows], i % rows, output.ptr<uchar>(i), flipCode);
+        });
+    });
+
+    stack = output;
+}
@@ -0,0 +1,81 @@
+/*******************************************************************************
+ * Pixel Kernels Signatures
+ *
+ * @author Matthew Munson
+ * @date 4/28/2021
+ *
+ * Reusable per-pixel kernels shared by the assignments and the playgrounds.
+ * Each kernel makes a single pass over the image, splits the rows across
+ * OpenCV's thread pool, and keeps its inner loop free of branches on pixel
+ * values so the compiler can vectorize it. Kernels are templated on the pixel
+ * format (see PixelFormat.h) and dispatched once per image.
+ *
+ * - Threshold and replace: recolors every pixel whose channels are all below a
+ *   threshold and counts how many were recolored
+ *
+ * - Flip to gray: flips or rotates an image by 180 degrees and converts it to
+ *   greyscale, reading the color image once and writing the grey image once.
+ *   A batch version writes a stack of same-size images as grey planes.
+ *
+ * Header file documentation is user-focused. For implementation-level comments
+ * see PixelKernels.cpp
+ *
+ ******************************************************************************/
+
+#ifndef MACHINEVISION_PIXELKERNELS_H
+#define MACHINEVISION_PIXELKERNELS_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+#include "PixelFormat.h"
+
+using namespace cv;
+
+class PixelKernels {
+
+public:
+
+    /***********************************************************************************************
+     * Threshold and Replace
+     *
+     * Replaces every pixel whose blue, green and red channels are all below the matching channel
+     * of threshold with replacement, in place. Greyscale, BGR and BGRA images are supported; the
+     * alpha channel is left as it is, and greyscale pixels are written with replacement[0].
+     *
+     * @param image : An 8-bit image with 1, 3 or 4 channels, modified in place
+     * @param threshold : Per-channel exclusive upper bound for a pixel to match
+     * @param replacement : The color written over matching pixels
+     * @return The number of pixels replaced
+     **********************************************************************************************/
+    static int thresholdReplace(Mat& image, const Vec3b& threshold, const Vec3b& replacement);
+
+    /***********************************************************************************************
+     * Flip to Gray
+     *
+     * The same as flip(image, flipped, flipCode) followed by cvtColor(flipped, gray, *2GRAY), bit
+     * for bit, in one pass. The conversion uses OpenCV 4's fixed-point weights, checked against
+     * cvtColor on every 24-bit color.
+     *
+     * @param image : An 8-bit image with 1, 3 or 4 channels
+     * @param gray : Receives the CV_8UC1 result. May be the same Mat as image.
+     * @param flipCode : As for flip(): 0 flips vertically, a positive value mirrors horizontally,
+     *                   and a negative value does both, rotating by 180 degrees
+     **********************************************************************************************/
+    static void flipToGray(const Mat& image, Mat& gray, int flipCode);
+
+    /***********************************************************************************************
+     * Flip to Gray (batch)
+     *
+     * flipToGray for a batch of images of the same size and type, written as planes stacked one
+     * below the other: image k becomes rows k * rows to (k + 1) * rows - 1 of stack. The whole
+     * batch is one parallel pass, which pays off for many small images.
+     *
+     * @param images : At least one 8-bit image with 1, 3 or 4 channels, all the same size and type
+     * @param stack : Receives the CV_8UC1 planes
+     **********************************************************************************************/
+    static void flipToGray(const std::vector<Mat>& images, Mat& stack, int flipCode);
+};
+
+
+#endif //MACHINEVISION_PIXELKERNELS_H
@@ -0,0 +1,155 @@
+/*******************************************************************************
+ * Planar Image Implementation
+ *
+ * @author Matthew Munson
+ * @date 5/10/2021
+ *
+ * The split and merge loops are written per channel count with constant
+ * strides, which the compiler turns into vector loads and shuffles (a
+ * structure load of 3 or 4 interleaved channels). As elsewhere, the row loops
+ * take plain pointers so the compiler does not have to reload them.
+ *
+ ******************************************************************************/
+
+#include "PlanarImage.h"
+
+#include "TaskScheduler.h"
+
+using namespace std;
+using namespace cv;
+
+PlanarImage::PlanarImage() : height(0), planes(0)
+{
+}
+
+PlanarImage::PlanarImage(int rows, int cols, int channels)
+    : data(rows * channels, cols, CV_8UC1), height(rows), planes(channels)
+{
+    CV_Assert(channels == 1 || channels == 3 || channels == 4);
+}
+
+int PlanarImage::rows() const { return height; }
+int PlanarImage::cols() const { return data.cols; }
+int PlanarImage::channels() const { return planes; }
+bool PlanarImage::empty() const { return data.empty(); }
+
+uchar* PlanarImage::row(int c, int i) { return data.ptr<uchar>(c * height + i); }
+const uchar* PlanarImage::row(int c, int i) const { return data.ptr<uchar>(c * height + i); }
+
+Mat PlanarImage::plane(int c) const
+{
+    return data.rowRange(c * height, (c + 1) * height);
+}
+
+// Purpose: Split one interleaved row into its planes
+// Preconditions: src holds cols pixels of Channels channels. dst[c] has room for cols bytes.
+// Postconditions: dst[c][j] = src[j * Channels + c]
+template<int Channels>
+static void splitRow(const uchar* src, uchar* const* dst, int cols)
+{
+    uchar* d0 = dst[0];
+    uchar* d1 = dst[Channels > 1 ? 1 : 0];
+    uchar* d2 = dst[Channels > 2 ? 2 : 0];
+    uchar* d3 = dst[Channels > 3 ? 3 : 0];
+
+    for(int j = 0; j < cols; j++)
+    {
+        const uchar* pixel = src + j * Channels;
+
+        d0[j] = pixel[0];
+
+        if(Channels > 1)
+        {
+            d1[j] = pixel[1];
+            d2[j] = pixel[2];
+        }
+
+        if(Channels > 3)
+            d3[j] = pixel[3];
+    }
+}
+
+// Purpose: Interleave one row from its planes
+// Preconditions: src[c] holds cols bytes. dst has room for cols pixels of Channels channels.
+// Postconditions: dst[j * Channels + c] = src[c][j]
+template<int Channels>
+static void mergeRow(const uchar* const* src, uchar* dst, int cols)
+{
+    const uchar* s0 = src[0];
+    const uchar* s1 = src[Channels > 1 ? 1 : 0];
+    const uchar* s2 = src[Channels > 2 ? 2 : 0];
+    const uchar* s3 = src[Channels > 3 ? 3 : 0];
+
+    for(int j = 0; j < cols; j++)
+    {
+        uchar* pixel = dst + j * Channels;
+
+        pixel[0] = s0[j];
+
+        if(Channels > 1)
+        {
+            pixel[1] = s1[j];
+            pixel[2] = s2[j];
+        }
+
+        if(Channels > 3)
+            pixel[3] = s3[j];
+    }
+}
+
+// Purpose: Run splitRow or mergeRow over every row, with the channel count fixed at compile time
+// Preconditions: channels is 1, 3 or 4
+// Postconditions: rowKernel has been called for every row, rows split across the thread pool
+template<class RowKernel>
+static void forEachRow(int rows, int channels, RowKernel&& rowKernel)
+{
+    parallelFor(Range(0, rows), [&](const Range& range)
+    {
+        for(int i = range.start; i < range.end; i++)
+        {
+            switch(channels)
+            {
+                case 1: rowKernel(i, std::integral_constant<int, 1>()); break;
+                case 3: rowKernel(i, std::integral_constant<int, 3>()); break;
+                default: rowKernel(i, std::integral_constant<int, 4>()); break;
+            }
+        }
+    });
+}
+
+void PlanarImage::fromInterleaved(const Mat& image, PlanarImage& planar)
+{
+    CV_Assert(image.depth() == CV_8U);
+
+    int channels = image.channels();
+
+    if(planar.rows() != image.rows || planar.cols() != image.cols || planar.channels() != channels)
+        planar = PlanarImage(image.rows, image.cols, channels);
+
+    forEachRow(image.rows, channels, [&](int i, auto channelCount)
+    {
+        uchar* dst[4];
+
+        for(int c = 0; c < channels; c++)
+            dst[c] = planar.row(c, i);
+
+        splitRow<decltype(channelCount)::value>(image.ptr<uchar>(i), dst, image.cols);
+    });
+}
+
+void PlanarImage::toInterleaved(const PlanarImage& planar, Mat& image)
+{
+    int channels = planar.channels();
+
+    image.create(planar.rows(), planar.cols(), CV_8UC(channels));
+
+    forEachRow(planar.rows(), channels, [&](int i, auto channelCount)
+    {
+        const uchar* src[4];
+
+        for(int c = 0; c < channels; c++)
+            src[c] = planar.row(c, i);
+
+        mergeRow<decltype(channelCount)::value>(src, image.ptr<uchar>(i), planar.cols());
+    });
+}
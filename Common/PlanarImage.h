@@ -0,0 +1,79 @@
+/*******************************************************************************
+ * Planar Image Signatures
+ *
+ * @author Matthew Munson
+ * @date 5/10/2021
+ *
+ * An 8-bit image stored one channel after another (planar, or "structure of
+ * arrays") rather than with each pixel's channels side by side. A loop over a
+ * row of a plane reads one channel of consecutive pixels from contiguous
+ * memory, so a compare or an index computation fills a whole vector register
+ * without the shuffles needed to pull one channel out of interleaved BGR.
+ *
+ * The planes of an image with C channels are stored in one buffer, one below
+ * the other, in the channel order of the interleaved image (blue, green, red
+ * and alpha for OpenCV's BGR and BGRA).
+ *
+ * Converting costs a pass over the image each way. Planar kernels pay off when
+ * the work they save is larger than that, or when an image is converted once
+ * and used several times. imdecode() only produces interleaved images, so the
+ * split cannot be fused into decoding; split once after decoding and reuse the
+ * planes. See Keying.h for the planar keying kernels and the harness for the
+ * measurements.
+ *
+ * Header file documentation is user-focused. For implementation-level comments
+ * see PlanarImage.cpp
+ *
+ ******************************************************************************/
+
+#ifndef MACHINEVISION_PLANARIMAGE_H
+#define MACHINEVISION_PLANARIMAGE_H
+
+#include <opencv2/opencv.hpp>
+
+using namespace cv;
+
+class PlanarImage {
+
+public:
+
+    PlanarImage();
+
+    // An uninitialized image of the given size with 1, 3 or 4 channels
+    PlanarImage(int rows, int cols, int channels);
+
+    /***********************************************************************************************
+     * From Interleaved / To Interleaved
+     *
+     * Convert between an interleaved 8-bit Mat with 1, 3 or 4 channels and a planar image, in
+     * one parallel, vectorized pass.
+     **********************************************************************************************/
+    static void fromInterleaved(const Mat& image, PlanarImage& planar);
+    static void toInterleaved(const PlanarImage& planar, Mat& image);
+
+    int rows() const;
+    int cols() const;
+    int channels() const;
+    bool empty() const;
+
+    // Row i of channel c's plane
+    uchar* row(int c, int i);
+    const uchar* row(int c, int i) const;
+
+    // Channel c's plane as a CV_8UC1 header sharing this image's memory
+    Mat plane(int c) const;
+
+    // The plane holding blue, green or red. For a greyscale image these are all the one plane.
+    int bluePlane() const { return 0; }
+    int greenPlane() const { return planes > 1 ? 1 : 0; }
+    int redPlane() const { return planes > 1 ? 2 : 0; }
+
+private:
+
+    Mat data;       // CV_8UC1, planes * height rows
+    int height;
+    int planes;
+};
+
+
+#endif //MACHINEVISION_PLANARIMAGE_H
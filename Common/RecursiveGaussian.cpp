@@ -0,0 +1,291 @@
+/*******************************************************************************
+ * Recursive Gaussian Implementation
+ *
+ * @author Matthew Munson
+ * @date 5/8/2021
+ *
+ * Along one column the filter is
+ *
+ *     forward:   w[n] = B x[n] + a1 w[n-1] + a2 w[n-2] + a3 w[n-3]
+ *     backward:  y[n] = B w[n] + a1 y[n+1] + a2 y[n+2] + a3 y[n+3]
+ *
+ * Each step depends on the one before it, so a single column cannot be
+ * vectorized. Neighbouring columns are independent though, so the recursion is
+ * run on whole rows at a time: every step is an element-wise multiply-add of
+ * four rows, which the compiler vectorizes. Blurring along rows transposes the
+ * image, runs the same column filter and transposes back.
+ *
+ * The poles are those of van Vliet, Young and Verbeek, scaled so that the
+ * filter's variance is exactly sigma^2. This is about four times closer to a
+ * true Gaussian than Young and van Vliet's original closed-form coefficients.
+ *
+ * Columns are processed in strips of STRIP_WIDTH floats, split across
+ * OpenCV's thread pool. A strip's rows stay in cache between the two passes.
+ *
+ * References:
+ * - I. T. Young, L. J. van Vliet, "Recursive implementation of the Gaussian
+ *   filter", Signal Processing 44, 1995
+ * - L. J. van Vliet, I. T. Young, P. W. Verbeek, "Recursive Gaussian
+ *   derivative filters", ICPR 1998
+ * - B. Triggs, M. Sdika, "Boundary conditions for Young-van Vliet recursive
+ *   filtering", IEEE Transactions on Signal Processing 54, 2006
+ *
+ ******************************************************************************/
+
+#include "RecursiveGaussian.h"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+#include "TaskScheduler.h"
+
+using namespace std;
+using namespace cv;
+
+// Floats per strip of columns handled by one task
+static const int STRIP_WIDTH = 256;
+
+// Poles of the third-order filter for unit scale, optimized by van Vliet, Young and Verbeek.
+// Poles for a given sigma are these raised to the power 1 / q.
+static const complex<double> POLE_COMPLEX(1.40098, 1.00236);
+static const double POLE_REAL = 1.85132;
+
+// Filter coefficients for one sigma
+struct recursiveCoefficients
+{
+    float b;
+    float a1, a2, a3;
+    float boundary[9];  // Triggs-Sdika matrix, row major, already scaled by b
+};
+
+// Purpose: Variance of the forward and backward passes together, for poles raised to 1 / q
+// Preconditions: q > 0
+// Postconditions: None
+static double recursiveVariance(double q)
+{
+    complex<double> p1 = pow(POLE_COMPLEX, 1 / q);
+    double p3 = pow(POLE_REAL, 1 / q);
+
+    //Each pole d contributes 2d / (d - 1)^2; the conjugate pole contributes the conjugate
+    complex<double> complexPair = 2.0 * p1 / ((p1 - 1.0) * (p1 - 1.0));
+
+    return 2 * complexPair.real() + 2 * p3 / ((p3 - 1) * (p3 - 1));
+}
+
+// Purpose: Compute the filter coefficients and the Triggs-Sdika boundary matrix
+// Preconditions: sigma >= 0.5
+// Postconditions: None
+static recursiveCoefficients coefficientsFor(double sigma)
+{
+    //Scale the poles so the filter's variance is exactly sigma^2. The variance grows with q.
+    double low = 0.1;
+    double high = 10 * sigma + 10;
+
+    for(int i = 0; i < 64; i++)
+    {
+        double middle = (low + high) / 2;
+
+        if(recursiveVariance(middle) < sigma * sigma)
+            low = middle;
+        else
+            high = middle;
+    }
+
+    double q = (low + high) / 2;
+
+    //Expand 1 / ((1 - z^-1 / p1)(1 - z^-1 / conj(p1))(1 - z^-1 / p3)) into feedback coefficients
+    complex<double> r1 = 1.0 / pow(POLE_COMPLEX, 1 / q);
+    double r3 = 1 / pow(POLE_REAL, 1 / q);
+    double modulus = norm(r1);
+
+    double a1 = 2 * r1.real() + r3;
+    double a2 = -(modulus + 2 * r1.real() * r3);
+    double a3 = modulus * r3;
+    double b = 1 - (a1 + a2 + a3);
+
+    double scale = b / ((1 + a1 - a2 + a3) * (1 - a1 - a2 - a3) * (1 + a2 + (a1 - a3) * a3));
+
+    double m[9] = {
+        -a3 * a1 + 1 - a3 * a3 - a2,
+        (a3 + a1) * (a2 + a3 * a1),
+        a3 * (a1 + a3 * a2),
+        a1 + a3 * a2,
+        -(a2 - 1) * (a2 + a3 * a1),
+        -(a3 * a1 + a3 * a3 + a2 - 1) * a3,
+        a3 * a1 + a2 + a1 * a1 - a2 * a2,
+        a1 * a2 + a3 * a2 * a2 - a1 * a3 * a3 - a3 * a3 * a3 - a3 * a2 + a3,
+        a3 * (a1 + a3 * a2)
+    };
+
+    recursiveCoefficients c;
+    c.b = (float)b;
+    c.a1 = (float)a1;
+    c.a2 = (float)a2;
+    c.a3 = (float)a3;
+
+    for(int i = 0; i < 9; i++)
+        c.boundary[i] = (float)(m[i] * scale);
+
+    return c;
+}
+
+// Purpose: One step of the recursion for a row of independent columns
+// Preconditions: All pointers address width floats. out may be x.
+// Postconditions: out[i] = b x[i] + a1 p1[i] + a2 p2[i] + a3 p3[i]
+static void recursionStep(const float* x,
+                          const float* p1,
+                          const float* p2,
+                          const float* p3,
+                          float* out,
+                          int width,
+                          const recursiveCoefficients& c)
+{
+    for(int i = 0; i < width; i++)
+        out[i] = c.b * x[i] + c.a1 * p1[i] + c.a2 * p2[i] + c.a3 * p3[i];
+}
+
+// Purpose: Run the forward and backward passes down a strip of columns, in place
+// Preconditions: rows >= 3. row(n) points at the strip in row n. width <= STRIP_WIDTH.
+// Postconditions: The strip holds the blurred columns
+template<class RowPointer>
+static void filterStrip(RowPointer row, int rows, int width, const recursiveCoefficients& c)
+{
+    float first[STRIP_WIDTH];
+    float last[STRIP_WIDTH];
+    float after1[STRIP_WIDTH];
+    float after2[STRIP_WIDTH];
+
+    //Replicated border: before the first row the forward pass is in steady state at x[0]
+    copy(row(0), row(0) + width, first);
+    copy(row(rows - 1), row(rows - 1) + width, last);
+
+    for(int n = 0; n < rows; n++)
+    {
+        const float* p1 = n >= 1 ? row(n - 1) : first;
+        const float* p2 = n >= 2 ? row(n - 2) : first;
+        const float* p3 = n >= 3 ? row(n - 3) : first;
+
+        recursionStep(row(n), p1, p2, p3, row(n), width, c);
+    }
+
+    //Backward pass initial conditions, from the last three forward outputs
+    const float* w1 = row(rows - 1);
+    const float* w2 = row(rows - 2);
+    const float* w3 = row(rows - 3);
+    const float* m = c.boundary;
+
+    for(int i = 0; i < width; i++)
+    {
+        float d1 = w1[i] - last[i];
+        float d2 = w2[i] - last[i];
+        float d3 = w3[i] - last[i];
+
+        float y0 = m[0] * d1 + m[1] * d2 + m[2] * d3 + last[i];
+        after1[i] = m[3] * d1 + m[4] * d2 + m[5] * d3 + last[i];
+        after2[i] = m[6] * d1 + m[7] * d2 + m[8] * d3 + last[i];
+
+        row(rows - 1)[i] = y0;
+    }
+
+    for(int n = rows - 2; n >= 0; n--)
+    {
+        const float* p1 = row(n + 1);
+        const float* p2 = n + 2 < rows ? row(n + 2) : after1;
+        const float* p3 = n + 3 < rows ? row(n + 3) : n + 3 == rows ? after1 : after2;
+
+        recursionStep(row(n), p1, p2, p3, row(n), width, c);
+    }
+}
+
+void RecursiveGaussian::filterColumns(Mat& image, double sigma)
+{
+    CV_Assert(image.depth() == CV_32F && image.rows >= 3);
+
+    recursiveCoefficients c = coefficientsFor(sigma);
+
+    int width = image.cols * image.channels();
+    int strips = (width + STRIP_WIDTH - 1) / STRIP_WIDTH;
+
+    parallelFor(Range(0, strips), [&](const Range& range)
+    {
+        for(int s = range.start; s < range.end; s++)
+        {
+            int start = s * STRIP_WIDTH;
+
+            auto row = [&](int n) { return image.ptr<float>(n) + start; };
+
+            filterStrip(row, image.rows, min(STRIP_WIDTH, width - start), c);
+        }
+    });
+}
+
+void RecursiveGaussian::kernelBlur(const Mat& src, Mat& dst, double sigma, bool rows, int ddepth)
+{
+    int size = max(1, cvRound(sigma * 3 * 2 + 1) | 1);
+
+    Mat kernel = getGaussianKernel(size, max(sigma, 0.0), CV_64F);
+    Mat identity = Mat(1, 1, CV_64F, Scalar(1.0));
+
+    sepFilter2D(src,
+                dst,
+                ddepth,
+                rows ? kernel : identity,
+                rows ? identity : kernel,
+                Point(-1, -1),
+                0,
+                BORDER_REPLICATE);
+}
+
+void RecursiveGaussian::blurColumns(const Mat& src, Mat& dst, double sigma, int ddepth)
+{
+    if(ddepth < 0)
+        ddepth = src.depth();
+
+    if(sigma < minimumSigma() || src.rows < 4)
+    {
+        kernelBlur(src, dst, sigma, false, ddepth);
+        return;
+    }
+
+    Mat work;
+    src.convertTo(work, CV_32F);
+
+    filterColumns(work, sigma);
+
+    work.convertTo(dst, ddepth);
+}
+
+void RecursiveGaussian::blurRows(const Mat& src, Mat& dst, double sigma, int ddepth)
+{
+    if(ddepth < 0)
+        ddepth = src.depth();
+
+    if(sigma < minimumSigma() || src.cols < 4)
+    {
+        kernelBlur(src, dst, sigma, true, ddepth);
+        return;
+    }
+
+    Mat work;
+    Mat transposed;
+    src.convertTo(work, CV_32F);
+
+    transpose(work, transposed);
+    filterColumns(transposed, sigma);
+    transpose(transposed, work);
+
+    work.convertTo(dst, ddepth);
+}
+
+void RecursiveGaussian::blur(const Mat& src, Mat& dst, double sigmaX, double sigmaY, int ddepth)
+{
+    if(ddepth < 0)
+        ddepth = src.depth();
+
+    //Both passes in float, so the image is only rounded once
+    Mat work;
+    blurColumns(src, work, sigmaY, CV_32F);
+    blurRows(work, dst, sigmaX, ddepth);
+}
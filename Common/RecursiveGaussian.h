@@ -0,0 +1,82 @@
+/*******************************************************************************
+ * Recursive Gaussian Signatures
+ *
+ * @author Matthew Munson
+ * @date 5/8/2021
+ *
+ * A Gaussian blur whose cost per pixel does not depend on sigma. GaussianBlur
+ * convolves with a kernel about 6 sigma wide, so at the sigmas the sliders
+ * reach (up to 11) every output pixel reads dozens of inputs per axis. This
+ * instead runs a third-order recursive (IIR) approximation in the style of
+ * Young and van Vliet forwards and then backwards along each axis: seven
+ * multiply-adds per pixel per axis at any sigma.
+ *
+ * Borders behave like BORDER_REPLICATE, using the exact initial conditions of
+ * Triggs and Sdika for the backward pass.
+ *
+ * Accuracy against GaussianBlur(src, dst, Size(0, 0), sigma) on 8-bit images
+ * (noise and smooth images with hard edges, sigma 1 to 11):
+ *
+ * - Away from the borders, the output differs by at most 1 gray level for
+ *   sigma >= 2, with a mean difference of 0.03 to 0.25 levels. At sigma 1 the
+ *   difference reaches 6 levels on noise (mean 1.1), where the recursive
+ *   approximation is least accurate.
+ * - Within about 3 sigma of a border, GaussianBlur reflects
+ *   (BORDER_REFLECT_101) while this replicates. On noise that changes border
+ *   pixels by tens of levels; against GaussianBlur with BORDER_REPLICATE the
+ *   bounds above hold everywhere.
+ * - Kernel sizes are ignored: this approximates the untruncated Gaussian,
+ *   where GaussianBlur truncates it at 3 sigma, or at an explicit size.
+ *
+ * Prefer GaussianBlur for small sigmas, where its kernel is short anyway.
+ *
+ * Header file documentation is user-focused. For implementation-level comments
+ * see RecursiveGaussian.cpp
+ *
+ ******************************************************************************/
+
+#ifndef MACHINEVISION_RECURSIVEGAUSSIAN_H
+#define MACHINEVISION_RECURSIVEGAUSSIAN_H
+
+#include <opencv2/opencv.hpp>
+
+using namespace cv;
+
+class RecursiveGaussian {
+
+public:
+
+    /***********************************************************************************************
+     * Blur
+     *
+     * Blurs along both axes. Any depth and channel count is accepted; the filter runs in float.
+     * Sigmas below minimumSigma(), and images under four pixels along an axis, fall back to an
+     * exact Gaussian kernel on that axis.
+     *
+     * @param ddepth : Output depth, or -1 for the depth of src
+     **********************************************************************************************/
+    static void blur(const Mat& src, Mat& dst, double sigmaX, double sigmaY, int ddepth = -1);
+
+    /***********************************************************************************************
+     * Blur Rows / Blur Columns
+     *
+     * Blurs along one axis only: blurRows along each row (horizontally), blurColumns along each
+     * column (vertically). Running both is the same as blur().
+     **********************************************************************************************/
+    static void blurRows(const Mat& src, Mat& dst, double sigma, int ddepth = -1);
+    static void blurColumns(const Mat& src, Mat& dst, double sigma, int ddepth = -1);
+
+    // The smallest sigma the recursive approximation is defined for
+    static double minimumSigma() { return 0.5; }
+
+private:
+
+    // Runs the recursion down every column of a float image, in place
+    static void filterColumns(Mat& image, double sigma);
+
+    // Exact fallback for one axis: a sampled Gaussian kernel, as GaussianBlur() would use
+    static void kernelBlur(const Mat& src, Mat& dst, double sigma, bool rows, int ddepth);
+};
+
+
+#endif //MACHINEVISION_RECURSIVEGAUSSIAN_H
@@ -0,0 +1,514 @@
+/*******************************************************************************
+ * Task Scheduler Implementation
+ *
+ * @author Matthew Munson
+ * @date 5/11/2021
+ *
+ * Each deque has its own mutex. A chunk is a whole stripe of rows, so a task
+ * takes far longer to run than the lock takes to acquire, and the owner and a
+ * thief only meet on a deque's last few chunks. The scheduler-wide mutex is
+ * only used to put idle threads to sleep and to wake them.
+ *
+ * allocate()'s tasks wait in a deque of their own that thieves never look at.
+ * Every task at the back of a stealable deque can therefore be stolen, so a
+ * worker woken because tasks are queued always finds one, rather than spinning
+ * on a deque whose back it may not take.
+ *
+ * A task never touches its job after counting itself done: the thread waiting
+ * on the job may return (and destroy the job) the moment the count reaches
+ * zero.
+ *
+ ******************************************************************************/
+
+#include "TaskScheduler.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+using namespace cv;
+
+// Chunks per worker in parallelFor, enough to even out chunks of uneven cost
+static const int CHUNKS_PER_WORKER = 4;
+
+// How often a thread waiting on its job looks for work to steal, once there was none
+static const chrono::microseconds IDLE_WAIT(200);
+
+// Highest NUMA node number looked for in /sys
+static const int MAX_NODES = 64;
+
+static atomic<TaskScheduler*> installedScheduler(nullptr);
+
+// Which scheduler's worker the calling thread is, if any
+static thread_local const TaskScheduler* currentScheduler = nullptr;
+static thread_local int currentIndex = -1;
+
+struct TaskScheduler::job
+{
+    const function<void(const Range&)>* body;
+    atomic<int> remaining;
+
+    mutex errorLock;
+    exception_ptr error;
+};
+
+// Purpose: Parse a sysfs CPU list such as "0-3,8-11"
+// Preconditions: None
+// Postconditions: Returns the CPUs in the list, in order
+static vector<int> parseCpuList(const string& text)
+{
+    vector<int> cpus;
+    stringstream stream(text);
+    string part;
+
+    while(getline(stream, part, ','))
+    {
+        int first = 0, last = 0;
+        int fields = sscanf(part.c_str(), "%d-%d", &first, &last);
+
+        if(fields < 1)
+            continue;
+
+        if(fields == 1)
+            last = first;
+
+        for(int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+
+    return cpus;
+}
+
+vector<vector<int>> TaskScheduler::numaNodes()
+{
+    vector<vector<int>> nodes;
+
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool restricted = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+    for(int n = 0; n < MAX_NODES; n++)
+    {
+        ifstream file("/sys/devices/system/node/node" + to_string(n) + "/cpulist");
+        string text;
+
+        if(!file || !getline(file, text))
+            continue;
+
+        vector<int> cpus;
+
+        //Only CPUs this process may run on, so a container or taskset is respected
+        for(int cpu : parseCpuList(text))
+        {
+            if(!restricted || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)))
+                cpus.push_back(cpu);
+        }
+
+        //Memory-only nodes have no CPUs
+        if(!cpus.empty())
+            nodes.push_back(cpus);
+    }
+#endif
+
+    if(nodes.empty())
+    {
+        nodes.emplace_back();
+
+        for(int cpu = 0; cpu < max(1, getNumberOfCPUs()); cpu++)
+            nodes.back().push_back(cpu);
+    }
+
+    return nodes;
+}
+
+TaskScheduler::TaskScheduler() : TaskScheduler(options())
+{
+}
+
+TaskScheduler::TaskScheduler(const options& settings) : queued(0), stopping(false)
+{
+    int count = settings.threads > 0 ? settings.threads : max(1, getNumberOfCPUs());
+
+    //Every CPU in node order, and the node of each
+    vector<int> cpus;
+    vector<int> cpuNodes;
+    vector<vector<int>> nodes = numaNodes();
+
+    for(size_t n = 0; n < nodes.size(); n++)
+    {
+        for(int cpu : nodes[n])
+        {
+            cpus.push_back(cpu);
+            cpuNodes.push_back((int)n);
+        }
+    }
+
+    vector<int> workerCpus(count, -1);
+
+    for(int w = 0; w < count; w++)
+    {
+        workers.emplace_back(new worker());
+
+        if(settings.pin)
+        {
+            size_t slot = (size_t)(max(0, settings.firstCpu) + w) % cpus.size();
+            workerCpus[w] = cpus[slot];
+            workers[w]->node = cpuNodes[slot];
+        }
+    }
+
+    //Steal from workers on the same node first, nearest index first
+    for(int w = 0; w < count; w++)
+    {
+        for(int sameNode = 1; sameNode >= 0; sameNode--)
+        {
+            for(int k = 1; k < count; k++)
+            {
+                int victim = (w + k) % count;
+
+                if((workers[victim]->node == workers[w]->node) == (sameNode == 1))
+                    workers[w]->victims.push_back(victim);
+            }
+        }
+    }
+
+    for(int w = 0; w < count; w++)
+    {
+        int cpu = workerCpus[w];
+
+        workers[w]->thread = thread([this, w, cpu]()
+        {
+#ifdef __linux__
+            if(cpu >= 0)
+            {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(cpu, &set);
+                pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            }
+#else
+            (void)cpu;
+#endif
+            workerMain(w);
+        });
+    }
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    if(installed() == this)
+        install(nullptr);
+
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+
+    wake.notify_all();
+
+    for(unique_ptr<worker>& w : workers)
+        w->thread.join();
+}
+
+int TaskScheduler::threads() const
+{
+    return (int)workers.size();
+}
+
+int TaskScheduler::node(int worker) const
+{
+    return workers[worker]->node;
+}
+
+void TaskScheduler::install(TaskScheduler* scheduler)
+{
+    installedScheduler = scheduler;
+}
+
+TaskScheduler* TaskScheduler::installed()
+{
+    return installedScheduler;
+}
+
+int TaskScheduler::currentWorker() const
+{
+    return currentScheduler == this ? currentIndex : -1;
+}
+
+// Purpose: The loop run by each worker thread
+// Preconditions: index is this worker's slot
+// Postconditions: Runs tasks until the scheduler stops, sleeping while there are none it can take
+void TaskScheduler::workerMain(int index)
+{
+    currentScheduler = this;
+    currentIndex = index;
+
+    Trace::nameThread("scheduler worker " + to_string(index));
+
+    worker& self = *workers[index];
+
+    while(true)
+    {
+        if(runOne(index))
+            continue;
+
+        unique_lock<mutex> guard(lock);
+
+        //Tasks in our own deque count even when they may not be stolen
+        wake.wait(guard, [&]()
+        {
+            lock_guard<mutex> own(self.lock);
+            return stopping || queued > 0 || !self.tasks.empty() || !self.pinned.empty();
+        });
+
+        if(stopping)
+            return;
+    }
+}
+
+// Purpose: Run one task: our pinned ones, then the front of our deque, or the back of another's
+// Preconditions: self is a worker index of this scheduler, or -1 for any other thread
+// Postconditions: Returns false if no task could be taken
+bool TaskScheduler::runOne(int self)
+{
+    task next = {nullptr, Range(), false};
+    bool found = false;
+
+    if(self >= 0)
+    {
+        worker& own = *workers[self];
+        lock_guard<mutex> guard(own.lock);
+
+        deque<task>& tasks = own.pinned.empty() ? own.tasks : own.pinned;
+
+        if(!tasks.empty())
+        {
+            next = tasks.front();
+            tasks.pop_front();
+            found = true;
+        }
+    }
+
+    //Other threads start from a different worker each time, to spread where they steal
+    static thread_local size_t rotation = 0;
+    size_t start = rotation++;
+
+    size_t candidates = self >= 0 ? workers[self]->victims.size() : workers.size();
+
+    for(size_t k = 0; !found && k < candidates; k++)
+    {
+        int victim = self >= 0 ? workers[self]->victims[k] : (int)((start + k) % workers.size());
+
+        worker& other = *workers[victim];
+        lock_guard<mutex> guard(other.lock);
+
+        if(!other.tasks.empty())
+        {
+            next = other.tasks.back();
+            other.tasks.pop_back();
+            found = true;
+        }
+    }
+
+    if(!found)
+        return false;
+
+    if(next.stealable)
+        queued--;
+
+    runTask(next);
+
+    return true;
+}
+
+// Purpose: Run a task and count it done
+// Preconditions: next came off a deque
+// Postconditions: The first exception of the job is kept. The job is not touched once counted.
+void TaskScheduler::runTask(const task& next)
+{
+    job& work = *next.owner;
+
+    try
+    {
+        Trace::span trace("parallel chunk");
+        (*work.body)(next.range);
+    }
+    catch(...)
+    {
+        lock_guard<mutex> guard(work.errorLock);
+
+        if(!work.error)
+            work.error = current_exception();
+    }
+
+    if(work.remaining.fetch_sub(1) == 1)
+    {
+        lock_guard<mutex> guard(lock);
+        wake.notify_all();
+    }
+}
+
+// Purpose: Queue a job's tasks on the given workers and wait for them, running tasks meanwhile
+// Preconditions: work.remaining is the number of tasks in perWorker
+// Postconditions: Every task of the job has run. Rethrows the first exception a task threw.
+void TaskScheduler::runJob(job& work, vector<vector<task>>& perWorker, int self)
+{
+    int stealable = 0;
+
+    for(size_t w = 0; w < perWorker.size(); w++)
+    {
+        if(perWorker[w].empty())
+            continue;
+
+        lock_guard<mutex> guard(workers[w]->lock);
+
+        for(const task& next : perWorker[w])
+        {
+            (next.stealable ? workers[w]->tasks : workers[w]->pinned).push_back(next);
+            stealable += next.stealable ? 1 : 0;
+        }
+    }
+
+    {
+        lock_guard<mutex> guard(lock);
+        queued += stealable;
+    }
+
+    wake.notify_all();
+
+    //Help until the job is done. Once nothing can be taken, sleep and look again now and then.
+    while(work.remaining.load() > 0)
+    {
+        if(runOne(self))
+            continue;
+
+        unique_lock<mutex> guard(lock);
+        wake.wait_for(guard, IDLE_WAIT, [&]() { return work.remaining.load() == 0; });
+    }
+
+    if(work.error)
+        rethrow_exception(work.error);
+}
+
+void TaskScheduler::parallelFor(const Range& range,
+                                const function<void(const Range&)>& body,
+                                double nstripes)
+{
+    int length = range.size();
+    int count = (int)workers.size();
+
+    if(length <= 0)
+        return;
+
+    int chunks = nstripes > 0 ? max(1, min(length, cvRound(nstripes)))
+                              : min(length, count * CHUNKS_PER_WORKER);
+
+    if(chunks == 1)
+    {
+        body(range);
+        return;
+    }
+    int self = currentWorker();
+
+    job work;
+    work.body = &body;
+    work.remaining = chunks;
+
+    //Worker w gets the w-th contiguous block of chunks, so a given row always starts on the same
+    //worker. A call from inside a worker keeps its chunks, and idle workers steal them.
+    vector<vector<task>> perWorker(count);
+
+    for(int k = 0; k < chunks; k++)
+    {
+        Range chunk(range.start + (int)((long)length * k / chunks),
+                    range.start + (int)((long)length * (k + 1) / chunks));
+
+        int owner = self >= 0 ? self : (int)((long)k * count / chunks);
+        perWorker[owner].push_back({&work, chunk, true});
+    }
+
+    runJob(work, perWorker, self);
+}
+
+Mat TaskScheduler::allocate(int rows, int cols, int type)
+{
+    Mat image(rows, cols, type);
+    int count = (int)workers.size();
+
+    function<void(const Range&)> touch = [&](const Range& block)
+    {
+        for(int i = block.start; i < block.end; i++)
+            memset(image.ptr(i), 0, image.cols * image.elemSize());
+    };
+
+    job work;
+    work.body = &touch;
+    work.remaining = 0;
+
+    //The same split parallelFor starts from, one block per worker, which only that worker may run
+    vector<vector<task>> perWorker(count);
+
+    for(int w = 0; w < count; w++)
+    {
+        Range block((int)((long)rows * w / count), (int)((long)rows * (w + 1) / count));
+
+        if(block.size() > 0)
+        {
+            perWorker[w].push_back({&work, block, false});
+            work.remaining++;
+        }
+    }
+
+    runJob(work, perWorker, currentWorker());
+
+    return image;
+}
+
+void parallelFor(const Range& range, const function<void(const Range&)>& body, double nstripes)
+{
+    TaskScheduler* scheduler = TaskScheduler::installed();
+
+    if(scheduler)
+        scheduler->parallelFor(range, body, nstripes);
+    else if(Trace::enabled())
+    {
+        //OpenCV's threads are not ours to name, but their chunks still show occupancy
+        parallel_for_(range, [&](const Range& chunk)
+        {
+            Trace::span trace("parallel chunk");
+            body(chunk);
+        }, nstripes);
+    }
+    else
+        parallel_for_(range, body, nstripes);
+}
+
+int parallelThreads()
+{
+    TaskScheduler* scheduler = TaskScheduler::installed();
+
+    return scheduler ? scheduler->threads() : getNumThreads();
+}
+
+Mat allocateImage(int rows, int cols, int type)
+{
+    TaskScheduler* scheduler = TaskScheduler::installed();
+
+    if(scheduler)
+        return scheduler->allocate(rows, cols, type);
+
+    return Mat(rows, cols, type);
+}
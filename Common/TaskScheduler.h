@@ -0,0 +1,167 @@
+/*******************************************************************************
+ * Task Scheduler Signatures
+ *
+ * @author Matthew Munson
+ * @date 5/11/2021
+ *
+ * A work-stealing thread pool owned by the project, as an alternative to
+ * OpenCV's global pool for the kernels in this repository. OpenCV's pool has
+ * no notion of where its threads run, so on a machine with several NUMA nodes
+ * the rows of an image bounce between nodes from one kernel to the next.
+ *
+ * Each worker thread has its own deque of tasks. parallelFor() splits a range
+ * into chunks and gives each worker a contiguous block of them, so the same
+ * rows go to the same worker every time. A worker takes chunks from the front
+ * of its own block. Once its deque is empty it steals from the back of
+ * another worker's, trying workers on its own node first. The thread calling
+ * parallelFor() steals chunks too, until every chunk of its call is done.
+ *
+ * With pinning, workers are bound to CPUs in NUMA node order (read from
+ * /sys/devices/system/node), so contiguous blocks of rows stay on one node.
+ * allocate() places a new image near the workers that will process it. Linux
+ * places a page on the node of the thread that first writes it, so allocate()
+ * has each worker write its own block of rows.
+ *
+ * Kernels call the free function parallelFor(), which runs on the installed
+ * scheduler, or on OpenCV's pool when none is installed:
+ *
+ *     TaskScheduler scheduler({0, true});
+ *     TaskScheduler::install(&scheduler);
+ *
+ * Header file documentation is user-focused. For implementation-level comments
+ * see TaskScheduler.cpp
+ *
+ ******************************************************************************/
+
+#ifndef MACHINEVISION_TASKSCHEDULER_H
+#define MACHINEVISION_TASKSCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <thread>
+#include <vector>
+
+using namespace cv;
+
+class TaskScheduler {
+
+public:
+
+    struct options
+    {
+        int threads = 0;        // Worker threads. Zero uses one per CPU.
+        bool pin = false;       // Bind each worker to one CPU, in NUMA node order
+        int firstCpu = 0;       // With pin, workers take CPUs starting from this one in node order
+    };
+
+    TaskScheduler();
+    explicit TaskScheduler(const options& settings);
+
+    // Waits for the workers to finish their current tasks and stops them
+    ~TaskScheduler();
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    /***********************************************************************************************
+     * Parallel For
+     *
+     * Runs body over the range in chunks across the workers, as cv::parallel_for_ does, and
+     * returns once every chunk has run. May be called from any thread, including from inside
+     * another call's body. The first exception thrown by a chunk is rethrown here.
+     *
+     * @param nstripes : How many chunks to split the range into, as for cv::parallel_for_. Zero or
+     *                   less uses a few per worker.
+     **********************************************************************************************/
+    void parallelFor(const Range& range,
+                     const std::function<void(const Range&)>& body,
+                     double nstripes = -1);
+
+    /***********************************************************************************************
+     * Allocate
+     *
+     * A new image whose rows are first written by the workers parallelFor() would give them to,
+     * so each block of rows is placed on the node of the worker that processes it. The image is
+     * zeroed.
+     **********************************************************************************************/
+    Mat allocate(int rows, int cols, int type);
+
+    int threads() const;
+
+    // The NUMA node worker w is bound to, or -1 without pinning
+    int node(int worker) const;
+
+    // Makes parallelFor() and allocateImage() use this scheduler. Pass nullptr to go back to
+    // OpenCV's pool. The scheduler must outlive its installation.
+    static void install(TaskScheduler* scheduler);
+    static TaskScheduler* installed();
+
+    // The CPUs of each NUMA node. A machine without NUMA information is one node of every CPU.
+    static std::vector<std::vector<int>> numaNodes();
+
+private:
+
+    struct job;
+
+    struct task
+    {
+        job* owner;
+        Range range;
+        bool stealable;         // allocate()'s tasks must run on the worker they were given to
+    };
+
+    struct worker
+    {
+        std::mutex lock;
+        std::deque<task> tasks;     // Stealable tasks
+        std::deque<task> pinned;    // allocate()'s tasks, which only this worker takes
+        std::vector<int> victims;   // Workers to steal from, same node first
+        int node = -1;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<worker>> workers;
+
+    // Guards sleeping and waking; the deques have their own locks
+    std::mutex lock;
+    std::condition_variable wake;
+    std::atomic<int> queued;
+    bool stopping;
+
+    void workerMain(int index);
+
+    // Runs one task: from the worker's own deque, or stolen. self is -1 for other threads.
+    bool runOne(int self);
+
+    void runTask(const task& next);
+
+    // Queues a job's tasks and helps run tasks until the job is done
+    void runJob(job& work, std::vector<std::vector<task>>& perWorker, int self);
+
+    // The worker the calling thread is in this scheduler, or -1
+    int currentWorker() const;
+};
+
+/***************************************************************************************************
+ * Parallel For / Parallel Threads / Allocate Image
+ *
+ * parallelFor() runs on the installed scheduler, or on cv::parallel_for_ when none is installed.
+ * parallelThreads() is the number of threads parallelFor() runs on. Size stripes by it, not by
+ * cv::getNumThreads(), so the rows allocateImage() gave a worker are the rows it is handed.
+ * allocateImage() uses the installed scheduler's allocate(), or allocates an uninitialized Mat.
+ **************************************************************************************************/
+void parallelFor(const Range& range,
+                 const std::function<void(const Range&)>& body,
+                 double nstripes = -1);
+
+int parallelThreads();
+
+Mat allocateImage(int rows, int cols, int type);
+
+
+#endif //MACHINEVISION_TASKSCHEDULER_H
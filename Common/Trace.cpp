@@ -0,0 +1,388 @@
+/*******************************************************************************
+ * Trace Implementation
+ *
+ * @author Matthew Munson
+ * @date 5/13/2021
+ *
+ * Each thread's ring buffer has its own mutex, which only that thread and an
+ * export ever take, so recording never waits on another recording thread.
+ * Rings grow as events arrive, up to their capacity, so threads that record
+ * a few spans (such as short-lived connection threads) stay small. A thread
+ * marks its ring exited as it ends; a write drops exited rings once their
+ * events are out, and past MAX_EXITED_THREADS the oldest is dropped unwritten.
+ *
+ * The registry of rings is guarded by one mutex, taken when a thread records
+ * for the first time and during export. A fork handler holds it across fork()
+ * so the child never inherits it locked. The child keeps only the forking
+ * thread's ring, emptied: the other threads do not exist there, and the
+ * parent's events belong to the parent's trace.
+ *
+ * Events are written as complete events ("ph":"X") with timestamps in
+ * microseconds, and each named thread gets a thread_name metadata event.
+ *
+ ******************************************************************************/
+
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <sstream>
+#include <unistd.h>
+
+using namespace std;
+
+struct traceEvent
+{
+    const char* name;
+    string detail;
+    int64_t start;
+    int64_t duration;
+};
+
+struct threadBuffer
+{
+    mutex lock;
+    vector<traceEvent> events;
+    size_t capacity = 0;
+    size_t next = 0;            // Where the next event goes once the ring is full
+    int thread = 0;
+    string name;
+    bool exited = false;        // Guarded by the registry lock
+};
+
+struct traceRegistry
+{
+    mutex lock;
+    vector<shared_ptr<threadBuffer>> buffers;
+    int nextThread = 1;
+};
+
+static atomic<bool> recording(false);
+static atomic<size_t> eventsPerThread(Trace::DEFAULT_EVENTS);
+
+// The calling thread's ring, marked exited when the thread ends
+struct bufferOwner
+{
+    threadBuffer* buffer = nullptr;
+    ~bufferOwner();
+};
+
+static thread_local bufferOwner current;
+
+// Purpose: The registry, built on first use so spans in static initializers are safe
+// Preconditions: None
+// Postconditions: None
+static traceRegistry& getRegistry()
+{
+    static traceRegistry* state = new traceRegistry();
+    return *state;
+}
+
+static int64_t now()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool hasExited(const shared_ptr<threadBuffer>& ring)
+{
+    return ring->exited;
+}
+
+// Purpose: The calling thread's ring buffer
+// Preconditions: None
+// Postconditions: The buffer is registered, so it outlives the thread
+static threadBuffer& getBuffer()
+{
+    if(current.buffer)
+        return *current.buffer;
+
+    shared_ptr<threadBuffer> buffer = make_shared<threadBuffer>();
+    buffer->capacity = max<size_t>(1, eventsPerThread.load());
+
+    traceRegistry& state = getRegistry();
+    lock_guard<mutex> guard(state.lock);
+
+    buffer->thread = state.nextThread++;
+    state.buffers.push_back(buffer);
+
+    current.buffer = buffer.get();
+    return *current.buffer;
+}
+
+// Purpose: Hand an ending thread's ring over to the next write
+// Preconditions: Runs as the thread exits
+// Postconditions: The ring is marked exited. Past MAX_EXITED_THREADS, the oldest exited ring is
+//                 dropped.
+bufferOwner::~bufferOwner()
+{
+    if(!buffer)
+        return;
+
+    traceRegistry& state = getRegistry();
+    lock_guard<mutex> guard(state.lock);
+
+    buffer->exited = true;
+    buffer = nullptr;
+
+    //Rings are registered in order, so the first exited one is the oldest
+    if((size_t)count_if(state.buffers.begin(), state.buffers.end(), hasExited) >
+       Trace::MAX_EXITED_THREADS)
+        state.buffers.erase(find_if(state.buffers.begin(), state.buffers.end(), hasExited));
+}
+
+// Purpose: Add an event to the calling thread's ring
+// Preconditions: None
+// Postconditions: The oldest event is overwritten if the ring is full
+static void record(const char* name, string& detail, int64_t start, int64_t end)
+{
+    threadBuffer& buffer = getBuffer();
+    lock_guard<mutex> guard(buffer.lock);
+
+    if(buffer.events.size() < buffer.capacity)
+    {
+        buffer.events.push_back({name, string(), start, end - start});
+        buffer.events.back().detail.swap(detail);
+        return;
+    }
+
+    traceEvent& slot = buffer.events[buffer.next];
+    slot.name = name;
+    slot.detail.swap(detail);
+    slot.start = start;
+    slot.duration = end - start;
+
+    buffer.next = (buffer.next + 1) % buffer.capacity;
+}
+
+static void lockBeforeFork()
+{
+    getRegistry().lock.lock();
+}
+
+static void unlockInParent()
+{
+    getRegistry().lock.unlock();
+}
+
+// Purpose: Start the child's trace from nothing
+// Preconditions: The registry lock was taken before the fork
+// Postconditions: Only the forking thread's ring is kept, and it is empty
+static void resetInChild()
+{
+    traceRegistry& state = getRegistry();
+    vector<shared_ptr<threadBuffer>> kept;
+
+    for(shared_ptr<threadBuffer>& buffer : state.buffers)
+    {
+        if(buffer.get() == current.buffer)
+        {
+            buffer->events.clear();
+            buffer->next = 0;
+            kept.push_back(buffer);
+        }
+    }
+
+    state.buffers.swap(kept);
+    state.lock.unlock();
+}
+
+// Purpose: Quote a string for JSON
+// Preconditions: None
+// Postconditions: Control characters are escaped, other bytes are copied as they are
+static void writeString(ostream& out, const string& text)
+{
+    out << '"';
+
+    for(unsigned char c : text)
+    {
+        if(c == '"' || c == '\\')
+            out << '\\' << c;
+        else if(c < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out << escaped;
+        }
+        else
+            out << c;
+    }
+
+    out << '"';
+}
+
+// Purpose: Write every event of this process as JSON objects separated by commas
+// Preconditions: None
+// Postconditions: first is false once anything has been written. Exited threads' rings are
+//                 dropped.
+static void writeEvents(ostream& out, bool& first)
+{
+    traceRegistry& state = getRegistry();
+    lock_guard<mutex> guard(state.lock);
+
+    int pid = (int)getpid();
+    char numbers[96];
+
+    for(shared_ptr<threadBuffer>& buffer : state.buffers)
+    {
+        lock_guard<mutex> own(buffer->lock);
+
+        if(!buffer->name.empty())
+        {
+            out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+                << ",\"tid\":" << buffer->thread << ",\"args\":{\"name\":";
+            writeString(out, buffer->name);
+            out << "}}";
+            first = false;
+        }
+
+        //Oldest first: once the ring has wrapped, the oldest event is the next to be overwritten
+        size_t count = buffer->events.size();
+
+        for(size_t k = 0; k < count; k++)
+        {
+            const traceEvent& event = buffer->events[(buffer->next + k) % count];
+
+            snprintf(numbers, sizeof(numbers), "\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                     pid, buffer->thread, event.start / 1000.0, event.duration / 1000.0);
+
+            out << (first ? "" : ",\n") << "{\"name\":";
+            writeString(out, event.name);
+            out << ",\"ph\":\"X\"," << numbers;
+
+            if(!event.detail.empty())
+            {
+                out << ",\"args\":{\"detail\":";
+                writeString(out, event.detail);
+                out << "}";
+            }
+
+            out << "}";
+            first = false;
+        }
+    }
+
+    //Exited threads will add nothing more
+    state.buffers.erase(remove_if(state.buffers.begin(), state.buffers.end(), hasExited),
+                        state.buffers.end());
+}
+
+// Purpose: Write a file through a temporary file and a rename, as Metrics::writeFile does
+// Preconditions: None
+// Postconditions: Returns false, leaving no temporary file, if anything failed
+static bool replaceFile(const string& path, const string& contents)
+{
+    string temporary = path + ".tmp." + to_string(getpid());
+
+    {
+        ofstream file(temporary, ios::binary);
+        file << contents;
+
+        if(!file)
+        {
+            unlink(temporary.c_str());
+            return false;
+        }
+    }
+
+    if(rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        unlink(temporary.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+Trace::span::span(const char* name) : name(name), start(recording.load() ? now() : -1)
+{
+}
+
+Trace::span::span(const char* name, const string& detail) : span(name)
+{
+    if(start >= 0)
+        this->detail = detail;
+}
+
+void Trace::span::end()
+{
+    if(start < 0)
+        return;
+
+    record(name, detail, start, now());
+    start = -1;
+}
+
+void Trace::enable(size_t events)
+{
+    static once_flag installed;
+    call_once(installed, []() { pthread_atfork(lockBeforeFork, unlockInParent, resetInChild); });
+
+    eventsPerThread = events;
+    recording = true;
+}
+
+bool Trace::enabled()
+{
+    return recording.load();
+}
+
+void Trace::nameThread(const string& name)
+{
+    if(!enabled())
+        return;
+
+    threadBuffer& buffer = getBuffer();
+    lock_guard<mutex> guard(buffer.lock);
+
+    buffer.name = name;
+}
+
+bool Trace::writeFile(const string& path, const vector<string>& parts)
+{
+    ostringstream out;
+    bool first = true;
+
+    out << "{\"traceEvents\":[\n";
+    writeEvents(out, first);
+
+    for(const string& part : parts)
+    {
+        ifstream file(part, ios::binary);
+
+        if(!file)
+            continue;
+
+        stringstream contents;
+        contents << file.rdbuf();
+
+        if(!contents.str().empty())
+        {
+            out << (first ? "" : ",\n") << contents.str();
+            first = false;
+        }
+
+        file.close();
+        unlink(part.c_str());
+    }
+
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    return replaceFile(path, out.str());
+}
+
+bool Trace::writePart(const string& path)
+{
+    ostringstream out;
+    bool first = true;
+
+    writeEvents(out, first);
+
+    return replaceFile(path, out.str());
+}
@@ -0,0 +1,115 @@
+/*******************************************************************************
+ * Trace Signatures
+ *
+ * @author Matthew Munson
+ * @date 5/13/2021
+ *
+ * Optional span tracing, written out in the Chrome trace-event format for
+ * chrome://tracing or Perfetto. Metrics (see Metrics.h) say how long each
+ * stage takes on average; a trace shows when each stage of each job ran and on
+ * which thread, so stalls, idle threads and pipeline bubbles can be seen.
+ *
+ * A span times the scope it is declared in:
+ *
+ *     Trace::span trace("decode");
+ *
+ * Tracing is off until enable() is called. A span then costs one atomic load
+ * and nothing else, so spans are left in place around stages and jobs, but not
+ * inside per-pixel loops.
+ *
+ * Each thread records into its own ring buffer, so recording takes no shared
+ * lock. A ring keeps the latest events once it is full. A ring outlives its
+ * thread until the trace is next written, and is then dropped. Only the rings
+ * of the latest MAX_EXITED_THREADS exited threads are kept, so a server that
+ * starts a thread per connection does not grow without bound.
+ *
+ * Timestamps come from the monotonic clock, which is shared across processes,
+ * so the parts written by forked workers (writePart) line up when merged into
+ * one trace (writeFile).
+ *
+ * Header file documentation is user-focused. For implementation-level comments
+ * see Trace.cpp
+ *
+ ******************************************************************************/
+
+#ifndef MACHINEVISION_TRACE_H
+#define MACHINEVISION_TRACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Trace {
+
+public:
+
+    // Events each thread keeps by default, about a megabyte per busy thread
+    static const size_t DEFAULT_EVENTS = 16384;
+
+    // Exited threads whose rings are kept for the next write
+    static const size_t MAX_EXITED_THREADS = 256;
+
+    // Records a span from construction until end() or destruction
+    class span
+    {
+    public:
+        explicit span(const char* name);
+
+        // detail is shown in the viewer's arguments pane, for example the job line
+        span(const char* name, const std::string& detail);
+
+        ~span() { end(); }
+
+        span(const span&) = delete;
+        span& operator=(const span&) = delete;
+
+        // Ends the span early. Later calls do nothing.
+        void end();
+
+    private:
+        const char* name;       // Must outlive the trace, normally a string literal
+        std::string detail;
+        int64_t start;          // Nanoseconds, or -1 when not recording
+    };
+
+    /***********************************************************************************************
+     * Enable
+     *
+     * Starts recording spans in every thread of this process, and in processes it forks
+     * afterwards. A forked child starts with empty buffers.
+     *
+     * @param eventsPerThread : Ring buffer size. Only takes effect for threads that have not
+     *                          recorded yet.
+     **********************************************************************************************/
+    static void enable(size_t eventsPerThread = DEFAULT_EVENTS);
+
+    static bool enabled();
+
+    // Names the calling thread in the viewer. Does nothing while tracing is off.
+    static void nameThread(const std::string& name);
+
+    /***********************************************************************************************
+     * Write File
+     *
+     * Writes this process's events, followed by the events of each part file, as one Chrome
+     * trace. Part files are deleted once merged; missing ones, such as those of crashed workers,
+     * are skipped.
+     *
+     * @return False if the file could not be written
+     **********************************************************************************************/
+    static bool writeFile(const std::string& path, const std::vector<std::string>& parts = {});
+
+    /***********************************************************************************************
+     * Write Part
+     *
+     * Writes this process's events for a later writeFile() in another process to merge. A part
+     * file on its own is not a valid trace.
+     *
+     * @return False if the file could not be written
+     **********************************************************************************************/
+    static bool writePart(const std::string& path);
+};
+
+
+#endif //MACHINEVISION_TRACE_H
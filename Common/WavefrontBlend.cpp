@@ -0,0 +1,155 @@
+/***************************************************************************************************
+ * Wavefront Blend Implementation
+ *
+ * @author Matthew Munson
+ * @date 4/30/2021
+ *
+ * Implementation file for the WavefrontBlend class. Functions include:
+ *
+ *     - void blendBlock(uchar* top, size_t step, int col)
+ *     - void apply(Mat& image)
+ *     - void applySequential(Mat& image)
+ *     - void blendTile(Mat& image, int band, int span)
+ *
+ * A block is identified by its top-left pixel (i, j) and exists for i <= rows - 3 and
+ * j <= cols - 3. Band b holds the rows from b * TILE_ROWS, and within it a block's wavefront
+ * position is t = 3 * (i - b * TILE_ROWS) + j, counted from the band's first row so that every
+ * band has the same spans. Tile (band, span) holds the blocks of a band with t / TILE_SPAN == span.
+ *
+ * A block only depends on blocks at most two rows up and two columns right, so a tile depends on
+ * the tile to its left and on tiles of the band above up to lag = ceil(3 * TILE_ROWS / TILE_SPAN)
+ * spans further right, since the band above counts t from 3 * TILE_ROWS rows' worth earlier. The
+ * tiles with span + (lag + 1) * band == d can therefore all run at once once every earlier d has
+ * finished. Each wave holds one tile from every (lag + 1)-th band that has reached it, around
+ * cols / (TILE_SPAN + 3 * TILE_ROWS) of them for a tall image. Only those tiles are dispatched.
+ *
+ **************************************************************************************************/
+
+#include "WavefrontBlend.h"
+
+#include "TaskScheduler.h"
+
+using namespace std;
+using namespace cv;
+
+// Purpose: Blend one 3x3 block, exactly as Playgrounds/main.cpp does
+// Preconditions: top points at the first row of the block, col <= cols - 3
+// Postconditions: Each of the nine pixels becomes (pixel + block average) / 2, per channel, using
+//                 integer division as the original does
+static inline void blendBlock(uchar* top, size_t step, int col)
+{
+    for(int c = 0; c < 3; c++)
+    {
+        int sum = 0;
+
+        for(int r = 0; r < 3; r++)
+        {
+            const uchar* pixel = top + r * step + col * 3 + c;
+
+            sum += pixel[0] + pixel[3] + pixel[6];
+        }
+
+        int average = sum / 9;
+
+        for(int r = 0; r < 3; r++)
+        {
+            uchar* pixel = top + r * step + col * 3 + c;
+
+            pixel[0] = (uchar)((pixel[0] + average) / 2);
+            pixel[3] = (uchar)((pixel[3] + average) / 2);
+            pixel[6] = (uchar)((pixel[6] + average) / 2);
+        }
+    }
+}
+
+// Purpose: Reference single-threaded blend
+// Preconditions: image is CV_8UC3
+// Postconditions: image is blended in place
+void WavefrontBlend::applySequential(Mat& image)
+{
+    CV_Assert(image.type() == CV_8UC3);
+
+    for(int i = 0; i + 2 < image.rows; i++)
+    {
+        uchar* top = image.ptr<uchar>(i);
+
+        for(int j = 0; j + 2 < image.cols; j++)
+            blendBlock(top, image.step, j);
+    }
+}
+
+// Purpose: Parallel blend along anti-diagonal wavefronts of tiles
+// Preconditions: image is CV_8UC3
+// Postconditions: image is blended in place, identically to applySequential
+void WavefrontBlend::apply(Mat& image)
+{
+    CV_Assert(image.type() == CV_8UC3);
+
+    if(image.rows < 3 || image.cols < 3)
+        return;
+
+    int blockRows = image.rows - 2;
+    int blockCols = image.cols - 2;
+
+    int bands = (blockRows + TILE_ROWS - 1) / TILE_ROWS;
+    int lag = (3 * TILE_ROWS + TILE_SPAN - 1) / TILE_SPAN;
+
+    //Spans of each band. The last band may have fewer rows, and so fewer spans.
+    vector<int> spans(bands);
+    int lastWave = 0;
+
+    for(int band = 0; band < bands; band++)
+    {
+        int rows = min(TILE_ROWS, blockRows - band * TILE_ROWS);
+
+        spans[band] = (3 * (rows - 1) + blockCols - 1) / TILE_SPAN + 1;
+        lastWave = max(lastWave, spans[band] - 1 + (lag + 1) * band);
+    }
+
+    vector<Point> tiles;
+
+    for(int d = 0; d <= lastWave; d++)
+    {
+        //Only the bands that have reached this wave and not yet finished
+        tiles.clear();
+
+        for(int band = 0; band < bands && (lag + 1) * band <= d; band++)
+        {
+            int span = d - (lag + 1) * band;
+
+            if(span < spans[band])
+                tiles.push_back(Point(span, band));
+        }
+
+        parallelFor(Range(0, (int)tiles.size()), [&](const Range& range)
+        {
+            for(int k = range.start; k < range.end; k++)
+                blendTile(image, tiles[k].y, tiles[k].x);
+        }, (double)tiles.size());
+    }
+}
+
+// Purpose: Blend every block of one tile in row-major order
+// Preconditions: Every tile this one depends on has been blended
+// Postconditions: The tile's blocks are blended
+void WavefrontBlend::blendTile(Mat& image, int band, int span)
+{
+    int blockRows = image.rows - 2;
+    int blockCols = image.cols - 2;
+
+    int firstRow = band * TILE_ROWS;
+    int lastRow = min(firstRow + TILE_ROWS, blockRows);
+
+    for(int i = firstRow; i < lastRow; i++)
+    {
+        // Columns of this row whose wavefront position falls inside the span
+        int shift = 3 * (i - firstRow);
+        int firstCol = max(0, span * TILE_SPAN - shift);
+        int lastCol = min(blockCols, (span + 1) * TILE_SPAN - shift);
+
+        uchar* top = image.ptr<uchar>(i);
+
+        for(int j = firstCol; j < lastCol; j++)
+            blendBlock(top, image.step, j);
+    }
+}
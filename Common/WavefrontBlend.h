@@ -0,0 +1,72 @@
+/*******************************************************************************
+ * Wavefront Blend Signatures
+ *
+ * @author Matthew Munson
+ * @date 4/30/2021
+ *
+ * Parallel version of the neighbourhood blend kernel from Playgrounds/main.cpp.
+ * For every pixel, that kernel averages the 3x3 block whose top-left corner is
+ * the pixel and then pulls each of the nine pixels halfway toward the average,
+ * writing the block back into the image before moving on. Each block therefore
+ * reads pixels already modified by the blocks to its left and above.
+ *
+ * The result is reproduced bit for bit by scheduling blocks along anti-diagonal
+ * wavefronts. Two blocks share pixels only when they are within two rows and
+ * two columns of each other, and for any such pair the one processed first in
+ * row-major order has a smaller value of 3 * row + column. Blocks are grouped
+ * into cache-sized tiles (a band of rows by a range of 3 * row + column,
+ * counted from the band's first row), tiles on the same wavefront are
+ * independent, and each tile runs row-major inside. Each band trails the one
+ * above by a tile or two, so a wavefront holds about cols / 200 tiles.
+ *
+ * Header file documentation is user-focused. For implementation-level comments
+ * see WavefrontBlend.cpp
+ *
+ ******************************************************************************/
+
+#ifndef MACHINEVISION_WAVEFRONTBLEND_H
+#define MACHINEVISION_WAVEFRONTBLEND_H
+
+#include <opencv2/opencv.hpp>
+
+using namespace cv;
+
+class WavefrontBlend {
+
+public:
+
+    /***********************************************************************************************
+     * Apply
+     *
+     * Runs the blend over the whole image in place, in parallel. The result is identical to the
+     * single-threaded loop in Playgrounds/main.cpp.
+     *
+     * @param image : A BGR image (CV_8UC3), modified in place
+     **********************************************************************************************/
+    static void apply(Mat& image);
+
+    /***********************************************************************************************
+     * Apply Sequential
+     *
+     * The same blend on a single thread, in the original row-major order. Kept as the reference
+     * that apply() must match.
+     *
+     * @param image : A BGR image (CV_8UC3), modified in place
+     **********************************************************************************************/
+    static void applySequential(Mat& image);
+
+private:
+
+    // Block rows per tile
+    static const int TILE_ROWS = 32;
+
+    // Width of a tile along the wavefront axis (3 * row + column). Narrow tiles let more bands
+    // run at once, since each band trails the one above by 3 * TILE_ROWS columns.
+    static const int TILE_SPAN = 96;
+
+    // Blends the tile at (band, span) of the tile grid
+    static void blendTile(Mat& image, int band, int span);
+};
+
+
+#endif //MACHINEVISION_WAVEFRONTBLEND_H
@@ -0,0 +1,334 @@
+/***************************************************************************************************
+ * Reference Implementations
+ *
+ * @author Matthew Munson
+ * @date 5/1/2021
+ *
+ * The original implementations, copied as they were before any optimization work. Only names and
+ * the odd memory leak have changed, plus one bug fix noted at imgProcessing. See Reference.h.
+ *
+ **************************************************************************************************/
+
+#include "Reference.h"
+
+using namespace std;
+using namespace cv;
+
+/***************************************************************************************************
+ * PROGRAM II
+ **************************************************************************************************/
+
+Vec3i Reference::getMostCommonColor(const Mat& image, int buckets)
+{
+    int dims[] = {buckets, buckets, buckets};
+    Mat hist(3, dims, CV_32S, Scalar::all(0));
+
+    //Initialize all loop variables
+    int blue, green, red, x, y, z, bucketSize;
+    Vec3b pixel;
+
+    for(int i = 0; i < image.rows; i++)
+    {
+        for(int j = 0; j < image.cols; j++)
+        {
+            pixel = image.at<Vec3b>(i, j);
+
+            blue = pixel[0];
+            green = pixel[1];
+            red = pixel[2];
+
+            bucketSize = 256 / buckets;
+            x = red / bucketSize;
+            y = green / bucketSize;
+            z = blue / bucketSize;
+
+            hist.at<int>(z, y, x)++;
+        }
+    }
+
+    return findMaxBucket(hist, buckets);
+}
+
+Vec3i Reference::findMaxBucket(const Mat& hist, int buckets)
+{
+    Vec3i mostCommonColor = Vec3i(0,0,0);
+
+    int max = 0;
+
+    for(int i = 0; i < buckets; i++)
+    {
+        for(int j = 0; j < buckets; j++)
+        {
+            for(int k = 0; k < buckets; k++)
+            {
+                int count = hist.at<int>(i, j, k);
+
+                if(count > max)
+                {
+                    max = count;
+
+                    mostCommonColor = Vec3i(i * (256 / buckets),
+                                            j * (256 / buckets),
+                                            k * (256 / buckets));
+                }
+            }
+        }
+    }
+
+    return mostCommonColor;
+}
+
+Mat Reference::overlayBackground(const Mat& foreground,
+                                 const Mat& background,
+                                 const Vec3i& mostCommonColor,
+                                 int threshold)
+{
+    Mat overlay = Mat();
+    foreground.copyTo(overlay);
+
+    for(int i = 0; i < overlay.rows; i++)
+    {
+        for(int j = 0; j < overlay.cols; j++)
+        {
+            Vec3b pixel = overlay.at<Vec3b>(i, j);
+
+            if(abs(pixel[0] - mostCommonColor[0]) < threshold &&
+               abs(pixel[1] - mostCommonColor[1]) < threshold &&
+               abs(pixel[2] - mostCommonColor[2]) < threshold)
+            {
+
+                pixel = background.at<Vec3b>(i % background.rows, j % background.cols);
+
+                overlay.at<Vec3b>(i, j) = pixel;
+            }
+        }
+    }
+
+    return overlay;
+}
+
+// Not an original implementation: the straightforward two-pass version of the fused YCbCr keyer,
+// converting the whole image with cvtColor first
+Mat Reference::overlayBackgroundYCbCr(const Mat& foreground,
+                                      const Mat& background,
+                                      const Vec3i& mostCommonColor,
+                                      int lumaThreshold,
+                                      int chromaThreshold)
+{
+    Mat overlay = Mat();
+    foreground.copyTo(overlay);
+
+    Mat converted = Mat();
+    cvtColor(foreground, converted, COLOR_BGR2YCrCb);
+
+    Mat key(1, 1, CV_8UC3, Scalar(mostCommonColor[0], mostCommonColor[1], mostCommonColor[2]));
+    cvtColor(key, key, COLOR_BGR2YCrCb);
+    Vec3b keyColor = key.at<Vec3b>(0, 0);
+
+    for(int i = 0; i < overlay.rows; i++)
+    {
+        for(int j = 0; j < overlay.cols; j++)
+        {
+            Vec3b pixel = converted.at<Vec3b>(i, j);
+
+            if(abs(pixel[0] - keyColor[0]) < lumaThreshold &&
+               abs(pixel[1] - keyColor[1]) < chromaThreshold &&
+               abs(pixel[2] - keyColor[2]) < chromaThreshold)
+            {
+                overlay.at<Vec3b>(i, j) = background.at<Vec3b>(i % background.rows,
+                                                               j % background.cols);
+            }
+        }
+    }
+
+    return overlay;
+}
+
+/***************************************************************************************************
+ * PROGRAM I
+ **************************************************************************************************/
+
+// The original flipped with code 0, which only flips vertically, although the example is documented
+// as a 180 degree rotation. Corrected to -1 (both axes) together with Program1::imgProcessing.
+Mat Reference::imgProcessing(const Mat& image)
+{
+    Mat copy = Mat();
+
+    flip(image, copy, -1);
+
+    cvtColor(copy, copy, COLOR_BGR2GRAY);
+
+    GaussianBlur(copy,
+                 copy,
+                 Size(0,0),
+                 2.0,
+                 2.0);
+
+    Canny(copy, copy, 20, 60);
+
+    return copy;
+}
+
+Mat Reference::flipToGray(const Mat& image, int flipCode)
+{
+    Mat copy = Mat();
+
+    flip(image, copy, flipCode);
+
+    cvtColor(copy, copy, COLOR_BGR2GRAY);
+
+    return copy;
+}
+
+Mat Reference::blur(const Mat& image, Size size, double sigmaX, double sigmaY)
+{
+    Mat copy = Mat();
+
+    GaussianBlur(image, copy, size, sigmaX, sigmaY);
+
+    return copy;
+}
+
+Mat Reference::canny(const Mat& image, double threshold1, double threshold2)
+{
+    Mat copy = Mat();
+
+    Canny(image, copy, threshold1, threshold2);
+
+    return copy;
+}
+
+Mat Reference::additionalImageEffects(const Mat& image)
+{
+    Mat inverted;
+
+    bitwise_not(image, inverted);
+
+    convertScaleAbs(inverted, inverted, 2.0);
+
+    return inverted;
+}
+
+/***************************************************************************************************
+ * PLAYGROUNDS
+ **************************************************************************************************/
+
+static void getSurrounding(const Mat& input, int i, int j, Vec3b* retVal)
+{
+    int row = 0;
+    int column = 0;
+
+    for(int k = 0; k < 9; k++)
+    {
+        retVal[k] = input.at<Vec3b>(i + row, j + column);
+
+        column++;
+
+        if(column > 2)
+        {
+            column = 0;
+            row++;
+        }
+    }
+}
+
+static void setSurrounding(Mat &input, int i, int j, const Vec3b* values)
+{
+    int row = 0;
+    int column = 0;
+
+    for(int k = 0; k < 9; k++)
+    {
+        input.at<Vec3b>(i + row, j + column) = values[k];
+
+        column++;
+
+        if(column > 2)
+        {
+            column = 0;
+            row++;
+        }
+    }
+}
+
+void Reference::blendNeighbourhoods(Mat& test)
+{
+    Vec3b surrounding[9];
+
+    for(int i = 0; i < test.rows; i += 1)
+    {
+        if(i + 2 >= test.rows)
+            continue;
+
+        for(int j = 0; j < test.cols; j += 1)
+        {
+            if(j + 2 >= test.cols)
+                continue;
+
+            getSurrounding(test, i, j, surrounding);
+
+            int avg_red = 0;
+            int avg_green = 0;
+            int avg_blue = 0;
+
+            for(int k = 0; k < 9; k++)
+            {
+                Vec3b intensity = surrounding[k];
+
+                avg_blue += intensity.val[0];
+                avg_green += intensity.val[1];
+                avg_red += intensity.val[2];
+            }
+
+            avg_blue /= 9;
+            avg_green /= 9;
+            avg_red /= 9;
+
+            for(int k = 0; k < 9; k++)
+            {
+                Vec3b intensity = surrounding[k];
+
+                intensity.val[0] = (intensity.val[0] + avg_blue) / 2;
+                intensity.val[1] = (intensity.val[1] + avg_green) / 2;
+                intensity.val[2] = (intensity.val[2] + avg_red) / 2;
+
+                surrounding[k] = intensity;
+            }
+
+            setSurrounding(test, i, j, surrounding);
+        }
+    }
+}
+
+int Reference::recolorDarkPixels(Mat& test)
+{
+    int whiteCount = 0;
+
+    for(int i = 0; i < test.rows; i++)
+    {
+        for(int j = 0; j < test.cols; j++)
+        {
+            Vec3b pixel = test.at<Vec3b>(i, j);
+
+            int blue = pixel[0];
+            int green = pixel[1];
+            int red = pixel[2];
+
+            if(blue < 30 && green < 30 && red < 30)
+            {
+                blue = 255;
+                green = 255;
+                red = 255;
+                whiteCount++;
+            }
+
+            pixel[0] = blue;
+            pixel[1] = green;
+            pixel[2] = red;
+
+            test.at<Vec3b>(i, j) = pixel;
+        }
+    }
+
+    return whiteCount;
+}
@@ -0,0 +1,65 @@
+/*******************************************************************************
+ * Reference Implementations Signatures
+ *
+ * @author Matthew Munson
+ * @date 5/1/2021
+ *
+ * Frozen copies of the original, straightforward implementations that the
+ * optimized code paths replaced. The regression harness runs these side by
+ * side with the current implementations; they are the golden outputs every
+ * optimization has to reproduce. Do not optimize anything in this file.
+ *
+ * Header file documentation is user-focused. For implementation-level comments
+ * see Reference.cpp
+ *
+ ******************************************************************************/
+
+#ifndef MACHINEVISION_REFERENCE_H
+#define MACHINEVISION_REFERENCE_H
+
+#include <opencv2/opencv.hpp>
+
+using namespace std;
+using namespace cv;
+
+class Reference {
+
+public:
+
+    // Program II: the original at<Vec3b> histogram and overlay loops
+    static Vec3i getMostCommonColor(const Mat& image, int buckets);
+    static Vec3i findMaxBucket(const Mat& hist, int buckets);
+    static Mat overlayBackground(const Mat& foreground,
+                                 const Mat& background,
+                                 const Vec3i& mostCommonColor,
+                                 int threshold);
+
+    // Program II: YCbCr keying as cvtColor(COLOR_BGR2YCrCb) followed by a separate keying loop
+    static Mat overlayBackgroundYCbCr(const Mat& foreground,
+                                      const Mat& background,
+                                      const Vec3i& mostCommonColor,
+                                      int lumaThreshold,
+                                      int chromaThreshold);
+
+    // Program I, part I: rotate 180 degrees, greyscale, blur and Canny using OpenCV only
+    static Mat imgProcessing(const Mat& image);
+
+    // Not an original: flip() followed by cvtColor(), the two passes PixelKernels::flipToGray fuses
+    static Mat flipToGray(const Mat& image, int flipCode);
+
+    // Program I, part III: GaussianBlur followed by Canny
+    static Mat blur(const Mat& image, Size size, double sigmaX, double sigmaY);
+    static Mat canny(const Mat& image, double threshold1, double threshold2);
+
+    // Program I, part IV: bitwise_not followed by convertScaleAbs
+    static Mat additionalImageEffects(const Mat& image);
+
+    // Playgrounds/main.cpp: the in-place 3x3 neighbourhood blend. Modifies image.
+    static void blendNeighbourhoods(Mat& image);
+
+    // Playgrounds/main2.cpp: dark pixels to white. Modifies image, returns the count.
+    static int recolorDarkPixels(Mat& image);
+};
+
+
+#endif //MACHINEVISION_REFERENCE_H
@@ -0,0 +1,1416 @@
+/***************************************************************************************************
+ * Regression Harness
+ *
+ * @author Matthew Munson
+ * @date 5/1/2021
+ *
+ * Runs every optimized kernel side by side with the reference implementation it replaced (see
+ * Reference.h) on the images in the data directory plus a few generated ones. For each kernel and
+ * image it reports how many pixels differ, the largest per-channel error, both timings and the
+ * speedup.
+ *
+ * A kernel fails when its output differs from the reference by more than the kernel allows. Speed
+ * is only reported unless --min-speedup is given, since timings on a loaded machine are noisy and
+ * some cases time conversions on purpose. The process exits with a non-zero status if anything
+ * failed, so it can gate a build.
+ *
+ * _________________________________________________________________________________________________
+ * Usage:
+ *
+ * RegressionHarness [data directory] [--iterations N] [--min-speedup X] [--kernel NAME]
+ *                   [--scheduler]
+ *
+ * - data directory : Defaults to ../data
+ * - iterations : Timed runs per kernel and image. The median is reported. Defaults to 5.
+ * - min-speedup : Smallest acceptable reference time / optimized time. Defaults to 0, which reports
+ *                 speed without failing on it.
+ * - kernel : Only run kernels whose name contains NAME
+ * - scheduler : Run every case a second time with a TaskScheduler installed (see TaskScheduler.h),
+ *               along with cases for the scheduler itself
+ *
+ * _________________________________________________________________________________________________
+ * Adding a kernel:
+ *
+ * Append a kernelCase to buildCases(). Both functions receive the same BGR input and must not
+ * modify it; kernels that work in place should run on a clone. Cases that set encodedInput receive
+ * the bytes of each file in the data directory instead, and skip the generated images.
+ *
+ **************************************************************************************************/
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "Reference.h"
+#include "../Assignment1/BlurStack.h"
+#include "../Assignment1/EdgePipeline.h"
+#include "../Assignment1/FastCanny.h"
+#include "../Assignment1/PointOps.h"
+#include "../Assignment1/Program1.h"
+#include "../Assignment2/ColorHistogram.h"
+#include "../Assignment2/IntegralHistogram.h"
+#include "../Assignment2/Keying.h"
+#include "../Assignment2/KeyingJob.h"
+#include "../Assignment2/ResultCache.h"
+#include "../Common/AsyncImageLoader.h"
+#include "../Common/LineProtocol.h"
+#include "../Common/PixelFormat.h"
+#include "../Common/PixelKernels.h"
+#include "../Common/PlanarImage.h"
+#include "../Common/RecursiveGaussian.h"
+#include "../Common/TaskScheduler.h"
+#include "../Common/Trace.h"
+#include "../Common/WavefrontBlend.h"
+
+using namespace std;
+using namespace cv;
+
+// Settings from the edge detection slider example
+static const Size EDGE_BLUR_SIZE = Size(7, 7);
+static const double EDGE_SIGMA_X = 7.0;
+static const double EDGE_SIGMA_Y = 6.0;
+static const double EDGE_THRESHOLD_1 = 20.0;
+static const double EDGE_THRESHOLD_2 = 60.0;
+
+// The largest sigma the smoothing slider reaches
+static const double SMOOTHING_SIGMA = 11.0;
+
+// Settings from program II
+static const int HISTOGRAM_BUCKETS = 4;
+static const int REPLACEMENT_THRESHOLD = 60;
+static const int HISTOGRAM_DECODE_SCALE = 8;
+static const int LUMA_THRESHOLD = 80;
+static const int CHROMA_THRESHOLD = 20;
+
+// Settings for adaptive keying, from program II's --tiles
+static const Size ADAPTIVE_GRID = Size(8, 8);
+static const int ADAPTIVE_BUCKETS = 32;
+static const int TILE_MAX_DRIFT = 96;
+
+// Chunks of the inner parallelFor in the scheduler cases
+static const int NESTED_CHUNKS = 4;
+
+// Ring size and spans recorded in the trace case's ring check, so that the ring wraps
+static const size_t TRACE_RING_EVENTS = 4;
+static const int TRACE_RING_SPANS = 10;
+
+// Checks made by the trace case, each giving one flag
+static const int TRACE_CHECKS = 5;
+
+// One optimized kernel and the reference it must match
+struct kernelCase
+{
+    string name;
+    function<Mat(const Mat&)> reference;
+    function<Mat(const Mat&)> optimized;
+    double maxError;          // Largest per-channel difference allowed
+    double maxDiffFraction;   // Largest fraction of pixels allowed to differ at all
+    bool encodedInput = false;    // Given the input file's bytes, as a column of CV_8U, instead
+};
+
+/***************************************************************************************************
+ * Interior
+ *
+ * @return image without a band of margin pixels around its edges, for kernels that only match
+ *         their reference away from the border
+ **************************************************************************************************/
+static Mat interior(const Mat& image, int margin)
+{
+    margin = min(margin, min(image.rows, image.cols) / 4);
+
+    return image(Rect(margin, margin, image.cols - 2 * margin, image.rows - 2 * margin)).clone();
+}
+
+/***************************************************************************************************
+ * Split Tiles
+ *
+ * @return Copies of every whole tile of the given size in image, in row-major order, standing in
+ *         for a batch of small frames
+ **************************************************************************************************/
+static vector<Mat> splitTiles(const Mat& image, const Size& tile)
+{
+    vector<Mat> tiles;
+
+    for(int y = 0; y + tile.height <= image.rows; y += tile.height)
+    {
+        for(int x = 0; x + tile.width <= image.cols; x += tile.width)
+            tiles.push_back(image(Rect(x, y, tile.width, tile.height)).clone());
+    }
+
+    return tiles;
+}
+
+// Frame size for the batch processing case
+static const Size BATCH_FRAME = Size(64, 48);
+
+// The inputs every kernel runs on
+struct namedImage
+{
+    string name;
+    Mat image;
+    vector<uchar> encoded = vector<uchar>();   // The file decoded, empty for generated images
+};
+
+// Regions queried per image by the region keying cases
+static const int REGION_QUERIES = 256;
+
+/***************************************************************************************************
+ * Sample Regions
+ *
+ * @param size : The size of the image being queried
+ * @return The same pseudo-random set of rectangles every time for a given size
+ **************************************************************************************************/
+static vector<Rect> sampleRegions(const Size& size)
+{
+    vector<Rect> regions;
+    RNG rng(size.width * 7919 + size.height);
+
+    for(int k = 0; k < REGION_QUERIES; k++)
+    {
+        int x = rng.uniform(0, size.width);
+        int y = rng.uniform(0, size.height);
+
+        int width = rng.uniform(1, size.width - x + 1);
+        int height = rng.uniform(1, size.height - y + 1);
+
+        regions.push_back(Rect(x, y, width, height));
+    }
+
+    return regions;
+}
+
+/***************************************************************************************************
+ * Bucket Share
+ *
+ * @param image : A BGR image
+ * @param color : A bucket, as returned by getMostCommonColor()
+ * @return The percentage of image's pixels in that bucket, as a 1 x 1 CV_64F Mat
+ **************************************************************************************************/
+static Mat bucketShare(const Mat& image, const Vec3i& color)
+{
+    Mat hist;
+    ColorHistogram::fill(image, hist, HISTOGRAM_BUCKETS);
+
+    int bucketSize = 256 / HISTOGRAM_BUCKETS;
+    int count = hist.at<int>(color[0] / bucketSize, color[1] / bucketSize, color[2] / bucketSize);
+
+    return Mat(1, 1, CV_64F, Scalar(100.0 * count / image.total()));
+}
+
+/***************************************************************************************************
+ * Run Keying Jobs
+ *
+ * Writes a foreground file to a new scratch directory and runs three keying jobs on it with
+ * program II's settings: against background, the same again, then against background mirrored.
+ * With a cache, the jobs share one that starts empty. The directory is removed afterwards.
+ *
+ * @param encoded : The foreground file, as a column of CV_8U
+ * @param background : The first background
+ * @param useCache : Whether to give the jobs a ResultCache
+ * @return A column of CV_8U: the three outputs' bytes, then the colorCached, maskCached and
+ *         outputCached flags of each job. Empty if a job failed.
+ **************************************************************************************************/
+static Mat runKeyingJobs(const Mat& encoded, const Mat& background, bool useCache)
+{
+    char pattern[] = "/tmp/machinevision-harness-XXXXXX";
+
+    if(!mkdtemp(pattern))
+        return Mat();
+
+    string directory = pattern;
+    string foregroundPath = directory + "/foreground";
+    string backgroundPaths[] = {directory + "/background.png", directory + "/mirrored.png"};
+
+    Mat mirrored;
+    flip(background, mirrored, 1);
+
+    vector<uchar> bytes;
+    bool ok = ResultCache::writeFile(foregroundPath,
+                                     vector<uchar>(encoded.datastart, encoded.dataend)) &&
+              imencode(".png", background, bytes) &&
+              ResultCache::writeFile(backgroundPaths[0], bytes) &&
+              imencode(".png", mirrored, bytes) &&
+              ResultCache::writeFile(backgroundPaths[1], bytes);
+
+    unique_ptr<ResultCache> cache(useCache ? new ResultCache(directory + "/cache") : nullptr);
+    keyingSettings settings = {HISTOGRAM_BUCKETS,
+                               REPLACEMENT_THRESHOLD,
+                               HISTOGRAM_DECODE_SCALE,
+                               1,
+                               TILE_MAX_DRIFT};
+
+    vector<uchar> outputs;
+    vector<uchar> flags;
+
+    for(int job = 0; ok && job < 3; job++)
+    {
+        keyingOutcome outcome;
+        ok = KeyingJob::run(foregroundPath,
+                            backgroundPaths[job / 2],
+                            directory + "/output.jpg",
+                            settings,
+                            cache.get(),
+                            outcome);
+
+        outputs.insert(outputs.end(), outcome.encoded.begin(), outcome.encoded.end());
+        flags.insert(flags.end(), {outcome.colorCached, outcome.maskCached, outcome.outputCached});
+    }
+
+    outputs.insert(outputs.end(), flags.begin(), flags.end());
+
+    vector<String> files;
+    glob(directory, files, true);
+
+    for(const String& file : files)
+        remove(file.c_str());
+
+    rmdir((directory + "/cache").c_str());
+    rmdir(directory.c_str());
+
+    return ok ? Mat(outputs, true) : Mat();
+}
+
+/***************************************************************************************************
+ * Read Trace
+ *
+ * @return The contents of a trace file or part, or an empty string if it cannot be read
+ **************************************************************************************************/
+static string readTrace(const string& path)
+{
+    ifstream file(path, ios::binary);
+    stringstream contents;
+    contents << file.rdbuf();
+
+    return contents.str();
+}
+
+/***************************************************************************************************
+ * Trace Details
+ *
+ * Decodes the detail of every event with the given name in a trace, in the order written. Events
+ * are one per line, and only the escapes Trace writes are handled.
+ *
+ * @return The details, with an empty string for events that have none
+ **************************************************************************************************/
+static vector<string> traceDetails(const string& json, const string& name)
+{
+    vector<string> details;
+    stringstream lines(json);
+    string line;
+
+    string prefix = "{\"name\":\"" + name + "\",";
+    string marker = "\"detail\":\"";
+
+    while(getline(lines, line))
+    {
+        if(line.compare(0, prefix.size(), prefix) != 0)
+            continue;
+
+        string detail;
+        size_t start = line.find(marker);
+
+        for(size_t k = start == string::npos ? line.size() : start + marker.size();
+            k < line.size() && line[k] != '"';
+            k++)
+        {
+            if(line[k] != '\\' || k + 1 >= line.size())
+                detail += line[k];
+            else if(line[++k] == 'u')
+            {
+                detail += (char)strtol(line.substr(k + 1, 4).c_str(), nullptr, 16);
+                k += 4;
+            }
+            else
+                detail += line[k];
+        }
+
+        details.push_back(detail);
+    }
+
+    return details;
+}
+
+/***************************************************************************************************
+ * Check Trace
+ *
+ * Records spans and writes traces into directory, checking what comes out. Runs in a child of the
+ * harness: it enables tracing, which cannot be undone, and forks a part-writing child of its own.
+ *
+ * @param directory : A scratch directory
+ * @param detail : The detail to record on one span and read back
+ * @return The detail as read back, then one flag per check: the ring keeps its latest events
+ *         oldest first, a forked child's part holds only the child's events, parts are merged
+ *         into a well-formed trace and deleted, a write drops the rings of exited threads, and
+ *         only the latest MAX_EXITED_THREADS exited threads are kept
+ **************************************************************************************************/
+static vector<uchar> checkTrace(const string& directory, const string& detail)
+{
+    string partPath = directory + "/part";
+    string tracePaths[] = {directory + "/first.json",
+                           directory + "/second.json",
+                           directory + "/third.json"};
+
+    Trace::enable(TRACE_RING_EVENTS);
+
+    Trace::span("detail", detail).end();
+
+    thread([]()
+    {
+        for(int k = 0; k < TRACE_RING_SPANS; k++)
+            Trace::span("wrap", to_string(k)).end();
+    }).join();
+
+    //The child's part must not carry events recorded before the fork
+    pid_t child = fork();
+
+    if(child == 0)
+    {
+        Trace::span("child").end();
+
+        string part = Trace::writePart(partPath) ? readTrace(partPath) : string();
+        bool own = traceDetails(part, "child").size() == 1 &&
+                   traceDetails(part, "detail").empty() &&
+                   traceDetails(part, "wrap").empty();
+
+        _exit(own ? 0 : 1);
+    }
+
+    int status = -1;
+
+    if(child > 0)
+        waitpid(child, &status, 0);
+
+    Trace::writeFile(tracePaths[0], {partPath});
+    string first = readTrace(tracePaths[0]);
+
+    vector<string> wrapped = traceDetails(first, "wrap");
+    vector<string> latest;
+
+    for(int k = TRACE_RING_SPANS - (int)TRACE_RING_EVENTS; k < TRACE_RING_SPANS; k++)
+        latest.push_back(to_string(k));
+
+    string opening = "{\"traceEvents\":[\n";
+    string closing = "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    bool merged = traceDetails(first, "child").size() == 1 &&
+                  access(partPath.c_str(), F_OK) != 0 &&
+                  first.compare(0, opening.size(), opening) == 0 &&
+                  first.size() >= closing.size() &&
+                  first.compare(first.size() - closing.size(), closing.size(), closing) == 0;
+
+    //A few more exited threads than are kept, one at a time so the oldest are known
+    int extra = 8;
+
+    for(int k = 0; k < (int)Trace::MAX_EXITED_THREADS + extra; k++)
+        thread([k]() { Trace::span("exited", to_string(k)).end(); }).join();
+
+    Trace::writeFile(tracePaths[1]);
+    Trace::writeFile(tracePaths[2]);
+
+    string second = readTrace(tracePaths[1]);
+    string third = readTrace(tracePaths[2]);
+
+    vector<string> exited = traceDetails(second, "exited");
+
+    bool capped = exited.size() == Trace::MAX_EXITED_THREADS &&
+                  !exited.empty() && exited.front() == to_string(extra);
+    bool dropped = traceDetails(second, "wrap").empty() &&
+                   traceDetails(third, "exited").empty() &&
+                   traceDetails(third, "detail").size() == 1;
+
+    vector<string> details = traceDetails(first, "detail");
+    vector<uchar> outcome;
+
+    if(!details.empty())
+        outcome.assign(details.front().begin(), details.front().end());
+
+    outcome.insert(outcome.end(), {wrapped == latest,
+                                   WIFEXITED(status) && WEXITSTATUS(status) == 0,
+                                   merged,
+                                   dropped,
+                                   capped});
+
+    for(const string& path : tracePaths)
+        unlink(path.c_str());
+
+    return outcome;
+}
+
+/***************************************************************************************************
+ * Run Trace Checks
+ *
+ * Runs checkTrace() in a child process, in a new scratch directory that is removed afterwards,
+ * so the harness itself never records spans. The detail recorded is the first row of image: any
+ * bytes, control characters and quotes included, must come back out of the JSON unchanged.
+ *
+ * @return A column of CV_8U: the detail as read back, then TRACE_CHECKS flags, 1 where the check
+ *         passed. Empty if the child could not be run.
+ **************************************************************************************************/
+static Mat runTraceChecks(const Mat& image)
+{
+    char pattern[] = "/tmp/machinevision-harness-XXXXXX";
+
+    if(!mkdtemp(pattern))
+        return Mat();
+
+    string directory = pattern;
+    string detail((const char*)image.ptr(0), image.cols * image.elemSize());
+
+    int channel[2];
+    vector<uchar> outcome;
+
+    if(pipe(channel) == 0)
+    {
+        pid_t child = fork();
+
+        if(child == 0)
+        {
+            close(channel[0]);
+
+            vector<uchar> checked = checkTrace(directory, detail);
+            _exit(writeAll(channel[1], string(checked.begin(), checked.end())) ? 0 : 1);
+        }
+
+        close(channel[1]);
+
+        char chunk[4096];
+        ssize_t count;
+
+        while(child > 0 && (count = read(channel[0], chunk, sizeof(chunk))) > 0)
+            outcome.insert(outcome.end(), chunk, chunk + count);
+
+        close(channel[0]);
+
+        int status = -1;
+
+        if(child > 0)
+            waitpid(child, &status, 0);
+
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            outcome.clear();
+    }
+
+    rmdir(directory.c_str());
+
+    return outcome.empty() ? Mat() : Mat(outcome, true);
+}
+
+/***************************************************************************************************
+ * Lit Backdrop
+ *
+ * A green backdrop lit from one corner, fading to about a third of its brightness in the other,
+ * with magenta discs standing in for the subject. The backdrop's green channel spans 150 levels,
+ * more than twice the replacement threshold, so no single key can remove all of it.
+ *
+ * @param size : The size of the scene
+ * @param subject : Receives a CV_8UC1 mask, 255 on the discs
+ * @return The scene, BGR
+ **************************************************************************************************/
+static Mat litBackdrop(const Size& size, Mat& subject)
+{
+    Mat scene(size, CV_8UC3);
+
+    for(int i = 0; i < scene.rows; i++)
+    {
+        for(int j = 0; j < scene.cols; j++)
+        {
+            double light = 0.35 + 0.65 * ((double)i / scene.rows + (double)j / scene.cols) / 2;
+            scene.at<Vec3b>(i, j) = Vec3b(saturate_cast<uchar>(80 * light),
+                                          saturate_cast<uchar>(230 * light),
+                                          saturate_cast<uchar>(60 * light));
+        }
+    }
+
+    subject = Mat::zeros(size, CV_8UC1);
+    int radius = max(1, min(size.width, size.height) / 16);
+
+    for(Point2d center : {Point2d(0.2, 0.25), Point2d(0.5, 0.3), Point2d(0.8, 0.2),
+                          Point2d(0.3, 0.75), Point2d(0.6, 0.65), Point2d(0.85, 0.8)})
+    {
+        circle(subject,
+               Point((int)(center.x * size.width), (int)(center.y * size.height)),
+               radius,
+               Scalar(255),
+               FILLED);
+    }
+
+    scene.setTo(Scalar(230, 30, 230), subject);
+
+    return scene;
+}
+
+/***************************************************************************************************
+ * Build Cases
+ *
+ * Lists every kernel under test. Outputs that are not images (colors, counts) are returned as
+ * small Mats so that they are compared the same way.
+ *
+ * @param background : The background used by the keying kernels
+ * @return The kernels to run
+ **************************************************************************************************/
+static vector<kernelCase> buildCases(const Mat& background)
+{
+    vector<kernelCase> cases;
+
+    cases.push_back({"getMostCommonColor",
+                     [](const Mat& image)
+                     {
+                         return Mat(Reference::getMostCommonColor(image, HISTOGRAM_BUCKETS));
+                     },
+                     [](const Mat& image)
+                     {
+                         return Mat(getMostCommonColor(image, HISTOGRAM_BUCKETS));
+                     },
+                     0, 0});
+
+    cases.push_back({"IntegralHistogram regions",
+                     [](const Mat& image)
+                     {
+                         Mat colors(REGION_QUERIES, 1, CV_32SC3);
+                         vector<Rect> regions = sampleRegions(image.size());
+
+                         for(int k = 0; k < REGION_QUERIES; k++)
+                         {
+                             Mat region = image(regions[k]);
+                             Vec3i color = Reference::getMostCommonColor(region, HISTOGRAM_BUCKETS);
+
+                             colors.at<Vec3i>(k, 0) = color;
+                         }
+
+                         return colors;
+                     },
+                     [](const Mat& image)
+                     {
+                         Mat colors(REGION_QUERIES, 1, CV_32SC3);
+                         vector<Rect> regions = sampleRegions(image.size());
+                         IntegralHistogram index(image, HISTOGRAM_BUCKETS);
+
+                         for(int k = 0; k < REGION_QUERIES; k++)
+                             colors.at<Vec3i>(k, 0) = index.mostCommonColor(regions[k]);
+
+                         return colors;
+                     },
+                     0, 0});
+
+    cases.push_back({"overlayBackground",
+                     [background](const Mat& image)
+                     {
+                         Vec3i key = Reference::getMostCommonColor(image, HISTOGRAM_BUCKETS);
+                         return Reference::overlayBackground(image,
+                                                             background,
+                                                             key,
+                                                             REPLACEMENT_THRESHOLD);
+                     },
+                     [background](const Mat& image)
+                     {
+                         Vec3i key = Reference::getMostCommonColor(image, HISTOGRAM_BUCKETS);
+                         return overlayBackground(image, background, key, REPLACEMENT_THRESHOLD);
+                     },
+                     0, 0});
+
+    // Runs on the files in the data directory. Scaled JPEG decoding averages blocks of pixels,
+    // which can reorder buckets of nearly equal counts in an image without a dominant color, so
+    // rather than the colors this compares how much of the full image is in the chosen bucket, in
+    // percent. The largest loss, on Overlay.jpg, is 2 points.
+    cases.push_back({"decodeForHistogram",
+                     [](const Mat& encoded)
+                     {
+                         Mat full = imdecode(encoded, IMREAD_COLOR);
+                         return bucketShare(full, getMostCommonColor(full, HISTOGRAM_BUCKETS));
+                     },
+                     [](const Mat& encoded)
+                     {
+                         Mat full = imdecode(encoded, IMREAD_COLOR);
+                         Mat reduced = decodeForHistogram(vector<uchar>(encoded.datastart,
+                                                                        encoded.dataend),
+                                                          full,
+                                                          HISTOGRAM_DECODE_SCALE);
+                         return bucketShare(full, getMostCommonColor(reduced, HISTOGRAM_BUCKETS));
+                     },
+                     2.5, 1, true});
+
+    // The whole program II pipeline on the files in the data directory, computed each time by the
+    // reference and through an empty cache by the optimized side. The jobs must give the same bytes
+    // and find in the cache: nothing, then the color and output, then the color and mask.
+    cases.push_back({"KeyingJob cache",
+                     [background](const Mat& encoded)
+                     {
+                         Mat outputs = runKeyingJobs(encoded, background, false);
+                         uchar expected[] = {0, 0, 0, 1, 0, 1, 1, 1, 0};
+
+                         if(!outputs.empty())
+                         {
+                             Mat flags = outputs.rowRange(outputs.rows - 9, outputs.rows);
+                             Mat(9, 1, CV_8U, expected).copyTo(flags);
+                         }
+
+                         return outputs;
+                     },
+                     [background](const Mat& encoded)
+                     {
+                         return runKeyingJobs(encoded, background, true);
+                     },
+                     0, 0, true});
+
+    // The planar cases time the split into planes (and the merge back) as part of the kernel, so
+    // their speedup shows whether converting for a single use pays for itself
+    cases.push_back({"getMostCommonColor planar",
+                     [](const Mat& image)
+                     {
+                         return Mat(Reference::getMostCommonColor(image, HISTOGRAM_BUCKETS));
+                     },
+                     [](const Mat& image)
+                     {
+                         PlanarImage planar;
+                         PlanarImage::fromInterleaved(image, planar);
+                         return Mat(getMostCommonColor(planar, HISTOGRAM_BUCKETS));
+                     },
+                     0, 0});
+
+    cases.push_back({"overlayBackground planar",
+                     [background](const Mat& image)
+                     {
+                         Vec3i key = Reference::getMostCommonColor(image, HISTOGRAM_BUCKETS);
+                         return Reference::overlayBackground(image,
+                                                             background,
+                                                             key,
+                                                             REPLACEMENT_THRESHOLD);
+                     },
+                     [background](const Mat& image)
+                     {
+                         Vec3i key = Reference::getMostCommonColor(image, HISTOGRAM_BUCKETS);
+
+                         Mat tile;
+                         convertChannels(background, tile, image.channels());
+
+                         PlanarImage foreground, planarTile;
+                         PlanarImage::fromInterleaved(image, foreground);
+                         PlanarImage::fromInterleaved(tile, planarTile);
+
+                         Mat overlay;
+                         PlanarImage::toInterleaved(overlayBackground(foreground,
+                                                                      planarTile,
+                                                                      key,
+                                                                      REPLACEMENT_THRESHOLD),
+                                                    overlay);
+                         return overlay;
+                     },
+                     0, 0});
+
+    // The fused conversion uses cvtColor's 8-bit fixed point coefficients, rounding and chroma
+    // saturation. It was checked identical to cvtColor(COLOR_BGR2YCrCb) for all 2^24 BGR colors, so
+    // the outputs must match exactly.
+    cases.push_back({"overlayBackgroundYCbCr",
+                     [background](const Mat& image)
+                     {
+                         Vec3i key = Reference::getMostCommonColor(image, HISTOGRAM_BUCKETS);
+                         return Reference::overlayBackgroundYCbCr(image,
+                                                                  background,
+                                                                  key,
+                                                                  LUMA_THRESHOLD,
+                                                                  CHROMA_THRESHOLD);
+                     },
+                     [background](const Mat& image)
+                     {
+                         Vec3i key = Reference::getMostCommonColor(image, HISTOGRAM_BUCKETS);
+                         return overlayBackgroundYCbCr(image,
+                                                       background,
+                                                       key,
+                                                       LUMA_THRESHOLD,
+                                                       CHROMA_THRESHOLD);
+                     },
+                     0, 0});
+
+    // A single tile keys with the global color, so the adaptive path must match exactly
+    cases.push_back({"overlayBackgroundAdaptive",
+                     [background](const Mat& image)
+                     {
+                         Vec3i key = Reference::getMostCommonColor(image, HISTOGRAM_BUCKETS);
+                         return Reference::overlayBackground(image,
+                                                             background,
+                                                             key,
+                                                             REPLACEMENT_THRESHOLD);
+                     },
+                     [background](const Mat& image)
+                     {
+                         Vec3i key = Reference::getMostCommonColor(image, HISTOGRAM_BUCKETS);
+                         Mat tileColors = getTileColors(image,
+                                                        HISTOGRAM_BUCKETS,
+                                                        Size(1, 1),
+                                                        key,
+                                                        0);
+                         return overlayBackgroundAdaptive(image,
+                                                          background,
+                                                          tileColors,
+                                                          REPLACEMENT_THRESHOLD);
+                     },
+                     0, 0});
+
+    // Only the input's size is used. The reference is the exact composite: background wherever the
+    // scene is backdrop, the discs elsewhere. overlayBackground with the global key gets about 29%
+    // of this scene wrong (6% even with 32 buckets); tiles whose color is the subject's must fall
+    // back to the global key for the adaptive key to be exact.
+    cases.push_back({"overlayBackgroundAdaptive lit backdrop",
+                     [background](const Mat& image)
+                     {
+                         Mat subject;
+                         Mat scene = litBackdrop(image.size(), subject);
+
+                         for(int i = 0; i < scene.rows; i++)
+                         {
+                             for(int j = 0; j < scene.cols; j++)
+                             {
+                                 if(!subject.at<uchar>(i, j))
+                                 {
+                                     scene.at<Vec3b>(i, j) = background.at<Vec3b>(
+                                         i % background.rows, j % background.cols);
+                                 }
+                             }
+                         }
+
+                         return scene;
+                     },
+                     [background](const Mat& image)
+                     {
+                         Mat subject;
+                         Mat scene = litBackdrop(image.size(), subject);
+
+                         Vec3i key = getMostCommonColor(scene, ADAPTIVE_BUCKETS);
+                         Size grid(min(ADAPTIVE_GRID.width, scene.cols),
+                                   min(ADAPTIVE_GRID.height, scene.rows));
+                         Mat tileColors = getTileColors(scene,
+                                                        ADAPTIVE_BUCKETS,
+                                                        grid,
+                                                        key,
+                                                        TILE_MAX_DRIFT);
+                         return overlayBackgroundAdaptive(scene,
+                                                          background,
+                                                          tileColors,
+                                                          REPLACEMENT_THRESHOLD);
+                     },
+                     0, 0});
+
+    cases.push_back({"imgProcessing",
+                     [](const Mat& image) { return Reference::imgProcessing(image); },
+                     [](const Mat& image) { return Program1::imgProcessing(image); },
+                     0, 0});
+
+    // Small frames cut from the image, processed one by one and as a single batch
+    cases.push_back({"imgProcessingBatch",
+                     [](const Mat& image)
+                     {
+                         vector<Mat> processed;
+
+                         for(const Mat& frame : splitTiles(image, BATCH_FRAME))
+                             processed.push_back(Reference::imgProcessing(frame));
+
+                         Mat stacked;
+                         vconcat(processed, stacked);
+                         return stacked;
+                     },
+                     [](const Mat& image)
+                     {
+                         Mat stacked;
+                         vconcat(Program1::imgProcessingBatch(splitTiles(image, BATCH_FRAME)),
+                                 stacked);
+                         return stacked;
+                     },
+                     0, 0});
+
+    for(int flipCode : {-1, 0, 1})
+    {
+        cases.push_back({"flipToGray " + to_string(flipCode),
+                         [=](const Mat& image) { return Reference::flipToGray(image, flipCode); },
+                         [=](const Mat& image)
+                         {
+                             Mat gray;
+                             PixelKernels::flipToGray(image, gray, flipCode);
+                             return gray;
+                         },
+                         0, 0});
+
+        // The batch's first stage on its own, so a failure of imgProcessingBatch can be placed
+        cases.push_back({"flipToGray batch " + to_string(flipCode),
+                         [=](const Mat& image)
+                         {
+                             vector<Mat> planes;
+
+                             for(const Mat& frame : splitTiles(image, BATCH_FRAME))
+                                 planes.push_back(Reference::flipToGray(frame, flipCode));
+
+                             Mat stacked;
+                             vconcat(planes, stacked);
+                             return stacked;
+                         },
+                         [=](const Mat& image)
+                         {
+                             Mat stacked;
+                             PixelKernels::flipToGray(splitTiles(image, BATCH_FRAME),
+                                                      stacked,
+                                                      flipCode);
+                             return stacked;
+                         },
+                         0, 0});
+    }
+
+    // The pipeline keeps the horizontal pass in float where GaussianBlur uses fixed point, so it
+    // rounds differently by one level: measured on up to 31% of pixels for noise, 17% for photos
+    cases.push_back({"edgePipeline blur",
+                     [](const Mat& image)
+                     {
+                         return Reference::blur(image, EDGE_BLUR_SIZE, EDGE_SIGMA_X, EDGE_SIGMA_Y);
+                     },
+                     [](const Mat& image)
+                     {
+                         EdgePipeline pipeline;
+                         pipeline.setImage(image);
+                         pipeline.setBlurX(EDGE_BLUR_SIZE.width, EDGE_SIGMA_X);
+                         pipeline.setBlurY(EDGE_BLUR_SIZE.height, EDGE_SIGMA_Y);
+                         return pipeline.blurred().clone();
+                     },
+                     1, 0.35});
+
+    // Recursive blur replicates the border where GaussianBlur reflects, so only the interior is
+    // compared. See RecursiveGaussian.h for the accuracy this checks.
+    cases.push_back({"RecursiveGaussian",
+                     [](const Mat& image)
+                     {
+                         Mat blurred = Reference::blur(image,
+                                                       Size(0, 0),
+                                                       SMOOTHING_SIGMA,
+                                                       SMOOTHING_SIGMA);
+                         return interior(blurred, cvCeil(3 * SMOOTHING_SIGMA));
+                     },
+                     [](const Mat& image)
+                     {
+                         Mat blurred;
+                         RecursiveGaussian::blur(image, blurred, SMOOTHING_SIGMA, SMOOTHING_SIGMA);
+                         return interior(blurred, cvCeil(3 * SMOOTHING_SIGMA));
+                     },
+                     1, 0.5});
+
+    // Every level of the smoothing slider, stacked vertically. The stack chains float blurs with
+    // truncated kernels, so it may round differently from a direct float blur by a level. The
+    // reference blurs in float too: 8-bit GaussianBlur truncates its kernel at 3 sigma.
+    cases.push_back({"BlurStack levels",
+                     [](const Mat& image)
+                     {
+                         Mat converted;
+                         image.convertTo(converted, CV_32F);
+
+                         vector<Mat> levels;
+
+                         for(int sigma = 1; sigma <= SMOOTHING_SIGMA; sigma++)
+                         {
+                             Mat level;
+                             Reference::blur(converted, Size(0, 0), sigma, sigma)
+                                 .convertTo(level, image.depth());
+                             levels.push_back(level);
+                         }
+
+                         Mat stacked;
+                         vconcat(levels, stacked);
+                         return stacked;
+                     },
+                     [](const Mat& image)
+                     {
+                         vector<double> sigmas;
+
+                         for(int sigma = 1; sigma <= SMOOTHING_SIGMA; sigma++)
+                             sigmas.push_back(sigma);
+
+                         BlurStack stack(image, sigmas);
+                         stack.wait();
+
+                         vector<Mat> levels;
+
+                         for(size_t i = 0; i < sigmas.size(); i++)
+                             levels.push_back(stack.level(i));
+
+                         Mat stacked;
+                         vconcat(levels, stacked);
+                         return stacked;
+                     },
+                     1, 0.01});
+
+    cases.push_back({"FastCanny",
+                     [](const Mat& image)
+                     {
+                         return Reference::canny(image, EDGE_THRESHOLD_1, EDGE_THRESHOLD_2);
+                     },
+                     [](const Mat& image)
+                     {
+                         Mat edges;
+                         FastCanny::detect(image, edges, EDGE_THRESHOLD_1, EDGE_THRESHOLD_2);
+                         return edges;
+                     },
+                     0, 0});
+
+    cases.push_back({"PointOpChain",
+                     [](const Mat& image) { return Reference::additionalImageEffects(image); },
+                     [](const Mat& image)
+                     {
+                         Mat output;
+                         PointOpChain().invert().scale(2.0).apply(image, output);
+                         return output;
+                     },
+                     0, 0});
+
+    cases.push_back({"WavefrontBlend",
+                     [](const Mat& image)
+                     {
+                         Mat copy = image.clone();
+                         Reference::blendNeighbourhoods(copy);
+                         return copy;
+                     },
+                     [](const Mat& image)
+                     {
+                         Mat copy = image.clone();
+                         WavefrontBlend::apply(copy);
+                         return copy;
+                     },
+                     0, 0});
+
+    cases.push_back({"thresholdReplace",
+                     [](const Mat& image)
+                     {
+                         Mat copy = image.clone();
+                         Reference::recolorDarkPixels(copy);
+                         return copy;
+                     },
+                     [](const Mat& image)
+                     {
+                         Mat copy = image.clone();
+                         PixelKernels::thresholdReplace(copy,
+                                                        Vec3b(30, 30, 30),
+                                                        Vec3b(255, 255, 255));
+                         return copy;
+                     },
+                     0, 0});
+
+    cases.push_back({"thresholdReplace count",
+                     [](const Mat& image)
+                     {
+                         Mat copy = image.clone();
+                         return Mat(1, 1, CV_32S, Scalar(Reference::recolorDarkPixels(copy)));
+                     },
+                     [](const Mat& image)
+                     {
+                         Mat copy = image.clone();
+                         int count = PixelKernels::thresholdReplace(copy,
+                                                                    Vec3b(30, 30, 30),
+                                                                    Vec3b(255, 255, 255));
+                         return Mat(1, 1, CV_32S, Scalar(count));
+                     },
+                     0, 0});
+
+    // Trace, checked in a child process since tracing cannot be turned off. The reference is the
+    // recorded detail and every check passing; see runTraceChecks().
+    cases.push_back({"Trace",
+                     [](const Mat& image)
+                     {
+                         const uchar* row = image.ptr(0);
+                         vector<uchar> expected(row, row + image.cols * image.elemSize());
+                         expected.insert(expected.end(), TRACE_CHECKS, 1);
+
+                         return Mat(expected, true);
+                     },
+                     [](const Mat& image) { return runTraceChecks(image); },
+                     0, 0});
+
+    return cases;
+}
+
+/***************************************************************************************************
+ * Build Scheduler Cases
+ *
+ * Cases for the scheduler itself, run only with --scheduler. They call parallelFor() and
+ * allocateImage(), so they run on the installed scheduler; the references run on one thread.
+ *
+ * @return The kernels to run
+ **************************************************************************************************/
+static vector<kernelCase> buildSchedulerCases()
+{
+    vector<kernelCase> cases;
+
+    // Each row's chunk runs a parallelFor of its own, so workers queue tasks on their own deques
+    // while others steal them
+    cases.push_back({"scheduler nested",
+                     [](const Mat& image)
+                     {
+                         Mat inverted;
+                         bitwise_not(image, inverted);
+                         return inverted;
+                     },
+                     [](const Mat& image)
+                     {
+                         Mat inverted(image.size(), image.type());
+                         int width = image.cols * image.channels();
+
+                         parallelFor(Range(0, image.rows), [&](const Range& rows)
+                         {
+                             for(int i = rows.start; i < rows.end; i++)
+                             {
+                                 const uchar* in = image.ptr<uchar>(i);
+                                 uchar* out = inverted.ptr<uchar>(i);
+
+                                 parallelFor(Range(0, width), [&](const Range& columns)
+                                 {
+                                     for(int j = columns.start; j < columns.end; j++)
+                                         out[j] = (uchar)(255 - in[j]);
+                                 }, NESTED_CHUNKS);
+                             }
+                         });
+
+                         return inverted;
+                     },
+                     0, 0});
+
+    // One inner chunk of the middle row throws. The exception must come out of both calls, and
+    // every other chunk must still run: one row per outer chunk keeps the count exact. The output
+    // is whether it was caught, then how many chunks ran, as a column.
+    cases.push_back({"scheduler exception",
+                     [](const Mat& image)
+                     {
+                         vector<int> expected = {1, image.rows * NESTED_CHUNKS - 1};
+                         return Mat(expected, true);
+                     },
+                     [](const Mat& image)
+                     {
+                         atomic<int> ran(0);
+                         int caught = 0;
+
+                         try
+                         {
+                             parallelFor(Range(0, image.rows), [&](const Range& rows)
+                             {
+                                 for(int i = rows.start; i < rows.end; i++)
+                                 {
+                                     parallelFor(Range(0, NESTED_CHUNKS), [&](const Range& chunk)
+                                     {
+                                         if(i == image.rows / 2 && chunk.start == 0)
+                                             throw runtime_error("scheduler case");
+
+                                         ran++;
+                                     }, NESTED_CHUNKS);
+                                 }
+                             }, image.rows);
+                         }
+                         catch(const runtime_error& error)
+                         {
+                             caught = string(error.what()) == "scheduler case";
+                         }
+
+                         vector<int> outcome = {caught, ran.load()};
+                         return Mat(outcome, true);
+                     },
+                     0, 0});
+
+    // allocate() from inside chunks queues tasks that only their worker may run behind chunks
+    // that may be stolen. Both images must come back zeroed: the copy is built by adding to them.
+    cases.push_back({"scheduler allocate",
+                     [](const Mat& image) { return image.clone(); },
+                     [](const Mat& image)
+                     {
+                         Mat copy = allocateImage(image.rows, image.cols, image.type());
+
+                         parallelFor(Range(0, image.rows), [&](const Range& rows)
+                         {
+                             for(int i = rows.start; i < rows.end; i++)
+                             {
+                                 Mat scratch = allocateImage(1, image.cols, image.type());
+                                 add(scratch, image.row(i), scratch);
+
+                                 Mat target = copy.row(i);
+                                 add(target, scratch, target);
+                             }
+                         });
+
+                         return copy;
+                     },
+                     0, 0});
+
+    return cases;
+}
+
+/***************************************************************************************************
+ * Load Images
+ *
+ * Loads every image in the data directory as BGR and adds generated images that exercise cases
+ * the photos do not: noise, smooth gradients, and a flat backdrop for keying.
+ *
+ * @param dataDirectory : Directory to load images from
+ * @return The inputs for every kernel
+ **************************************************************************************************/
+static vector<namedImage> loadImages(const string& dataDirectory)
+{
+    vector<namedImage> images;
+
+    vector<String> files;
+    glob(dataDirectory + "/*", files, false);
+
+    vector<string> paths(files.begin(), files.end());
+
+    for(const AsyncImageLoader::loadedImage& loaded : AsyncImageLoader::loadAll(paths,
+                                                                                IMREAD_COLOR,
+                                                                                true))
+    {
+        string name = loaded.path.substr(loaded.path.find_last_of("/\\") + 1);
+
+        if(!loaded.image.empty())
+            images.push_back({name, loaded.image, loaded.bytes});
+    }
+
+    RNG rng(587);
+
+    Mat noise(720, 1280, CV_8UC3);
+    rng.fill(noise, RNG::UNIFORM, Scalar::all(0), Scalar::all(256));
+    images.push_back({"generated/noise", noise});
+
+    Mat gradient(720, 1280, CV_8UC3);
+    for(int i = 0; i < gradient.rows; i++)
+    {
+        for(int j = 0; j < gradient.cols; j++)
+        {
+            gradient.at<Vec3b>(i, j) = Vec3b((uchar)(j * 255 / gradient.cols),
+                                             (uchar)(i * 255 / gradient.rows),
+                                             (uchar)((i + j) % 256));
+        }
+    }
+    images.push_back({"generated/gradient", gradient});
+
+    Mat backdrop(720, 1280, CV_8UC3, Scalar(60, 180, 40));
+    for(int k = 0; k < 40; k++)
+    {
+        Point center(rng.uniform(0, backdrop.cols), rng.uniform(0, backdrop.rows));
+        Scalar color(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256));
+        circle(backdrop, center, rng.uniform(10, 120), color, FILLED);
+    }
+    images.push_back({"generated/backdrop", backdrop});
+
+    return images;
+}
+
+/***************************************************************************************************
+ * Compare Outputs
+ *
+ * @param reference, optimized : Outputs to compare
+ * @param diffPixels : Receives the number of pixels where any channel differs
+ * @param maxError : Receives the largest per-channel difference
+ * @return False if the outputs do not even have the same size and type
+ **************************************************************************************************/
+static bool compareOutputs(const Mat& reference,
+                           const Mat& optimized,
+                           long& diffPixels,
+                           double& maxError)
+{
+    diffPixels = 0;
+    maxError = 0;
+
+    if(reference.size() != optimized.size() || reference.type() != optimized.type())
+        return false;
+
+    Mat a, b;
+    reference.convertTo(a, CV_64F);
+    optimized.convertTo(b, CV_64F);
+
+    int cn = a.channels();
+
+    for(int i = 0; i < a.rows; i++)
+    {
+        const double* rowA = a.ptr<double>(i);
+        const double* rowB = b.ptr<double>(i);
+
+        for(int j = 0; j < a.cols; j++)
+        {
+            double pixelError = 0;
+
+            for(int c = 0; c < cn; c++)
+                pixelError = max(pixelError, abs(rowA[j * cn + c] - rowB[j * cn + c]));
+
+            diffPixels += pixelError > 0;
+            maxError = max(maxError, pixelError);
+        }
+    }
+
+    return true;
+}
+
+/***************************************************************************************************
+ * Time Kernel
+ *
+ * @param kernel : The function to time
+ * @param input : Its input
+ * @param iterations : Number of timed runs
+ * @param output : Receives the output of the last run
+ * @return The median run time in milliseconds
+ **************************************************************************************************/
+static double timeKernel(const function<Mat(const Mat&)>& kernel,
+                         const Mat& input,
+                         int iterations,
+                         Mat& output)
+{
+    vector<double> samples;
+
+    for(int k = 0; k < iterations; k++)
+    {
+        int64 start = getTickCount();
+
+        output = kernel(input);
+
+        samples.push_back((getTickCount() - start) * 1000.0 / getTickFrequency());
+    }
+
+    sort(samples.begin(), samples.end());
+
+    return samples[samples.size() / 2];
+}
+
+/***************************************************************************************************
+ * Run Cases
+ *
+ * Runs each case whose name contains filter on every image and prints a line for each.
+ *
+ * @return The number of kernel and image pairs that failed
+ **************************************************************************************************/
+static int runCases(const vector<kernelCase>& cases,
+                    const vector<namedImage>& images,
+                    const string& filter,
+                    int iterations,
+                    double minSpeedup)
+{
+    int failures = 0;
+
+    printf("%-24s %-24s %10s %8s %10s %10s %8s  %s\n",
+           "kernel", "image", "diff px", "max err", "ref ms", "fast ms", "speedup", "result");
+
+    for(const kernelCase& kernel : cases)
+    {
+        if(!filter.empty() && kernel.name.find(filter) == string::npos)
+            continue;
+
+        for(const namedImage& input : images)
+        {
+            if(kernel.encodedInput && input.encoded.empty())
+                continue;
+
+            Mat kernelInput = kernel.encodedInput ? Mat(input.encoded) : input.image;
+            Mat referenceOutput, optimizedOutput;
+
+            double referenceMs = timeKernel(kernel.reference,
+                                            kernelInput,
+                                            iterations,
+                                            referenceOutput);
+            double optimizedMs = timeKernel(kernel.optimized,
+                                            kernelInput,
+                                            iterations,
+                                            optimizedOutput);
+
+            long diffPixels;
+            double maxError;
+            bool comparable = compareOutputs(referenceOutput,
+                                             optimizedOutput,
+                                             diffPixels,
+                                             maxError);
+
+            double diffFraction = (double)diffPixels / max((size_t)1, referenceOutput.total());
+            double speedup = referenceMs / max(optimizedMs, 1e-6);
+
+            bool correct = comparable &&
+                           maxError <= kernel.maxError &&
+                           diffFraction <= kernel.maxDiffFraction;
+            bool fastEnough = minSpeedup <= 0 || speedup >= minSpeedup;
+
+            string result = !correct ? "FAIL (output)" : (!fastEnough ? "FAIL (speed)" : "ok");
+            failures += !(correct && fastEnough);
+
+            printf("%-24s %-24s %10ld %8.0f %10.2f %10.2f %7.2fx  %s\n",
+                   kernel.name.c_str(),
+                   input.name.substr(0, 24).c_str(),
+                   diffPixels,
+                   maxError,
+                   referenceMs,
+                   optimizedMs,
+                   speedup,
+                   result.c_str());
+        }
+    }
+
+    return failures;
+}
+
+/***************************************************************************************************
+ * Main Function
+ *
+ * Purpose:
+ * Parses the command line, runs every kernel on every image (a second time on a TaskScheduler with
+ * --scheduler), prints a report and returns whether everything passed.
+ *
+ * @return Zero if every kernel matched its reference and was fast enough, one otherwise.
+ **************************************************************************************************/
+int main(int argc, char** argv)
+{
+    string dataDirectory = "../data";
+    int iterations = 5;
+    double minSpeedup = 0;
+    string filter;
+    bool useScheduler = false;
+
+    for(int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+
+        if(arg == "--iterations" && i + 1 < argc)
+            iterations = max(1, atoi(argv[++i]));
+        else if(arg == "--min-speedup" && i + 1 < argc)
+            minSpeedup = atof(argv[++i]);
+        else if(arg == "--kernel" && i + 1 < argc)
+            filter = argv[++i];
+        else if(arg == "--scheduler")
+            useScheduler = true;
+        else
+            dataDirectory = arg;
+    }
+
+    vector<namedImage> images = loadImages(dataDirectory);
+
+    // A fixed tiled pattern, so keying results do not depend on what is in the data directory
+    Mat background(97, 131, CV_8UC3);
+    RNG rng(17);
+    rng.fill(background, RNG::UNIFORM, Scalar::all(0), Scalar::all(256));
+
+    int failures = runCases(buildCases(background), images, filter, iterations, minSpeedup);
+
+    if(useScheduler)
+    {
+        TaskScheduler scheduler;
+        TaskScheduler::install(&scheduler);
+
+        vector<kernelCase> cases = buildCases(background);
+        vector<kernelCase> schedulerCases = buildSchedulerCases();
+        cases.insert(cases.end(), schedulerCases.begin(), schedulerCases.end());
+
+        cout << endl << "With a TaskScheduler of " << scheduler.threads() << " threads:" << endl
+             << endl;
+
+        failures += runCases(cases, images, filter, iterations, minSpeedup);
+    }
+
+    cout << endl << (failures == 0 ? "All kernels passed." : to_string(failures) + " failure(s).")
+         << endl;
+
+    return failures == 0 ? 0 : 1;
+}
@@ -6,6 +6,8 @@
 #include <opencv2/opencv.hpp>
 #include <random>
 
+#include "../Common/PixelKernels.h"
+
 //Basic pixel manipulation
 
 using namespace cv;
@@ -13,35 +15,11 @@ using namespace std;
 
 int main()
 {
+    //May load as grey, BGR or BGRA. The kernel handles each layout.
     Mat test = imread("../data/sadge_bronze.png", IMREAD_UNCHANGED);
 
-    int whiteCount = 0;
-
-    for(int i = 0; i < test.rows; i++)
-    {
-        for(int j = 0; j < test.cols; j++)
-        {
-            Vec3b pixel = test.at<Vec3b>(i, j);
-
-            int blue = pixel[0];
-            int green = pixel[1];
-            int red = pixel[2];
-
-            if(blue < 30 && green < 30 && red < 30)
-            {
-                blue = 255;
-                green = 255;
-                red = 255;
-                whiteCount++;
-            }
-
-            pixel[0] = blue;
-            pixel[1] = green;
-            pixel[2] = red;
-
-            test.at<Vec3b>(i, j) = pixel;
-        }
-    }
+    //Dark pixels become white. The kernel also counts how many it replaced.
+    int whiteCount = PixelKernels::thresholdReplace(test, Vec3b(30, 30, 30), Vec3b(255, 255, 255));
 
     imwrite("../data/output.png", test);
 